@@ -0,0 +1,284 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "asset_manager.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define PLACEHOLDER_SIZE 8
+#define PLACEHOLDER_SQUARES 2
+
+enum asset_type {
+	ASSET_MODEL,
+	ASSET_TEXTURE
+};
+
+struct asset {
+	enum asset_type type;
+	char *path;
+	enum asset_state state;
+	int references;
+	struct model model;
+	struct texture texture;
+	struct asset *next_queued;
+};
+
+struct asset_manager {
+	pthread_t *threads;
+	int thread_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;
+	pthread_cond_t finished;
+	bool quit;
+
+	// Every asset that is referenced or still loading
+	struct asset **assets;
+	int asset_count;
+	int asset_capacity;
+
+	struct asset *queue_head;
+	struct asset *queue_tail;
+	int pending; // Queued or loading
+	int loads;
+
+	asset_ready_callback *callback;
+	void *user_data;
+	struct texture placeholder_texture;
+};
+
+/**
+ Removes an asset from the manager and unloads it. Must be called with the
+ mutex held, for an asset that is not loading.
+ */
+static void free_asset(struct asset_manager *manager, struct asset *asset) {
+	for (int i = 0; i < manager->asset_count; i++) {
+		if (manager->assets[i] == asset) {
+			manager->assets[i] = manager->assets[--manager->asset_count];
+			break;
+		}
+	}
+	if (asset->state == ASSET_READY) {
+		if (asset->type == ASSET_MODEL) {
+			unload_model(asset->model);
+		} else {
+			unload_texture(asset->texture);
+		}
+	}
+	free(asset->path);
+	free(asset);
+}
+
+/**
+ Loads the file of an asset. Only reads the asset's path and type, which
+ never change, so it runs without the mutex.
+ */
+static bool load_asset_file(struct asset *asset, struct model *model, struct texture *texture) {
+	if (asset->type == ASSET_TEXTURE) {
+		return load_texture_file(asset->path, texture);
+	}
+	FILE *fp = fopen(asset->path, "r");
+	if (!fp) {
+		return false;
+	}
+	*model = load_model(fp);
+	fclose(fp);
+	return true;
+}
+
+static void *loader_thread(void *argument) {
+	struct asset_manager *manager = argument;
+	pthread_mutex_lock(&manager->mutex);
+	while (true) {
+		while (!manager->queue_head && !manager->quit) {
+			pthread_cond_wait(&manager->queued, &manager->mutex);
+		}
+		if (!manager->queue_head) {
+			break;
+		}
+
+		struct asset *asset = manager->queue_head;
+		manager->queue_head = asset->next_queued;
+		if (!manager->queue_head) {
+			manager->queue_tail = NULL;
+		}
+		pthread_mutex_unlock(&manager->mutex);
+
+		struct model model = {0};
+		struct texture texture = {0};
+		bool loaded = load_asset_file(asset, &model, &texture);
+
+		pthread_mutex_lock(&manager->mutex);
+		asset->model = model;
+		asset->texture = texture;
+		asset->state = loaded ? ASSET_READY : ASSET_FAILED;
+		manager->loads += loaded;
+		manager->pending--;
+		bool released = asset->references == 0;
+		if (released) {
+			free_asset(manager, asset);
+		}
+		pthread_cond_broadcast(&manager->finished);
+
+		asset_ready_callback *callback = manager->callback;
+		void *user_data = manager->user_data;
+		if (callback && !released) {
+			// Holds a reference so that an asset_release() during the
+			// callback doesn't free the asset under it
+			asset->references++;
+			pthread_mutex_unlock(&manager->mutex);
+			callback(asset, user_data);
+			pthread_mutex_lock(&manager->mutex);
+			if (--asset->references == 0) {
+				free_asset(manager, asset);
+			}
+		}
+	}
+	pthread_mutex_unlock(&manager->mutex);
+	return NULL;
+}
+
+struct asset_manager *create_asset_manager(int threads) {
+	if (threads <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (int)cpus : 1;
+	}
+
+	struct asset_manager *manager = calloc(1, sizeof(struct asset_manager));
+	manager->placeholder_texture = create_checkerboard_texture(PLACEHOLDER_SIZE, PLACEHOLDER_SQUARES);
+	manager->asset_capacity = 16;
+	manager->assets = malloc(sizeof(struct asset *) * manager->asset_capacity);
+	pthread_mutex_init(&manager->mutex, NULL);
+	pthread_cond_init(&manager->queued, NULL);
+	pthread_cond_init(&manager->finished, NULL);
+
+	manager->threads = malloc(sizeof(pthread_t) * threads);
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&manager->threads[manager->thread_count], NULL, &loader_thread, manager) == 0) {
+			manager->thread_count++;
+		}
+	}
+	return manager;
+}
+
+void destroy_asset_manager(struct asset_manager *manager) {
+	asset_manager_wait(manager);
+	pthread_mutex_lock(&manager->mutex);
+	manager->quit = true;
+	pthread_cond_broadcast(&manager->queued);
+	pthread_mutex_unlock(&manager->mutex);
+	for (int i = 0; i < manager->thread_count; i++) {
+		pthread_join(manager->threads[i], NULL);
+	}
+
+	while (manager->asset_count > 0) {
+		free_asset(manager, manager->assets[0]);
+	}
+	pthread_cond_destroy(&manager->finished);
+	pthread_cond_destroy(&manager->queued);
+	pthread_mutex_destroy(&manager->mutex);
+	unload_texture(manager->placeholder_texture);
+	free(manager->threads);
+	free(manager->assets);
+	free(manager);
+}
+
+void asset_manager_set_ready_callback(struct asset_manager *manager, asset_ready_callback *callback, void *user_data) {
+	pthread_mutex_lock(&manager->mutex);
+	manager->callback = callback;
+	manager->user_data = user_data;
+	pthread_mutex_unlock(&manager->mutex);
+}
+
+static struct asset *load_asset(struct asset_manager *manager, enum asset_type type, const char *path) {
+	pthread_mutex_lock(&manager->mutex);
+	for (int i = 0; i < manager->asset_count; i++) {
+		struct asset *asset = manager->assets[i];
+		if (asset->type == type && strcmp(asset->path, path) == 0) {
+			asset->references++;
+			pthread_mutex_unlock(&manager->mutex);
+			return asset;
+		}
+	}
+
+	struct asset *asset = calloc(1, sizeof(struct asset));
+	asset->type = type;
+	asset->path = malloc(strlen(path) + 1);
+	strcpy(asset->path, path);
+	asset->state = ASSET_LOADING;
+	asset->references = 1;
+
+	if (manager->asset_count == manager->asset_capacity) {
+		manager->asset_capacity *= 2;
+		manager->assets = realloc(manager->assets, sizeof(struct asset *) * manager->asset_capacity);
+	}
+	manager->assets[manager->asset_count++] = asset;
+	if (manager->queue_tail) {
+		manager->queue_tail->next_queued = asset;
+	} else {
+		manager->queue_head = asset;
+	}
+	manager->queue_tail = asset;
+	manager->pending++;
+	pthread_cond_signal(&manager->queued);
+	pthread_mutex_unlock(&manager->mutex);
+	return asset;
+}
+
+struct asset *asset_manager_load_model(struct asset_manager *manager, const char *path) {
+	return load_asset(manager, ASSET_MODEL, path);
+}
+
+struct asset *asset_manager_load_texture(struct asset_manager *manager, const char *path) {
+	return load_asset(manager, ASSET_TEXTURE, path);
+}
+
+void asset_release(struct asset_manager *manager, struct asset *asset) {
+	pthread_mutex_lock(&manager->mutex);
+	// An asset that is still loading is freed by the loader when it's done
+	if (--asset->references == 0 && asset->state != ASSET_LOADING) {
+		free_asset(manager, asset);
+	}
+	pthread_mutex_unlock(&manager->mutex);
+}
+
+void asset_manager_wait(struct asset_manager *manager) {
+	pthread_mutex_lock(&manager->mutex);
+	while (manager->pending > 0) {
+		pthread_cond_wait(&manager->finished, &manager->mutex);
+	}
+	pthread_mutex_unlock(&manager->mutex);
+}
+
+enum asset_state asset_get_state(struct asset_manager *manager, struct asset *asset) {
+	pthread_mutex_lock(&manager->mutex);
+	enum asset_state state = asset->state;
+	pthread_mutex_unlock(&manager->mutex);
+	return state;
+}
+
+const char *asset_path(struct asset *asset) {
+	return asset->path;
+}
+
+struct model asset_model(struct asset_manager *manager, struct asset *asset) {
+	pthread_mutex_lock(&manager->mutex);
+	struct model model = asset->state == ASSET_READY ? asset->model : (struct model){0};
+	pthread_mutex_unlock(&manager->mutex);
+	return model;
+}
+
+struct texture asset_texture(struct asset_manager *manager, struct asset *asset) {
+	pthread_mutex_lock(&manager->mutex);
+	struct texture texture = asset->state == ASSET_READY ? asset->texture : manager->placeholder_texture;
+	pthread_mutex_unlock(&manager->mutex);
+	return texture;
+}
+
+int asset_manager_load_count(struct asset_manager *manager) {
+	pthread_mutex_lock(&manager->mutex);
+	int loads = manager->loads;
+	pthread_mutex_unlock(&manager->mutex);
+	return loads;
+}
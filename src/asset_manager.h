@@ -0,0 +1,69 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include "textures.h"
+#include "obj.h"
+
+/**
+ Loads models and textures on a pool of threads. Each file is loaded once:
+ asking for a path that is already loaded (or loading) returns the same asset
+ with one more reference. An asset is unloaded when its last reference is
+ released.
+
+ Until an asset is ready, its accessors return a placeholder, so rendering
+ can start right away: an empty model, or a small checkerboard texture.
+ Assets that fail to load keep their placeholder.
+ */
+struct asset_manager;
+struct asset;
+
+enum asset_state {
+	ASSET_LOADING,
+	ASSET_READY,
+	ASSET_FAILED
+};
+
+/**
+ Called on a loader thread whenever an asset is ready or has failed
+ */
+typedef void asset_ready_callback(struct asset *asset, void *user_data);
+
+/**
+ Creates a manager with the given number of loader threads (0 for one per CPU)
+ */
+struct asset_manager *create_asset_manager(int threads);
+
+/**
+ Waits for loads in progress, then unloads every asset that is still
+ referenced
+ */
+void destroy_asset_manager(struct asset_manager *manager);
+
+void asset_manager_set_ready_callback(struct asset_manager *manager, asset_ready_callback *callback, void *user_data);
+
+struct asset *asset_manager_load_model(struct asset_manager *manager, const char *path);
+struct asset *asset_manager_load_texture(struct asset_manager *manager, const char *path);
+void asset_release(struct asset_manager *manager, struct asset *asset);
+
+/**
+ Blocks until every asset requested so far is ready or has failed
+ */
+void asset_manager_wait(struct asset_manager *manager);
+
+enum asset_state asset_get_state(struct asset_manager *manager, struct asset *asset);
+const char *asset_path(struct asset *asset);
+
+/**
+ The loaded model or texture, or a placeholder if it's not ready. The result
+ stays valid as long as the caller holds its reference to the asset.
+ */
+struct model asset_model(struct asset_manager *manager, struct asset *asset);
+struct texture asset_texture(struct asset_manager *manager, struct asset *asset);
+
+/**
+ Number of files actually loaded, which is less than the number of requests
+ when paths are shared
+ */
+int asset_manager_load_count(struct asset_manager *manager);
+
+#endif
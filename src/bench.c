@@ -0,0 +1,2556 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "graphics_context.h"
+#include "geometry.h"
+#include "textures.h"
+#include "shaders.h"
+#include "object.h"
+#include "scene_graph.h"
+#include "command_buffer.h"
+#include "shadow_map.h"
+#include "wireframe.h"
+#include "checkerboard.h"
+#include "multiprocess.h"
+#include "cpu_kernels.h"
+#include "light_tiles.h"
+#include "compact_mesh.h"
+#include "streamed_mesh.h"
+#include "asset_manager.h"
+#include "scene.h"
+#include "color.h"
+#include "obj.h"
+#include "timing.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ Headless, deterministic benchmark of the rendering pipeline. Every scene is
+ rendered with fixed transforms, lights and a procedural texture, so two runs
+ on the same machine render identical images and can be compared directly.
+
+ A frame is split into stages:
+   clear   - clear() of color and depth buffers
+   vertex  - vertex shading of every face (shade_face)
+   setup   - back-face culling and screen bounds rejection
+   raster  - triangle() without a fragment shader
+   shading - fragment shading, measured as the difference between a full
+             triangle() pass and the raster-only pass
+   present - copying the finished pixel buffer out of the context, which is
+             what a window blit costs without a display attached
+
+ The depth buffer clear is also measured on its own at 4K for every depth
+ format, a scene of many sphere instances is rendered through the scene
+ graph with and without culling and sorting, and a wall in front of many
+ cubes is rendered with and without occlusion culling.
+ */
+
+#define STAGE_COUNT 6
+#define DEPTH_FORMAT_COUNT 3
+#define CLEAR_WIDTH 3840
+#define CLEAR_HEIGHT 2160
+#define CHUNK_FACES 4096
+#define MAX_RESOLUTIONS 16
+#define MAX_SCENES 16
+#define INSTANCE_GRID 10
+#define PICK_GRID 32
+#define BVH_ZOOM 4
+#define SHADOW_MAP_SIZE 512
+#define STREAM_CHUNK_FACES 4096
+#define STREAM_ZOOM 4
+#define STREAM_FRAMES 60
+#define ASSET_REQUESTS_PER_FILE 3
+#define CHECKERBOARD_ROTATION 0.02 // Radians per frame, about what dragging in the viewer does
+#define MAX_WORKER_COUNTS 5
+#define KERNEL_PIXELS (1920 * 1080)
+#define KERNEL_POINTS (256 * 1024)
+
+#define INSTANCE_MESHES 2
+
+enum instancing_mode {
+	INSTANCING_PER_OBJECT,
+	INSTANCING_UNSORTED,
+	INSTANCING_SORTED,
+	INSTANCING_Z_PREPASS,
+	INSTANCING_COMMAND_BUFFER,
+	INSTANCING_COMMAND_QUEUE,
+	INSTANCING_MODE_COUNT
+};
+static const char *instancing_mode_names[INSTANCING_MODE_COUNT] = {
+	"per_object", "culled", "culled_sorted", "z_prepass", "command_buffer", "command_queue"
+};
+
+enum aa_mode { AA_NONE, AA_MSAA4, AA_MSAA8, AA_SSAA4, AA_SSAA16, AA_MODE_COUNT };
+static const char *aa_mode_names[AA_MODE_COUNT] = {"none", "msaa4", "msaa8", "ssaa4", "ssaa16"};
+static const int aa_msaa_samples[AA_MODE_COUNT] = {0, 4, 8, 0, 0};
+static const int aa_supersample_factor[AA_MODE_COUNT] = {1, 1, 1, 2, 4};
+
+enum stage { STAGE_CLEAR, STAGE_VERTEX, STAGE_SETUP, STAGE_RASTER, STAGE_SHADING, STAGE_PRESENT };
+static const char *stage_names[STAGE_COUNT] = {"clear", "vertex", "setup", "raster", "shading", "present"};
+
+struct bench_scene {
+	const char *name;
+	double rotation_y;
+	struct object object;
+};
+
+struct resolution {
+	int width;
+	int height;
+};
+
+struct bench_options {
+	int warmup;
+	int repetitions;
+	int grid_size;
+	int instances;
+	int cubes;
+	int lights;
+	int stream_budget; // MB
+	int workers;
+	const char *json_path;
+	const char *heatmap_directory;
+	enum depth_format depth_format;
+	enum aa_mode aa;
+	bool aa_compare;
+	bool kernel_compare;
+	struct resolution resolutions[MAX_RESOLUTIONS];
+	int resolution_count;
+	const char *scene_names[MAX_SCENES];
+	int scene_count;
+};
+
+struct summary {
+	double mean;
+	double min;
+	double p50;
+	double p90;
+	double p99;
+};
+
+struct bench_result {
+	const char *scene;
+	struct resolution resolution;
+	enum aa_mode aa;
+	int triangles;
+	int visible_triangles;
+	long fragments;
+	struct pipeline_stats stats;
+	struct summary frame;
+	struct summary stages[STAGE_COUNT];
+	struct summary depth_only; // Clearing and drawing only the depth of the front faces
+	size_t arena_high_water; // Most of the context's frame arena used in a frame
+	long arena_allocations;  // Blocks the frame arena allocated during the timed frames
+};
+
+/**
+ Clear cost of the depth buffer at 4K for one format. lazy is what clear()
+ costs per frame. first_touch additionally fills every tile, which is the
+ most a frame can pay for deferred clears. full_fill is the old approach of
+ writing every pixel on clear.
+ */
+struct depth_clear_result {
+	enum depth_format format;
+	struct summary lazy;
+	struct summary first_touch;
+	struct summary full_fill;
+};
+
+/**
+ Anti-aliasing cost and quality on one scene. Errors are mean absolute
+ channel differences against a 16x supersampled reference, over the whole
+ image and over silhouette pixels only (pixels next to the boundary between
+ the model and the background in the aliased image). MSAA only smooths
+ geometry edges, so the silhouette error is the one to compare.
+ */
+struct aa_result {
+	struct bench_result result;
+	double mean_error;
+	double edge_error;
+};
+
+enum kernel_op {
+	KERNEL_FILL,
+	KERNEL_AVERAGE,
+	KERNEL_DEPTH_SPAN,
+	KERNEL_TRANSFORM,
+	KERNEL_OP_COUNT
+};
+
+static const char *kernel_op_names[KERNEL_OP_COUNT] = {
+	"fill", "average_4x", "depth_span", "transform"
+};
+
+/**
+ One kernel level (cpu_kernels.h) of the ones this CPU supports. Each kernel
+ is timed on its own over a 1080p frame of colors (of 4x MSAA samples for
+ average_4x, of depth span points for depth_span) or KERNEL_POINTS points,
+ and head.obj is rendered with 4x MSAA, which clears, resolves and
+ transforms vertices with the kernels. Kernel outputs and the rendered image are compared to those
+ of the scalar kernels, and must be identical.
+ */
+struct kernel_result {
+	enum cpu_kernel_level level;
+	double kernel_ms[KERNEL_OP_COUNT];
+	int mismatched_kernels;
+	struct bench_result frame;
+	long mismatched_pixels;
+};
+
+/**
+ Many instances of sphere.obj in a shuffled 3D grid that is wider than the
+ view, alternating between two textures. per_object calls render_object() for
+ every instance, like a naive main loop. culled renders through the scene
+ graph with frustum culling (using a BVH over the instances), and
+ culled_sorted also sorts the instances front to back. z_prepass draws the
+ depth of the sorted instances first, and then shades them with an equal
+ depth test. command_buffer records
+ every instance into a command buffer and executes it, which sorts by texture
+ and then depth. command_queue does the
+ same on a render thread, recording each frame while the previous one is
+ drawn.
+ */
+struct instancing_result {
+	enum instancing_mode mode;
+	struct resolution resolution;
+	int instances;
+	struct pipeline_stats stats;
+	struct summary frame;
+	size_t arena_high_water;
+	long arena_allocations;
+};
+
+/**
+ BVH over the faces of head.obj: build time on one thread and on every CPU,
+ the shape of the tree, the cost of picking a grid of screen positions with
+ and without the BVH, and the frame time with the model zoomed in so that
+ most of it is outside the view, with and without BVH culling.
+ */
+struct bvh_result {
+	struct resolution resolution;
+	int faces;
+	int nodes;
+	int depth;
+	double sah_cost;
+	struct summary build_single_thread;
+	struct summary build_parallel;
+	int picks;
+	int pick_hits;
+	int pick_mismatches;
+	double pick_bvh_us;
+	double pick_brute_force_us;
+	struct summary frame_bvh;
+	struct summary frame_brute_force;
+	long faces_bvh;
+	long faces_brute_force;
+};
+
+/**
+ A wall in front of a grid of cube.obj instances that is wider than the wall,
+ rendered through the scene graph without and with the wall as an occluder.
+ mismatched_pixels counts pixels that differ between the two images, which
+ should be none.
+ */
+struct occlusion_result {
+	struct resolution resolution;
+	int cubes;
+	struct pipeline_stats stats_off;
+	struct pipeline_stats stats_on;
+	struct summary frame_off;
+	struct summary frame_on;
+	int mismatched_pixels;
+};
+
+/**
+ head.obj with a wireframe overlay. none draws no wireframe. lerp_per_face is
+ how wireframes used to be drawn: the three edges of every front face, with a
+ lerp per pixel. edge_list draws each edge of the front faces once, and
+ edge_list_depth also depth tests it. The lines are also timed on their own.
+ */
+enum wireframe_mode {
+	WIREFRAME_NONE,
+	WIREFRAME_LERP_PER_FACE,
+	WIREFRAME_EDGE_LIST,
+	WIREFRAME_EDGE_LIST_DEPTH,
+	WIREFRAME_MODE_COUNT
+};
+
+static const char *wireframe_mode_names[WIREFRAME_MODE_COUNT] = {
+	"none", "lerp_per_face", "edge_list", "edge_list_depth"
+};
+
+struct wireframe_result {
+	struct resolution resolution;
+	int faces;
+	int edges;
+	struct summary frame[WIREFRAME_MODE_COUNT];
+	struct summary lines[WIREFRAME_MODE_COUNT];
+};
+
+/**
+ head.obj turning a little every frame, rendered at full rate and with
+ temporal checkerboard rendering (checkerboard.h). The checkerboard frame
+ time includes filling in the missing pixels, which is also timed on its
+ own. Errors are mean absolute channel differences from the full rate frames,
+ over all pixels and over the pixels covered by the model.
+ */
+struct checkerboard_result {
+	struct resolution resolution;
+	int frames;
+	long shaded_full;
+	long shaded_checkerboard;
+	struct summary frame_full;
+	struct summary frame_checkerboard;
+	struct summary reconstruction;
+	struct checkerboard_stats stats;
+	double mean_error;
+	double model_error;
+};
+
+enum multiprocess_variant {
+	MULTIPROCESS_FIRST_STATIC,
+	MULTIPROCESS_FIRST_BALANCED,
+	MULTIPROCESS_LAST_BALANCED,
+	MULTIPROCESS_VARIANT_COUNT
+};
+
+static const char *multiprocess_variant_names[MULTIPROCESS_VARIANT_COUNT] = {
+	"sort_first_static", "sort_first_balanced", "sort_last_balanced"
+};
+
+struct multiprocess_run {
+	struct summary frame;
+	double composite_ms;
+	double imbalance; // Slowest worker over the mean worker time, averaged over frames
+	long mismatched_pixels;
+};
+
+/**
+ head.obj turning a little every frame, like the checkerboard benchmark,
+ rendered by 1, 2, 4 and 8 worker processes (multiprocess.h). Sort-first is
+ run with even bands and with balancing, sort-last with balancing. The
+ renderers are started before timing, so frames only include sending the
+ work, rendering and compositing. Every frame is compared to the same frame
+ rendered by render_object in this process.
+ */
+struct multiprocess_result {
+	struct resolution resolution;
+	int frames;
+	struct summary frame_single;
+	int worker_counts[MAX_WORKER_COUNTS];
+	int worker_count_count;
+	struct multiprocess_run runs[MAX_WORKER_COUNTS][MULTIPROCESS_VARIANT_COUNT];
+};
+
+/**
+ head.obj lit from above, with and without a shadow map for that light.
+ frame_shadowed includes rendering the shadow map, which is also timed on
+ its own. Both frames light per fragment, so the difference is the cost of
+ the shadows.
+ */
+struct shadow_result {
+	struct resolution resolution;
+	int map_size;
+	struct summary shadow_map;
+	struct summary frame_plain;
+	struct summary frame_shadowed;
+};
+
+/**
+ The instancing scene lit by many point and spot lights scattered through it.
+ naive evaluates every light at every vertex. tiled bins the lights into
+ screen tiles every frame (which is included in its frame time and also timed
+ on its own) and evaluates only the lights of each vertex's tile. Both must
+ give the same image.
+ */
+struct light_result {
+	struct resolution resolution;
+	int lights;
+	int instances;
+	double lights_per_tile;
+	int max_lights_per_tile;
+	struct summary build;
+	struct summary frame_naive;
+	struct summary frame_tiled;
+	int mismatched_pixels;
+};
+
+/**
+ A scene stored as struct model and as a compact mesh (16 byte vertices).
+ vertex_ms runs the vertex shader for every face once, which for the compact
+ mesh includes decoding. Both frames are rendered by render_object and
+ render_compact_mesh at the first resolution, and their images compared.
+ */
+struct compact_result {
+	const char *scene;
+	struct resolution resolution;
+	int faces;
+	int compact_vertices;
+	size_t model_bytes;
+	size_t compact_bytes;
+	struct summary vertex_model;
+	struct summary vertex_compact;
+	struct summary frame_model;
+	struct summary frame_compact;
+	int mismatched_pixels;
+	double max_error;
+};
+
+/**
+ The grid written as a streamed mesh file, zoomed in STREAM_ZOOM times and
+ panned across from left to right over STREAM_FRAMES frames, with chunks
+ loaded in the background within a memory budget. missing_chunks is the mean
+ number of visible chunks per frame that weren't loaded yet.
+ frames_to_complete counts the frames at the last position until every
+ visible chunk was drawn, waiting for the loader in between. The final image
+ is compared with the whole grid rendered as one compact mesh.
+ */
+struct stream_result {
+	struct resolution resolution;
+	int faces;
+	long file_bytes;
+	struct streamed_mesh_stats stats;
+	struct summary frame;
+	double missing_chunks;
+	long prefetched_chunks;
+	int frames_to_complete;
+	int mismatched_pixels;
+};
+
+/**
+ Every model in model/ requested ASSET_REQUESTS_PER_FILE times, as a scene
+ sharing its assets would. sequential loads each request in turn on one
+ thread. asynchronous goes through an asset manager, which loads each file
+ once on a pool of threads. slowest is the longest time a single file takes
+ on its own, which is the least asynchronous loading can take.
+ */
+struct asset_result {
+	int files;
+	int requests;
+	int loads;
+	double sequential_ms;
+	double asynchronous_ms;
+	double slowest_ms;
+};
+
+struct bench_report {
+	struct bench_result *results;
+	int result_count;
+	struct instancing_result *instancing_results;
+	int instancing_result_count;
+	struct bvh_result bvh;
+	bool has_bvh;
+	struct occlusion_result *occlusion_results;
+	int occlusion_result_count;
+	struct light_result *light_results;
+	int light_result_count;
+	struct shadow_result shadow;
+	bool has_shadow;
+	struct wireframe_result wireframe;
+	bool has_wireframe;
+	struct checkerboard_result checkerboard;
+	bool has_checkerboard;
+	struct multiprocess_result multiprocess;
+	bool has_multiprocess;
+	struct compact_result *compact_results;
+	int compact_result_count;
+	struct stream_result stream;
+	bool has_stream;
+	struct asset_result assets;
+	struct aa_result aa_results[AA_MODE_COUNT];
+	int aa_result_count;
+	struct kernel_result kernel_results[CPU_KERNEL_LEVEL_COUNT];
+	int kernel_result_count;
+	struct depth_clear_result depth_clears[DEPTH_FORMAT_COUNT];
+};
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, int count, double p) {
+	int index = (int)ceil(p / 100.0 * count) - 1;
+	if (index < 0) index = 0;
+	if (index >= count) index = count - 1;
+	return sorted[index];
+}
+
+static struct summary summarize(double *samples, int count) {
+	double *sorted = malloc(sizeof(double) * count);
+	memcpy(sorted, samples, sizeof(double) * count);
+	qsort(sorted, count, sizeof(double), &compare_doubles);
+
+	struct summary s = {.min = sorted[0]};
+	for (int i = 0; i < count; i++) {
+		s.mean += sorted[i] / count;
+	}
+	s.p50 = percentile(sorted, count, 50.0);
+	s.p90 = percentile(sorted, count, 90.0);
+	s.p99 = percentile(sorted, count, 99.0);
+	free(sorted);
+	return s;
+}
+
+// ********** Scenes **********
+
+/**
+ Builds a flat, gently rippled grid of size x size quads (two triangles each)
+ spanning [-1, 1] on the X and Y axes.
+ */
+static struct model make_grid_model(int size) {
+	struct model model;
+	int side = size + 1;
+	model.num_vertices = side * side;
+	model.num_normals = side * side;
+	model.num_textures = side * side;
+	model.num_faces = size * size * 2;
+	model.vertices = malloc(sizeof(vec3) * model.num_vertices);
+	model.normals = malloc(sizeof(vec3) * model.num_normals);
+	model.textures = malloc(sizeof(vec2) * model.num_textures);
+	model.faces = malloc(sizeof(struct face) * model.num_faces);
+
+	const double amplitude = 0.02;
+	const double frequency = 12.0;
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			int i = y * side + x;
+			double u = (double)x / size;
+			double v = (double)y / size;
+			double px = u * 2.0 - 1.0;
+			double py = v * 2.0 - 1.0;
+			model.vertices[i] = (vec3){px, py, amplitude * sin(px * frequency) * cos(py * frequency)};
+			vec3 normal = {-amplitude * frequency * cos(px * frequency) * cos(py * frequency),
+						   amplitude * frequency * sin(px * frequency) * sin(py * frequency),
+						   1.0};
+			model.normals[i] = vec3_unit(normal);
+			model.textures[i] = (vec2){u * 0.999, v * 0.999};
+		}
+	}
+
+	int f = 0;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			int corners[4] = {y * side + x, y * side + x + 1, (y + 1) * side + x, (y + 1) * side + x + 1};
+			int triangles[2][3] = {{corners[0], corners[1], corners[2]}, {corners[2], corners[1], corners[3]}};
+			for (int t = 0; t < 2; t++, f++) {
+				for (int c = 0; c < 3; c++) {
+					model.faces[f].vertices[c] = &model.vertices[triangles[t][c]];
+					model.faces[f].normals[c] = &model.normals[triangles[t][c]];
+					model.faces[f].textures[c] = &model.textures[triangles[t][c]];
+				}
+			}
+		}
+	}
+	return model;
+}
+
+static bool load_model_file(const char *file, struct model *model) {
+	FILE *fp = fopen(file, "r");
+	if (!fp) {
+		fprintf(stderr, "Failed to open model file %s\n", file);
+		return false;
+	}
+	*model = load_model(fp);
+	fclose(fp);
+	return true;
+}
+
+/**
+ Returns a transform that centers a model in a width x height viewport and
+ scales it to fill most of it, using the same axis flips as the viewer.
+ */
+static transform_3d fit_model(struct model model, double rotation_y, int width, int height) {
+	vec3 min = model.vertices[0];
+	vec3 max = model.vertices[0];
+	for (int i = 1; i < model.num_vertices; i++) {
+		vec3 v = model.vertices[i];
+		min = (vec3){fmin(min.x, v.x), fmin(min.y, v.y), fmin(min.z, v.z)};
+		max = (vec3){fmax(max.x, v.x), fmax(max.y, v.y), fmax(max.z, v.z)};
+	}
+	vec3 center = vec3_scale(vec3_add(min, max), 0.5);
+	double extent = fmax(fmax(max.x - min.x, max.y - min.y), max.z - min.z);
+	double scale = 0.8 * fmin(width, height) / (extent > 0.0 ? extent : 1.0);
+
+	transform_3d t = transform_3d_identity;
+	t = transform_3d_scale(t, scale, -scale, -scale); // Flip Y and Z axis to fit coordinate space
+	t = transform_3d_multiply(t, transform_3d_make_rotation_y(rotation_y));
+	t = transform_3d_rotate_x_around_origin(t, 0.3);
+	vec3 offset = transform_3d_apply(center, t);
+	return transform_3d_translate(t, -offset.x, -offset.y, -offset.z);
+}
+
+static struct directional_light scene_lights[] = {
+	{.intensity = {200, 200, 200}, .direction = {0.0, 0.0, 1.0}},
+	{.intensity = {100, 140, 100}, .direction = {0.0, 1.0, 0.0}}
+};
+
+/**
+ The camera and lights shared by every benchmark. Supersampled renders scale
+ the whole view by factor, and shift it so that the factor x factor pixel
+ centers are centered on each output pixel.
+ */
+static struct scene make_scene(struct resolution resolution, int factor) {
+	struct scene scene;
+	double offset = (factor - 1) / 2.0;
+	scene.view = transform_3d_make_translation(resolution.width / 2.0 + offset, resolution.height / 2.0 + offset, 100.0 * factor);
+	scene.perspective = 0.0005 / factor;
+	scene.ambient_light = (rgb_color){20, 20, 20};
+	scene.directional_lights = scene_lights;
+	scene.directional_light_count = sizeof(scene_lights) / sizeof(scene_lights[0]);
+	scene.local_lights = NULL;
+	scene.local_light_count = 0;
+	scene.light_tiles = NULL;
+	return scene;
+}
+
+// ********** Measurement **********
+
+/**
+ Box filters a supersampled image down by factor in each direction (a plain
+ copy for factor 1)
+ */
+static void downsample(uint32_t *source, int width, int height, int factor, uint32_t *destination) {
+	if (factor == 1) {
+		memcpy(destination, source, sizeof(uint32_t) * width * height);
+		return;
+	}
+
+	int destination_width = width / factor;
+	int destination_height = height / factor;
+	int count = factor * factor;
+	for (int y = 0; y < destination_height; y++) {
+		for (int x = 0; x < destination_width; x++) {
+			uint32_t r = 0, g = 0, b = 0;
+			for (int sy = 0; sy < factor; sy++) {
+				uint32_t *row = &source[(y * factor + sy) * width + x * factor];
+				for (int sx = 0; sx < factor; sx++) {
+					r += row[sx] >> 24;
+					g += (row[sx] >> 16) & 0xff;
+					b += (row[sx] >> 8) & 0xff;
+				}
+			}
+			destination[y * destination_width + x] = ((r / count) << 24) | ((g / count) << 16) | ((b / count) << 8) | 0xff;
+		}
+	}
+}
+
+/**
+ Renders one frame of a scene stage by stage. If fragment_shader is NULL,
+ only the raster stage is exercised. Stage times are added to times[].
+ */
+static void run_frame(struct object *object,
+					  struct scene scene,
+					  fragment_shader *fragment_shader,
+					  struct graphics_context *context,
+					  int supersample_factor,
+					  uint32_t *present_buffer,
+					  double times[STAGE_COUNT],
+					  int *visible_triangles)
+{
+	rgb_color clear_color = {0, 0, 0};
+	double start = timing_now_ms();
+	clear(context, clear_color);
+	times[STAGE_CLEAR] += timing_now_ms() - start;
+
+	// Transformed vertices of one chunk of faces at a time
+	struct vertex *vertices = frame_arena_alloc(context->arena, sizeof(struct vertex) * CHUNK_FACES * 3);
+	int *visible = frame_arena_alloc(context->arena, sizeof(int) * CHUNK_FACES);
+
+	struct fragment_shader_input input;
+	input.texture = &object->texture;
+	input.normal_map = &object->normal_map;
+	input.scene = scene;
+	input.stats = NULL;
+
+	*visible_triangles = 0;
+	enum stage raster_stage = fragment_shader ? STAGE_SHADING : STAGE_RASTER;
+	for (int first = 0; first < object->model.num_faces; first += CHUNK_FACES) {
+		int count = object->model.num_faces - first;
+		if (count > CHUNK_FACES) count = CHUNK_FACES;
+
+		double t0 = timing_now_ms();
+		for (int i = 0; i < count; i++) {
+			shade_face(object, scene, &goraud_shader, first + i, &vertices[i * 3]);
+		}
+
+		double t1 = timing_now_ms();
+		int visible_count = 0;
+		for (int i = 0; i < count; i++) {
+			struct vertex *v = &vertices[i * 3];
+			if (face_is_front_facing(v) && triangle_intersects_bounds(v, context)) {
+				visible[visible_count++] = i;
+			}
+		}
+
+		double t2 = timing_now_ms();
+		for (int i = 0; i < visible_count; i++) {
+			triangle(&vertices[visible[i] * 3], input, fragment_shader, context);
+		}
+
+		double t3 = timing_now_ms();
+		times[STAGE_VERTEX] += t1 - t0;
+		times[STAGE_SETUP] += t2 - t1;
+		times[raster_stage] += t3 - t2;
+		*visible_triangles += visible_count;
+	}
+
+	start = timing_now_ms();
+	context_resolve_msaa(context);
+	downsample(context->pixel_buffer, context->width, context->height, supersample_factor, present_buffer);
+	times[STAGE_PRESENT] += timing_now_ms() - start;
+}
+
+/**
+ Benchmarks one scene at one resolution. Supersampled modes render into a
+ larger context and box filter it down in the present stage. If image is not
+ NULL, the final image is copied into it.
+ */
+static struct bench_result run_benchmark(struct bench_scene *bench_scene,
+										 struct resolution resolution,
+										 enum aa_mode aa,
+										 struct bench_options *options,
+										 uint32_t *image)
+{
+	int factor = aa_supersample_factor[aa];
+	struct resolution render_resolution = {resolution.width * factor, resolution.height * factor};
+	struct graphics_context *context = create_context(render_resolution.width, render_resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[aa]);
+	uint32_t *present_buffer = malloc(sizeof(uint32_t) * resolution.width * resolution.height);
+
+	struct scene scene = make_scene(render_resolution, factor);
+
+	struct object *object = &bench_scene->object;
+	object->transform = fit_model(object->model, bench_scene->rotation_y, render_resolution.width, render_resolution.height);
+
+	struct bench_result result = {.scene = bench_scene->name, .resolution = resolution, .aa = aa, .triangles = object->model.num_faces};
+	double *frame_samples = malloc(sizeof(double) * options->repetitions);
+	double *depth_only_samples = malloc(sizeof(double) * options->repetitions);
+	double *stage_samples[STAGE_COUNT];
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		stage_samples[s] = malloc(sizeof(double) * options->repetitions);
+	}
+
+	long arena_allocations = 0;
+	for (int i = 0; i < options->warmup + options->repetitions; i++) {
+		if (i == options->warmup) {
+			arena_allocations = frame_arena_get_stats(context->arena).block_allocations;
+		}
+		double times[STAGE_COUNT] = {0};
+		double raster_only[STAGE_COUNT] = {0};
+		int visible_triangles;
+
+		double depth_start = timing_now_ms();
+		clear(context, (rgb_color){0, 0, 0});
+		render_object_depth(*object, scene, context);
+		double depth_only = timing_now_ms() - depth_start;
+
+		// Raster-only pass first, so the shaded pass leaves the final image in the context
+		run_frame(object, scene, NULL, context, factor, present_buffer, raster_only, &visible_triangles);
+		run_frame(object, scene, &apply_texture_shader, context, factor, present_buffer, times, &visible_triangles);
+
+		times[STAGE_RASTER] = raster_only[STAGE_RASTER];
+		times[STAGE_SHADING] = fmax(times[STAGE_SHADING] - raster_only[STAGE_RASTER], 0.0);
+		if (i < options->warmup) {
+			continue;
+		}
+
+		int sample = i - options->warmup;
+		depth_only_samples[sample] = depth_only;
+		frame_samples[sample] = 0.0;
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			stage_samples[s][sample] = times[s];
+			frame_samples[sample] += times[s];
+		}
+		result.visible_triangles = visible_triangles;
+	}
+
+	struct frame_arena_stats arena = frame_arena_get_stats(context->arena);
+	result.arena_high_water = arena.high_water;
+	result.arena_allocations = arena.block_allocations - arena_allocations;
+
+	// Collect pipeline counters from one extra, untimed frame through render_object
+	context_enable_stats(context, true);
+	context_enable_heatmap(context, options->heatmap_directory != NULL);
+	clear(context, (rgb_color){0, 0, 0});
+	render_object(*object, scene, &goraud_shader, &apply_texture_shader, context);
+	result.stats = context_get_stats(context);
+	result.fragments = result.stats.fragments_generated;
+	if (image) {
+		memcpy(image, present_buffer, sizeof(uint32_t) * resolution.width * resolution.height);
+	}
+	if (options->heatmap_directory) {
+		char file_name[512];
+		snprintf(file_name, sizeof(file_name), "%s/%s_%dx%d_overdraw.bmp", options->heatmap_directory,
+				 bench_scene->name, resolution.width, resolution.height);
+		context_save_heatmap(context, file_name);
+	}
+
+	result.frame = summarize(frame_samples, options->repetitions);
+	result.depth_only = summarize(depth_only_samples, options->repetitions);
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		result.stages[s] = summarize(stage_samples[s], options->repetitions);
+		free(stage_samples[s]);
+	}
+
+	free(depth_only_samples);
+	free(frame_samples);
+	free(present_buffer);
+	destroy_context(context);
+	return result;
+}
+
+static struct depth_clear_result run_depth_clear_benchmark(enum depth_format format, struct bench_options *options) {
+	struct depth_buffer *buffer = create_depth_buffer(CLEAR_WIDTH, CLEAR_HEIGHT, format);
+	int tile_count = buffer->tiles_x * buffer->tiles_y;
+	size_t data_size = (format == DEPTH_FORMAT_UNORM16 ? sizeof(uint16_t) : sizeof(uint32_t)) * CLEAR_WIDTH * CLEAR_HEIGHT;
+	double *samples[3];
+	for (int i = 0; i < 3; i++) {
+		samples[i] = malloc(sizeof(double) * options->repetitions);
+	}
+
+	for (int i = 0; i < options->warmup + options->repetitions; i++) {
+		double t0 = timing_now_ms();
+		depth_buffer_clear(buffer);
+		double t1 = timing_now_ms();
+		for (int tile = 0; tile < tile_count; tile++) {
+			depth_buffer_fill_tile(buffer, tile);
+		}
+		double t2 = timing_now_ms();
+		memset(buffer->data, 0, data_size);
+		double t3 = timing_now_ms();
+
+		if (i >= options->warmup) {
+			samples[0][i - options->warmup] = t1 - t0;
+			samples[1][i - options->warmup] = t2 - t0;
+			samples[2][i - options->warmup] = t3 - t2;
+		}
+	}
+
+	struct depth_clear_result result = {.format = format};
+	result.lazy = summarize(samples[0], options->repetitions);
+	result.first_touch = summarize(samples[1], options->repetitions);
+	result.full_fill = summarize(samples[2], options->repetitions);
+	for (int i = 0; i < 3; i++) {
+		free(samples[i]);
+	}
+	destroy_depth_buffer(buffer);
+	return result;
+}
+
+/**
+ Places instances in a grid of up to INSTANCE_GRID^3 spheres, in a
+ deterministically shuffled order so the submission order is unrelated to depth
+ */
+static void build_instance_scene(struct scene_graph *graph, struct mesh *meshes[INSTANCE_MESHES], int instances, struct resolution resolution) {
+	int grid = INSTANCE_GRID;
+	double spacing = 1.4 * fmax(resolution.width, resolution.height) / grid;
+	double scale = 0.3 * spacing / meshes[0]->bounds_radius;
+
+	int *order = malloc(sizeof(int) * instances);
+	for (int i = 0; i < instances; i++) {
+		order[i] = i;
+	}
+	unsigned int seed = 12345;
+	for (int i = instances - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+		int j = (seed >> 8) % (i + 1);
+		int tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (int i = 0; i < instances; i++) {
+		int cell = order[i] % (grid * grid * grid);
+		double x = (cell % grid - (grid - 1) / 2.0) * spacing;
+		double y = (cell / grid % grid - (grid - 1) / 2.0) * spacing;
+		double z = (cell / (grid * grid) - (grid - 1) / 2.0) * spacing;
+		transform_3d t = transform_3d_identity;
+		t = transform_3d_scale(t, scale, -scale, -scale); // Flip Y and Z axis to fit coordinate space
+		t = transform_3d_translate(t, x, y, z);
+		scene_graph_add_instance(graph, meshes[i % INSTANCE_MESHES], t);
+	}
+	free(order);
+}
+
+static void record_instances(struct command_buffer *buffer, struct scene_graph *graph, struct scene scene) {
+	struct draw_state state = {.vertex_shader = &goraud_shader, .fragment_shader = &apply_texture_shader, .cull_back_faces = true};
+	command_buffer_begin(buffer, scene);
+	command_buffer_clear(buffer, (rgb_color){0, 0, 0});
+	for (int i = 0; i < graph->instance_count; i++) {
+		command_buffer_draw(buffer, graph->instances[i].mesh, graph->instances[i].transform, state);
+	}
+}
+
+static void render_instances(struct scene_graph *graph, enum instancing_mode mode, struct scene scene, struct graphics_context *context) {
+	if (mode == INSTANCING_COMMAND_BUFFER) {
+		struct command_buffer *buffer = create_command_buffer();
+		record_instances(buffer, graph, scene);
+		command_buffer_execute(buffer, context);
+		destroy_command_buffer(buffer);
+		context_resolve_msaa(context);
+		return;
+	}
+
+	clear(context, (rgb_color){0, 0, 0});
+	if (mode == INSTANCING_PER_OBJECT) {
+		for (int i = 0; i < graph->instance_count; i++) {
+			struct instance *instance = &graph->instances[i];
+			struct object object = {.model = instance->mesh->model,
+									.texture = instance->mesh->texture,
+									.normal_map = instance->mesh->normal_map,
+									.transform = instance->transform};
+			render_object(object, scene, &goraud_shader, &apply_texture_shader, context);
+		}
+	} else {
+		graph->sort_front_to_back = mode == INSTANCING_SORTED || mode == INSTANCING_Z_PREPASS;
+		graph->z_prepass = mode == INSTANCING_Z_PREPASS;
+		render_scene_graph(graph, scene, &goraud_shader, &apply_texture_shader, context);
+	}
+	context_resolve_msaa(context);
+}
+
+/**
+ Renders frames through a command queue, recording frame N + 1 while frame N
+ is executed. Returns the time per frame in samples[].
+ */
+/**
+ Returns the number of blocks the context's frame arena allocated during the
+ timed frames
+ */
+static long run_command_queue(struct scene_graph *graph, struct scene scene, struct graphics_context *context,
+							  int warmup, int repetitions, double *samples)
+{
+	long arena_allocations = 0;
+	struct command_queue *queue = create_command_queue(context);
+	struct command_buffer *buffers[2] = {create_command_buffer(), create_command_buffer()};
+	record_instances(buffers[0], graph, scene);
+
+	double start = timing_now_ms();
+	for (int frame = 0; frame < warmup + repetitions; frame++) {
+		if (frame == warmup) {
+			arena_allocations = frame_arena_get_stats(context->arena).block_allocations;
+		}
+		command_queue_submit(queue, buffers[frame % 2]);
+		record_instances(buffers[(frame + 1) % 2], graph, scene);
+		command_queue_wait(queue);
+		context_resolve_msaa(context);
+
+		double end = timing_now_ms();
+		if (frame >= warmup) {
+			samples[frame - warmup] = end - start;
+		}
+		start = end;
+	}
+
+	destroy_command_buffer(buffers[0]);
+	destroy_command_buffer(buffers[1]);
+	destroy_command_queue(queue);
+	return frame_arena_get_stats(context->arena).block_allocations - arena_allocations;
+}
+
+static int run_instancing_benchmark(struct mesh *meshes[INSTANCE_MESHES], struct resolution resolution, struct bench_options *options, struct instancing_result *results) {
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+
+	struct scene scene = make_scene(resolution, 1);
+
+	struct scene_graph *graph = create_scene_graph();
+	build_instance_scene(graph, meshes, options->instances, resolution);
+	scene_graph_build_bvh(graph, 0);
+	double *samples = malloc(sizeof(double) * options->repetitions);
+
+	for (int mode = 0; mode < INSTANCING_MODE_COUNT; mode++) {
+		long arena_allocations = 0;
+		if (mode == INSTANCING_COMMAND_QUEUE) {
+			arena_allocations = run_command_queue(graph, scene, context, options->warmup, options->repetitions, samples);
+		} else {
+			for (int i = 0; i < options->warmup + options->repetitions; i++) {
+				if (i == options->warmup) {
+					arena_allocations = frame_arena_get_stats(context->arena).block_allocations;
+				}
+				double start = timing_now_ms();
+				render_instances(graph, mode, scene, context);
+				if (i >= options->warmup) {
+					samples[i - options->warmup] = timing_now_ms() - start;
+				}
+			}
+			arena_allocations = frame_arena_get_stats(context->arena).block_allocations - arena_allocations;
+		}
+
+		// The command queue renders the same image as a command buffer on this thread
+		context_enable_stats(context, true);
+		render_instances(graph, mode == INSTANCING_COMMAND_QUEUE ? INSTANCING_COMMAND_BUFFER : mode, scene, context);
+		results[mode] = (struct instancing_result){.mode = mode, .resolution = resolution, .instances = graph->instance_count,
+												   .stats = context_get_stats(context), .frame = summarize(samples, options->repetitions),
+												   .arena_high_water = frame_arena_get_stats(context->arena).high_water,
+												   .arena_allocations = arena_allocations};
+		context_enable_stats(context, false);
+	}
+
+	free(samples);
+	destroy_scene_graph(graph);
+	destroy_context(context);
+	return INSTANCING_MODE_COUNT;
+}
+
+/**
+ Scatters point lights, and every fourth a spot light, through the volume of
+ the instancing scene, in view space
+ */
+static struct local_light *make_local_lights(int count, struct resolution resolution, struct scene scene) {
+	double spacing = 1.4 * fmax(resolution.width, resolution.height) / INSTANCE_GRID;
+	double extent = spacing * INSTANCE_GRID / 2.0;
+	struct local_light *lights = malloc(sizeof(struct local_light) * count);
+	unsigned int seed = 4321;
+	for (int i = 0; i < count; i++) {
+		double random[7];
+		for (int r = 0; r < 7; r++) {
+			seed = seed * 1103515245 + 12345;
+			random[r] = ((seed >> 8) & 0xffff) / 65535.0;
+		}
+		vec3 p = {(random[0] * 2.0 - 1.0) * extent, (random[1] * 2.0 - 1.0) * extent, (random[2] * 2.0 - 1.0) * extent};
+		lights[i] = (struct local_light){
+			.type = i % 4 == 3 ? LOCAL_LIGHT_SPOT : LOCAL_LIGHT_POINT,
+			.position = transform_3d_apply(p, scene.view),
+			.intensity = {60 + 140 * random[3], 60 + 140 * random[4], 60 + 140 * random[5]},
+			.radius = (1.0 + random[6]) * spacing,
+			.direction = vec3_unit((vec3){random[3] - 0.5, random[4] - 0.5, random[5] - 0.5}),
+			.cone_cosine = 0.7
+		};
+	}
+	return lights;
+}
+
+static struct light_result run_light_benchmark(struct mesh *meshes[INSTANCE_MESHES], struct resolution resolution, struct bench_options *options) {
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+
+	struct scene scene = make_scene(resolution, 1);
+	scene.local_lights = make_local_lights(options->lights, resolution, scene);
+	scene.local_light_count = options->lights;
+	struct light_tiles *tiles = create_light_tiles(resolution.width, resolution.height);
+
+	struct scene_graph *graph = create_scene_graph();
+	build_instance_scene(graph, meshes, options->instances, resolution);
+	scene_graph_build_bvh(graph, 0);
+
+	struct light_result result = {.resolution = resolution, .lights = options->lights, .instances = graph->instance_count};
+	double *build_samples = malloc(sizeof(double) * options->repetitions);
+	double *frame_samples = malloc(sizeof(double) * options->repetitions);
+	uint32_t *reference = malloc(sizeof(uint32_t) * resolution.width * resolution.height);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			if (pass == 1) {
+				light_tiles_build(tiles, scene);
+				scene.light_tiles = tiles;
+			}
+			double build_end = timing_now_ms();
+			clear(context, (rgb_color){0, 0, 0});
+			render_scene_graph(graph, scene, &goraud_shader, &apply_texture_shader, context);
+			context_resolve_msaa(context);
+			if (i >= options->warmup) {
+				build_samples[i - options->warmup] = build_end - start;
+				frame_samples[i - options->warmup] = timing_now_ms() - start;
+			}
+		}
+
+		if (pass == 0) {
+			result.frame_naive = summarize(frame_samples, options->repetitions);
+			memcpy(reference, context->pixel_buffer, sizeof(uint32_t) * resolution.width * resolution.height);
+		} else {
+			result.build = summarize(build_samples, options->repetitions);
+			result.frame_tiled = summarize(frame_samples, options->repetitions);
+			result.lights_per_tile = light_tiles_average(tiles);
+			result.max_lights_per_tile = light_tiles_max(tiles);
+			for (int p = 0; p < resolution.width * resolution.height; p++) {
+				result.mismatched_pixels += reference[p] != context->pixel_buffer[p];
+			}
+		}
+	}
+
+	free(reference);
+	free(frame_samples);
+	free(build_samples);
+	destroy_scene_graph(graph);
+	destroy_light_tiles(tiles);
+	free(scene.local_lights);
+	destroy_context(context);
+	return result;
+}
+
+/**
+ Places a wall covering the middle of the view at the front, and a grid of
+ cubes behind it that reaches past the wall on every side
+ */
+static void build_occlusion_scene(struct scene_graph *graph, struct mesh *cube, int cubes, struct resolution resolution) {
+	// The extent of the model, to stretch it into a wall
+	vec3 min = cube->model.vertices[0];
+	vec3 max = min;
+	for (int i = 1; i < cube->model.num_vertices; i++) {
+		vec3 p = cube->model.vertices[i];
+		min = (vec3){fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z)};
+		max = (vec3){fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z)};
+	}
+	vec3 size = vec3_subtract(max, min);
+	transform_3d center = transform_3d_make_translation(-cube->bounds_center.x, -cube->bounds_center.y, -cube->bounds_center.z);
+
+	transform_3d wall = transform_3d_scale(center, 0.7 * resolution.width / size.x, -0.7 * resolution.height / size.y, -0.1);
+	wall = transform_3d_translate(wall, 0, 0, -200);
+	int index = scene_graph_add_instance(graph, cube, wall);
+	graph->instances[index].occluder = true;
+
+	int side = (int)ceil(sqrt(cubes));
+	double spacing_x = 1.2 * resolution.width / side;
+	double spacing_y = 1.2 * resolution.height / side;
+	double scale = 0.5 * fmin(spacing_x, spacing_y) / cube->bounds_radius;
+	for (int i = 0; i < cubes; i++) {
+		double x = (i % side - (side - 1) / 2.0) * spacing_x;
+		double y = (i / side - (side - 1) / 2.0) * spacing_y;
+		transform_3d t = transform_3d_multiply(center, transform_3d_make_rotation_y(0.4 + 0.1 * (i % 7)));
+		t = transform_3d_scale(t, scale, -scale, -scale);
+		t = transform_3d_translate(t, x, y, 150 + 20 * (i % 5));
+		scene_graph_add_instance(graph, cube, t);
+	}
+}
+
+static struct occlusion_result run_occlusion_benchmark(struct mesh *cube, struct resolution resolution, struct bench_options *options) {
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+	struct scene scene = make_scene(resolution, 1);
+
+	struct scene_graph *graph = create_scene_graph();
+	build_occlusion_scene(graph, cube, options->cubes, resolution);
+	scene_graph_build_bvh(graph, 0);
+
+	struct occlusion_result result = {.resolution = resolution, .cubes = options->cubes};
+	double *samples = malloc(sizeof(double) * options->repetitions);
+	uint32_t *reference = malloc(sizeof(uint32_t) * resolution.width * resolution.height);
+	for (int pass = 0; pass < 2; pass++) {
+		graph->occlusion_culling = pass == 1;
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			clear(context, (rgb_color){0, 0, 0});
+			render_scene_graph(graph, scene, &goraud_shader, &apply_texture_shader, context);
+			context_resolve_msaa(context);
+			if (i >= options->warmup) {
+				samples[i - options->warmup] = timing_now_ms() - start;
+			}
+		}
+
+		context_enable_stats(context, true);
+		clear(context, (rgb_color){0, 0, 0});
+		render_scene_graph(graph, scene, &goraud_shader, &apply_texture_shader, context);
+		context_resolve_msaa(context);
+		if (pass == 0) {
+			result.stats_off = context_get_stats(context);
+			result.frame_off = summarize(samples, options->repetitions);
+			memcpy(reference, context->pixel_buffer, sizeof(uint32_t) * resolution.width * resolution.height);
+		} else {
+			result.stats_on = context_get_stats(context);
+			result.frame_on = summarize(samples, options->repetitions);
+			for (int p = 0; p < resolution.width * resolution.height; p++) {
+				result.mismatched_pixels += reference[p] != context->pixel_buffer[p];
+			}
+		}
+		context_enable_stats(context, false);
+	}
+
+	free(reference);
+	free(samples);
+	destroy_scene_graph(graph);
+	destroy_context(context);
+	return result;
+}
+
+/**
+ Renders a mesh zoomed in BVH_ZOOM times, and returns the time in samples[]
+ and the number of faces that went through the vertex shader
+ */
+static long run_zoomed_frames(struct mesh *mesh, transform_3d transform, struct scene scene, struct graphics_context *context,
+							  struct bench_options *options, double *samples)
+{
+	transform_3d model_view = transform_3d_multiply(transform, scene.view);
+	struct fragment_shader_input input = {.texture = &mesh->texture, .normal_map = &mesh->normal_map, .scene = scene};
+	for (int i = 0; i < options->warmup + options->repetitions + 1; i++) {
+		bool counted = i == options->warmup + options->repetitions;
+		context_enable_stats(context, counted);
+		input.stats = context->stats;
+
+		double start = timing_now_ms();
+		clear(context, (rgb_color){0, 0, 0});
+		render_mesh(mesh, transform, model_view, scene, &goraud_shader, &apply_texture_shader, input, true, context);
+		context_resolve_msaa(context);
+		if (i >= options->warmup && !counted) {
+			samples[i - options->warmup] = timing_now_ms() - start;
+		}
+	}
+	long faces = context_get_stats(context).faces_submitted;
+	context_enable_stats(context, false);
+	return faces;
+}
+
+static struct bvh_result run_bvh_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct object *object = &bench_scene->object;
+	struct mesh *mesh = create_mesh(object->model, object->texture, object->normal_map);
+	struct bvh_result result = {.resolution = resolution, .faces = object->model.num_faces};
+	double *samples = malloc(sizeof(double) * options->repetitions);
+
+	for (int threads = 1; threads >= 0; threads--) {
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			mesh_build_bvh(mesh, threads);
+			if (i >= options->warmup) {
+				samples[i - options->warmup] = timing_now_ms() - start;
+			}
+		}
+		if (threads == 1) {
+			result.build_single_thread = summarize(samples, options->repetitions);
+		} else {
+			result.build_parallel = summarize(samples, options->repetitions);
+		}
+	}
+	result.nodes = mesh->bvh->node_count;
+	result.depth = mesh->bvh->depth;
+	result.sah_cost = bvh_sah_cost(mesh->bvh);
+
+	// Pick a grid of positions over the whole view, with the BVH and by testing every face
+	struct scene scene = make_scene(resolution, 1);
+	transform_3d model_view = transform_3d_multiply(fit_model(object->model, bench_scene->rotation_y, resolution.width, resolution.height), scene.view);
+	struct pick_result *picks = malloc(sizeof(struct pick_result) * PICK_GRID * PICK_GRID);
+	struct bvh *bvh = mesh->bvh;
+	result.picks = PICK_GRID * PICK_GRID;
+	for (int pass = 0; pass < 2; pass++) {
+		mesh->bvh = pass == 0 ? bvh : NULL;
+		double start = timing_now_ms();
+		for (int i = 0; i < result.picks; i++) {
+			double x = (i % PICK_GRID + 0.5) * resolution.width / PICK_GRID;
+			double y = (i / PICK_GRID + 0.5) * resolution.height / PICK_GRID;
+			struct pick_result pick;
+			bool hit = mesh_pick(mesh, model_view, scene, x, y, &pick);
+			if (pass == 0) {
+				picks[i] = pick;
+				result.pick_hits += hit;
+			} else if (pick.face != picks[i].face && fabs(pick.z - picks[i].z) > 1e-6) {
+				result.pick_mismatches++;
+			}
+		}
+		double us = (timing_now_ms() - start) * 1000.0 / result.picks;
+		if (pass == 0) {
+			result.pick_bvh_us = us;
+		} else {
+			result.pick_brute_force_us = us;
+		}
+	}
+	free(picks);
+
+	// Zoomed in, most of the model is outside the view
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+	transform_3d zoomed = fit_model(object->model, bench_scene->rotation_y, resolution.width * BVH_ZOOM, resolution.height * BVH_ZOOM);
+	mesh->bvh = bvh;
+	result.faces_bvh = run_zoomed_frames(mesh, zoomed, scene, context, options, samples);
+	result.frame_bvh = summarize(samples, options->repetitions);
+	mesh->bvh = NULL;
+	result.faces_brute_force = run_zoomed_frames(mesh, zoomed, scene, context, options, samples);
+	result.frame_brute_force = summarize(samples, options->repetitions);
+	mesh->bvh = bvh;
+
+	destroy_context(context);
+	destroy_mesh(mesh);
+	free(samples);
+	return result;
+}
+
+static struct shadow_result run_shadow_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+
+	// The usual lights, where the one from above gets a shadow map
+	struct directional_light lights[sizeof(scene_lights) / sizeof(scene_lights[0])];
+	memcpy(lights, scene_lights, sizeof(scene_lights));
+	struct scene scene = make_scene(resolution, 1);
+	scene.directional_lights = lights;
+	struct directional_light *light = &lights[1];
+
+	struct object *object = &bench_scene->object;
+	object->transform = fit_model(object->model, bench_scene->rotation_y, resolution.width, resolution.height);
+	transform_3d model_view = transform_3d_multiply(object->transform, scene.view);
+	vec3 min = {INFINITY, INFINITY, INFINITY};
+	vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < object->model.num_vertices; i++) {
+		vec3 p = transform_3d_apply(object->model.vertices[i], model_view);
+		min = (vec3){fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z)};
+		max = (vec3){fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z)};
+	}
+
+	struct shadow_map *map = create_shadow_map(SHADOW_MAP_SIZE);
+	struct shadow_result result = {.resolution = resolution, .map_size = SHADOW_MAP_SIZE};
+	double *map_samples = malloc(sizeof(double) * options->repetitions);
+	double *frame_samples = malloc(sizeof(double) * options->repetitions);
+	for (int pass = 0; pass < 2; pass++) {
+		light->shadow_map = pass == 1 ? map : NULL;
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			if (light->shadow_map) {
+				shadow_map_begin(map, light->direction, min, max);
+				shadow_map_draw_model(map, &object->model, model_view);
+			}
+			double map_end = timing_now_ms();
+			clear(context, (rgb_color){0, 0, 0});
+			render_object(*object, scene, &goraud_shader, &shadowed_texture_shader, context);
+			context_resolve_msaa(context);
+			if (i >= options->warmup) {
+				map_samples[i - options->warmup] = map_end - start;
+				frame_samples[i - options->warmup] = timing_now_ms() - start;
+			}
+		}
+		if (pass == 0) {
+			result.frame_plain = summarize(frame_samples, options->repetitions);
+		} else {
+			result.shadow_map = summarize(map_samples, options->repetitions);
+			result.frame_shadowed = summarize(frame_samples, options->repetitions);
+		}
+	}
+
+	free(frame_samples);
+	free(map_samples);
+	destroy_shadow_map(map);
+	destroy_context(context);
+	return result;
+}
+
+/**
+ Wireframe lines as they were drawn before draw_line_3d(): a lerp and a
+ rounding per pixel, bounds checked and depth tested in front of the near plane
+ */
+static void draw_line_lerp(vec3 p1, vec3 p2, packed_color color, struct graphics_context *context) {
+	double line_width = fabs(p2.x - p1.x);
+	double line_height = fabs(p2.y - p1.y);
+	double length = (line_width > line_height) ? line_width : line_height;
+	for (int i = 0; i < round(length); i++) {
+		double t = (double)i / length;
+		int x = (int)round(p1.x + (p2.x - p1.x) * t);
+		int y = (int)round(p1.y + (p2.y - p1.y) * t);
+		if (x < 0 || x >= context->width || y < 0 || y >= context->height) {
+			continue;
+		}
+		if (depth_buffer_test_and_set(context->depth_buffer, x, y, -9000.0)) {
+			context->pixel_buffer[context->width * y + x] = color;
+		}
+	}
+}
+
+static struct wireframe_result run_wireframe_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	struct scene scene = make_scene(resolution, 1);
+
+	struct object *object = &bench_scene->object;
+	object->transform = fit_model(object->model, bench_scene->rotation_y, resolution.width, resolution.height);
+	transform_3d model_view = transform_3d_multiply(object->transform, scene.view);
+	struct edge_list *edges = create_edge_list(object->model);
+	rgb_color color = {0, 255, 0};
+	packed_color rgba = rgba_from_color(color);
+
+	struct wireframe_result result = {.resolution = resolution, .faces = object->model.num_faces, .edges = edges->count};
+	double *samples = malloc(sizeof(double) * options->repetitions);
+	double *line_samples = malloc(sizeof(double) * options->repetitions);
+	for (int mode = 0; mode < WIREFRAME_MODE_COUNT; mode++) {
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			clear(context, (rgb_color){0, 0, 0});
+			render_object(*object, scene, &goraud_shader, &apply_texture_shader, context);
+			double lines_start = timing_now_ms();
+			if (mode == WIREFRAME_LERP_PER_FACE) {
+				for (int f = 0; f < object->model.num_faces; f++) {
+					vec3 coordinates[3];
+					project_face(object->model.faces[f], model_view, scene, coordinates);
+					if (coordinates_are_front_facing(coordinates)) {
+						for (int c = 0; c < 3; c++) {
+							draw_line_lerp(coordinates[c], coordinates[(c + 1) % 3], rgba, context);
+						}
+					}
+				}
+			} else if (mode == WIREFRAME_EDGE_LIST || mode == WIREFRAME_EDGE_LIST_DEPTH) {
+				render_wireframe(edges, object->model, model_view, scene, color, mode == WIREFRAME_EDGE_LIST_DEPTH, context);
+			}
+			if (i >= options->warmup) {
+				double end = timing_now_ms();
+				samples[i - options->warmup] = end - start;
+				line_samples[i - options->warmup] = end - lines_start;
+			}
+		}
+		result.frame[mode] = summarize(samples, options->repetitions);
+		result.lines[mode] = summarize(line_samples, options->repetitions);
+	}
+
+	free(line_samples);
+	free(samples);
+	destroy_edge_list(edges);
+	destroy_context(context);
+	return result;
+}
+
+static struct stream_result run_stream_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct object *object = &bench_scene->object;
+	struct stream_result result = {.resolution = resolution, .faces = object->model.num_faces, .frames_to_complete = -1};
+	FILE *fp = tmpfile();
+	if (!fp || !write_streamed_mesh(object->model, fp, STREAM_CHUNK_FACES)) {
+		fprintf(stderr, "Failed to write the streamed mesh\n");
+		if (fp) {
+			fclose(fp);
+		}
+		return result;
+	}
+	fseek(fp, 0, SEEK_END);
+	result.file_bytes = ftell(fp);
+	struct streamed_mesh *mesh = open_streamed_mesh(fp, (size_t)options->stream_budget << 20);
+
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+	struct scene scene = make_scene(resolution, 1);
+	transform_3d zoomed = fit_model(object->model, bench_scene->rotation_y, resolution.width * STREAM_ZOOM, resolution.height * STREAM_ZOOM);
+
+	// From the left edge of the zoomed grid to the right edge
+	double range = fmax(0.4 * STREAM_ZOOM * fmin(resolution.width, resolution.height) - resolution.width / 2.0, 0.0);
+	double samples[STREAM_FRAMES];
+	transform_3d transform = zoomed;
+	long missing = 0;
+	for (int i = 0; i < STREAM_FRAMES; i++) {
+		transform = transform_3d_translate(zoomed, range - 2.0 * range * i / (STREAM_FRAMES - 1), 0.0, 0.0);
+		double start = timing_now_ms();
+		clear(context, (rgb_color){0, 0, 0});
+		missing += render_streamed_mesh(mesh, transform, &object->texture, &object->normal_map, scene,
+										&goraud_shader, &apply_texture_shader, context);
+		context_resolve_msaa(context);
+		samples[i] = timing_now_ms() - start;
+		result.prefetched_chunks += streamed_mesh_get_stats(mesh).prefetched_chunks;
+	}
+	result.frame = summarize(samples, STREAM_FRAMES);
+	result.missing_chunks = missing / (double)STREAM_FRAMES;
+
+	for (int i = 1; i <= 100 && result.frames_to_complete < 0; i++) {
+		streamed_mesh_wait(mesh);
+		clear(context, (rgb_color){0, 0, 0});
+		if (render_streamed_mesh(mesh, transform, &object->texture, &object->normal_map, scene,
+								 &goraud_shader, &apply_texture_shader, context) == 0) {
+			result.frames_to_complete = i;
+		}
+	}
+	context_resolve_msaa(context);
+	uint32_t *image = malloc(sizeof(uint32_t) * resolution.width * resolution.height);
+	memcpy(image, context->pixel_buffer, sizeof(uint32_t) * resolution.width * resolution.height);
+	result.stats = streamed_mesh_get_stats(mesh);
+
+	struct compact_mesh *whole = create_compact_mesh(object->model);
+	clear(context, (rgb_color){0, 0, 0});
+	render_compact_mesh(whole, transform, &object->texture, &object->normal_map, scene, &goraud_shader, &apply_texture_shader, context);
+	context_resolve_msaa(context);
+	for (int i = 0; i < resolution.width * resolution.height; i++) {
+		result.mismatched_pixels += image[i] != context->pixel_buffer[i];
+	}
+
+	destroy_compact_mesh(whole);
+	free(image);
+	destroy_context(context);
+	close_streamed_mesh(mesh);
+	fclose(fp);
+	return result;
+}
+
+static struct asset_result run_asset_benchmark(void) {
+	static const char *files[] = {"model/cube.obj", "model/head.obj", "model/rectangle.obj", "model/sphere.obj", "model/triangle.obj"};
+	const int file_count = sizeof(files) / sizeof(files[0]);
+	struct asset_result result = {.files = file_count, .requests = file_count * ASSET_REQUESTS_PER_FILE};
+
+	for (int r = 0; r < ASSET_REQUESTS_PER_FILE; r++) {
+		for (int i = 0; i < file_count; i++) {
+			double start = timing_now_ms();
+			struct model model;
+			if (load_model_file(files[i], &model)) {
+				double time = timing_now_ms() - start;
+				result.sequential_ms += time;
+				result.slowest_ms = fmax(result.slowest_ms, time);
+				unload_model(model);
+			}
+		}
+	}
+
+	double start = timing_now_ms();
+	struct asset_manager *manager = create_asset_manager(0);
+	struct asset *assets[sizeof(files) / sizeof(files[0]) * ASSET_REQUESTS_PER_FILE];
+	for (int r = 0; r < ASSET_REQUESTS_PER_FILE; r++) {
+		for (int i = 0; i < file_count; i++) {
+			assets[r * file_count + i] = asset_manager_load_model(manager, files[i]);
+		}
+	}
+	asset_manager_wait(manager);
+	result.asynchronous_ms = timing_now_ms() - start;
+	result.loads = asset_manager_load_count(manager);
+	for (int i = 0; i < result.requests; i++) {
+		asset_release(manager, assets[i]);
+	}
+	destroy_asset_manager(manager);
+	return result;
+}
+
+static double channel_error(uint32_t a, uint32_t b) {
+	double error = 0.0;
+	for (int shift = 8; shift <= 24; shift += 8) {
+		error += abs((int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff));
+	}
+	return error / 3.0;
+}
+
+static struct checkerboard_result run_checkerboard_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct graphics_context *full = create_context(resolution.width, resolution.height);
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(full, options->depth_format);
+	context_set_depth_format(context, options->depth_format);
+	context_enable_stats(full, true);
+	context_enable_stats(context, true);
+	struct checkerboard *checkerboard = create_checkerboard(resolution.width, resolution.height);
+	struct scene scene = make_scene(resolution, 1);
+	struct object object = bench_scene->object;
+	object.transform = fit_model(object.model, bench_scene->rotation_y, resolution.width, resolution.height);
+
+	int frames = options->warmup + options->repetitions;
+	struct checkerboard_result result = {.resolution = resolution, .frames = options->repetitions};
+	double *full_samples = malloc(sizeof(double) * options->repetitions);
+	double *samples = malloc(sizeof(double) * options->repetitions);
+	double *reconstruction_samples = malloc(sizeof(double) * options->repetitions);
+	double total_error = 0.0;
+	double model_error = 0.0;
+	long model_pixels = 0;
+	rgb_color clear_color = {0, 0, 0};
+	uint32_t background = rgba_from_color(clear_color);
+
+	for (int i = 0; i < frames; i++) {
+		if (i == options->warmup) {
+			context_reset_stats(full);
+			context_reset_stats(context);
+			checkerboard->stats = (struct checkerboard_stats){0};
+		}
+		object.transform = transform_3d_rotate_y_around_origin(object.transform, CHECKERBOARD_ROTATION);
+		transform_3d model_view = transform_3d_multiply(object.transform, scene.view);
+
+		double start = timing_now_ms();
+		// Lit per fragment (without shadow maps), where the fragments skipped
+		// save the most
+		clear(full, clear_color);
+		render_object(object, scene, &goraud_shader, &shadowed_texture_shader, full);
+		double full_end = timing_now_ms();
+
+		checkerboard_begin_frame(checkerboard, context);
+		clear(context, clear_color);
+		render_object(object, scene, &goraud_shader, &shadowed_texture_shader, context);
+		double reconstruction_start = timing_now_ms();
+		checkerboard_end_frame(checkerboard, context, model_view, scene);
+		double end = timing_now_ms();
+
+		if (i >= options->warmup) {
+			full_samples[i - options->warmup] = full_end - start;
+			samples[i - options->warmup] = end - full_end;
+			reconstruction_samples[i - options->warmup] = end - reconstruction_start;
+			for (int p = 0; p < resolution.width * resolution.height; p++) {
+				double error = channel_error(context->pixel_buffer[p], full->pixel_buffer[p]);
+				total_error += error;
+				if (full->pixel_buffer[p] != background) {
+					model_error += error;
+					model_pixels++;
+				}
+			}
+		}
+	}
+
+	result.shaded_full = context_get_stats(full).shader_invocations;
+	result.shaded_checkerboard = context_get_stats(context).shader_invocations;
+	result.frame_full = summarize(full_samples, options->repetitions);
+	result.frame_checkerboard = summarize(samples, options->repetitions);
+	result.reconstruction = summarize(reconstruction_samples, options->repetitions);
+	result.stats = checkerboard->stats;
+	result.mean_error = total_error / ((double)resolution.width * resolution.height * options->repetitions);
+	result.model_error = model_pixels > 0 ? model_error / model_pixels : 0.0;
+
+	free(reconstruction_samples);
+	free(samples);
+	free(full_samples);
+	destroy_checkerboard(checkerboard);
+	destroy_context(context);
+	destroy_context(full);
+	return result;
+}
+
+static struct multiprocess_run run_multiprocess_variant(struct bench_scene *bench_scene,
+														struct bench_options *options,
+														int workers,
+														enum multiprocess_variant variant)
+{
+	struct resolution resolution = options->resolutions[0];
+	struct graphics_context *single = create_context(resolution.width, resolution.height);
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(single, options->depth_format);
+	struct scene scene = make_scene(resolution, 1);
+	struct object object = bench_scene->object;
+	object.transform = fit_model(object.model, bench_scene->rotation_y, resolution.width, resolution.height);
+
+	struct multiprocess_run run = {0};
+	enum multiprocess_mode mode = variant == MULTIPROCESS_LAST_BALANCED ? MULTIPROCESS_SORT_LAST : MULTIPROCESS_SORT_FIRST;
+	struct multiprocess_renderer *renderer = create_multiprocess_renderer(workers, mode, resolution.width, resolution.height,
+																		  object, scene, &goraud_shader, &shadowed_texture_shader);
+	if (!renderer) {
+		fprintf(stderr, "Could not start %d workers\n", workers);
+		destroy_context(context);
+		destroy_context(single);
+		return run;
+	}
+	multiprocess_set_balancing(renderer, variant != MULTIPROCESS_FIRST_STATIC);
+
+	int frames = options->warmup + options->repetitions;
+	double *samples = malloc(sizeof(double) * options->repetitions);
+	double composite_ms = 0.0;
+	double imbalance = 0.0;
+	rgb_color clear_color = {0, 0, 0};
+	bool failed = false;
+
+	for (int i = 0; i < frames && !failed; i++) {
+		object.transform = transform_3d_rotate_y_around_origin(object.transform, CHECKERBOARD_ROTATION);
+
+		double start = timing_now_ms();
+		if (!multiprocess_render(renderer, object.transform, clear_color, context)) {
+			fprintf(stderr, "A worker of %d stopped answering\n", workers);
+			failed = true;
+			continue;
+		}
+		double end = timing_now_ms();
+
+		if (i >= options->warmup) {
+			samples[i - options->warmup] = end - start;
+			struct multiprocess_stats stats = multiprocess_get_stats(renderer);
+			double slowest = 0.0;
+			double total = 0.0;
+			for (int w = 0; w < workers; w++) {
+				slowest = fmax(slowest, stats.worker_ms[w]);
+				total += stats.worker_ms[w];
+			}
+			imbalance += total > 0.0 ? slowest / (total / workers) : 1.0;
+			composite_ms += stats.composite_ms;
+
+			clear(single, clear_color);
+			render_object(object, scene, &goraud_shader, &shadowed_texture_shader, single);
+			for (int p = 0; p < resolution.width * resolution.height; p++) {
+				run.mismatched_pixels += context->pixel_buffer[p] != single->pixel_buffer[p];
+			}
+		}
+	}
+
+	if (failed) {
+		run = (struct multiprocess_run){0};
+	} else {
+		run.frame = summarize(samples, options->repetitions);
+		run.composite_ms = composite_ms / options->repetitions;
+		run.imbalance = imbalance / options->repetitions;
+	}
+
+	free(samples);
+	destroy_multiprocess_renderer(renderer);
+	destroy_context(context);
+	destroy_context(single);
+	return run;
+}
+
+static struct multiprocess_result run_multiprocess_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct multiprocess_result result = {.resolution = resolution, .frames = options->repetitions};
+
+	// The same frames in this process, for the speedup of one worker
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	struct scene scene = make_scene(resolution, 1);
+	struct object object = bench_scene->object;
+	object.transform = fit_model(object.model, bench_scene->rotation_y, resolution.width, resolution.height);
+	double *samples = malloc(sizeof(double) * options->repetitions);
+	for (int i = 0; i < options->warmup + options->repetitions; i++) {
+		object.transform = transform_3d_rotate_y_around_origin(object.transform, CHECKERBOARD_ROTATION);
+		double start = timing_now_ms();
+		clear(context, (rgb_color){0, 0, 0});
+		render_object(object, scene, &goraud_shader, &shadowed_texture_shader, context);
+		if (i >= options->warmup) {
+			samples[i - options->warmup] = timing_now_ms() - start;
+		}
+	}
+	result.frame_single = summarize(samples, options->repetitions);
+	free(samples);
+	destroy_context(context);
+
+	for (int workers = 1; workers <= options->workers && result.worker_count_count < MAX_WORKER_COUNTS; workers *= 2) {
+		int index = result.worker_count_count++;
+		result.worker_counts[index] = workers;
+		for (int variant = 0; variant < MULTIPROCESS_VARIANT_COUNT; variant++) {
+			result.runs[index][variant] = run_multiprocess_variant(bench_scene, options, workers, variant);
+		}
+	}
+	return result;
+}
+
+static struct compact_result run_compact_benchmark(struct bench_scene *bench_scene, struct bench_options *options) {
+	struct resolution resolution = options->resolutions[0];
+	struct graphics_context *context = create_context(resolution.width, resolution.height);
+	context_set_depth_format(context, options->depth_format);
+	context_set_msaa(context, aa_msaa_samples[options->aa]);
+	struct scene scene = make_scene(resolution, 1);
+
+	struct object *object = &bench_scene->object;
+	object->transform = fit_model(object->model, bench_scene->rotation_y, resolution.width, resolution.height);
+	transform_3d model_view = transform_3d_multiply(object->transform, scene.view);
+	struct compact_mesh *mesh = create_compact_mesh(object->model);
+
+	struct compact_result result = {.scene = bench_scene->name,
+									.resolution = resolution,
+									.faces = mesh->num_faces,
+									.compact_vertices = mesh->num_vertices,
+									.model_bytes = model_memory(object->model),
+									.compact_bytes = compact_mesh_memory(mesh)};
+	uint32_t *images[2];
+	double *vertex_samples = malloc(sizeof(double) * options->repetitions);
+	double *frame_samples = malloc(sizeof(double) * options->repetitions);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < options->warmup + options->repetitions; i++) {
+			double start = timing_now_ms();
+			struct vertex vertices[3];
+			for (int f = 0; f < mesh->num_faces; f++) {
+				if (pass == 0) {
+					shade_face(object, scene, &goraud_shader, f, vertices);
+				} else {
+					compact_mesh_shade_face(mesh, f, object->transform, model_view, scene, &goraud_shader, vertices);
+				}
+			}
+			double vertex_end = timing_now_ms();
+			clear(context, (rgb_color){0, 0, 0});
+			if (pass == 0) {
+				render_object(*object, scene, &goraud_shader, &apply_texture_shader, context);
+			} else {
+				render_compact_mesh(mesh, object->transform, &object->texture, &object->normal_map, scene,
+									&goraud_shader, &apply_texture_shader, context);
+			}
+			context_resolve_msaa(context);
+			if (i >= options->warmup) {
+				vertex_samples[i - options->warmup] = vertex_end - start;
+				frame_samples[i - options->warmup] = timing_now_ms() - vertex_end;
+			}
+		}
+		images[pass] = malloc(sizeof(uint32_t) * resolution.width * resolution.height);
+		memcpy(images[pass], context->pixel_buffer, sizeof(uint32_t) * resolution.width * resolution.height);
+		if (pass == 0) {
+			result.vertex_model = summarize(vertex_samples, options->repetitions);
+			result.frame_model = summarize(frame_samples, options->repetitions);
+		} else {
+			result.vertex_compact = summarize(vertex_samples, options->repetitions);
+			result.frame_compact = summarize(frame_samples, options->repetitions);
+		}
+	}
+
+	for (int i = 0; i < resolution.width * resolution.height; i++) {
+		if (images[0][i] != images[1][i]) {
+			result.mismatched_pixels++;
+			result.max_error = fmax(result.max_error, channel_error(images[0][i], images[1][i]));
+		}
+	}
+
+	free(images[0]);
+	free(images[1]);
+	free(frame_samples);
+	free(vertex_samples);
+	destroy_compact_mesh(mesh);
+	destroy_context(context);
+	return result;
+}
+
+/**
+ Renders the head at the first resolution with every anti-aliasing mode, and
+ compares each image with a 16x supersampled reference
+ */
+static int run_aa_comparison(struct bench_scene *bench_scene, struct bench_options *options, struct aa_result *results) {
+	struct resolution resolution = options->resolutions[0];
+	int pixel_count = resolution.width * resolution.height;
+	uint32_t *images[AA_MODE_COUNT];
+	for (int aa = 0; aa < AA_MODE_COUNT; aa++) {
+		images[aa] = malloc(sizeof(uint32_t) * pixel_count);
+		results[aa].result = run_benchmark(bench_scene, resolution, aa, options, images[aa]);
+	}
+
+	// Find the silhouette, where the aliased image switches between background and model
+	bool *silhouette = calloc(pixel_count, sizeof(bool));
+	uint32_t background = 0x000000ff;
+	for (int y = 1; y < resolution.height - 1; y++) {
+		for (int x = 1; x < resolution.width - 1; x++) {
+			int i = y * resolution.width + x;
+			bool is_background = images[AA_NONE][i] == background;
+			int neighbours[4] = {i - 1, i + 1, i - resolution.width, i + resolution.width};
+			for (int n = 0; n < 4; n++) {
+				silhouette[i] |= (images[AA_NONE][neighbours[n]] == background) != is_background;
+			}
+		}
+	}
+
+	uint32_t *reference = images[AA_SSAA16];
+	for (int aa = 0; aa < AA_MODE_COUNT; aa++) {
+		double total = 0.0;
+		double edge_total = 0.0;
+		int edge_pixels = 0;
+		for (int i = 0; i < pixel_count; i++) {
+			double error = channel_error(images[aa][i], reference[i]);
+			total += error;
+			if (silhouette[i]) {
+				edge_total += error;
+				edge_pixels++;
+			}
+		}
+		results[aa].mean_error = total / pixel_count;
+		results[aa].edge_error = edge_pixels > 0 ? edge_total / edge_pixels : 0.0;
+	}
+
+	for (int aa = 0; aa < AA_MODE_COUNT; aa++) {
+		free(images[aa]);
+	}
+	free(silhouette);
+	return AA_MODE_COUNT;
+}
+
+struct kernel_buffers {
+	packed_color *samples;
+	vec3 *points;
+	packed_color *colors;
+	vec3 *transformed;
+	int *span_x;
+	int *span_y;
+	double *span_depth;
+};
+
+static void run_kernel(enum kernel_op op, struct kernel_buffers *buffers) {
+	transform_3d t = transform_3d_translate(transform_3d_rotate_y_around_origin(transform_3d_identity, 0.3), 12.5, -3.25, 40.0);
+	switch (op) {
+	case KERNEL_FILL:
+		packed_fill(buffers->colors, 0x336699ff, KERNEL_PIXELS);
+		break;
+	case KERNEL_AVERAGE:
+		packed_average_samples(buffers->colors, buffers->samples, 4, KERNEL_PIXELS);
+		break;
+	case KERNEL_DEPTH_SPAN:
+		// A span across the whole frame, which is computed the same way in rows
+		cpu_kernels_active()->depth_span(buffers->span_x, buffers->span_y, buffers->span_depth, (vec3){-3.7, 10.2, -500.0},
+										 (vec3){1920.4, 12.9, 9000.0}, KERNEL_PIXELS, 0, KERNEL_PIXELS, 8192.0, 1.0 / 16384.0);
+		break;
+	case KERNEL_TRANSFORM:
+		cpu_kernels_active()->transform_points(buffers->transformed, buffers->points, KERNEL_POINTS, t);
+		break;
+	default:
+		break;
+	}
+}
+
+static int run_kernel_comparison(struct bench_scene *bench_scene, struct bench_options *options, struct kernel_result *results) {
+	struct resolution resolution = options->resolutions[0];
+	int pixel_count = resolution.width * resolution.height;
+	struct kernel_buffers buffers = {
+		.samples = malloc(sizeof(packed_color) * KERNEL_PIXELS * 4),
+		.points = malloc(sizeof(vec3) * KERNEL_POINTS),
+		.colors = malloc(sizeof(packed_color) * KERNEL_PIXELS),
+		.transformed = malloc(sizeof(vec3) * KERNEL_POINTS),
+		.span_x = malloc(sizeof(int) * KERNEL_PIXELS),
+		.span_y = malloc(sizeof(int) * KERNEL_PIXELS),
+		.span_depth = malloc(sizeof(double) * KERNEL_PIXELS)
+	};
+	unsigned int seed = 1234;
+	for (int i = 0; i < KERNEL_PIXELS * 4; i++) {
+		seed = seed * 1103515245 + 12345;
+		packed_color color = (seed & 0xffffff00) | PACKED_COLOR_ALPHA;
+		buffers.samples[i] = color;
+	}
+	for (int i = 0; i < KERNEL_POINTS; i++) {
+		buffers.points[i] = (vec3){(i % 640) * 0.37 - 100.0, (i / 640) * 0.61 - 50.0, (i % 97) * 1.3};
+	}
+
+	// Outputs of the scalar kernels, which every other level must match
+	packed_color *reference_colors[KERNEL_OP_COUNT] = {0};
+	vec3 *reference_points = malloc(sizeof(vec3) * KERNEL_POINTS);
+	int *reference_span_x = malloc(sizeof(int) * KERNEL_PIXELS);
+	int *reference_span_y = malloc(sizeof(int) * KERNEL_PIXELS);
+	double *reference_span_depth = malloc(sizeof(double) * KERNEL_PIXELS);
+	uint32_t *reference_image = malloc(sizeof(uint32_t) * pixel_count);
+	uint32_t *image = malloc(sizeof(uint32_t) * pixel_count);
+
+	enum cpu_kernel_level initial = cpu_kernels_active()->level;
+	int count = 0;
+	for (int level = CPU_KERNELS_SCALAR; level < CPU_KERNEL_LEVEL_COUNT; level++) {
+		if (!cpu_kernels_select(level)) {
+			continue;
+		}
+		struct kernel_result *result = &results[count++];
+		*result = (struct kernel_result){.level = level};
+
+		for (int op = 0; op < KERNEL_OP_COUNT; op++) {
+			double total = 0.0;
+			for (int i = 0; i < options->warmup + options->repetitions; i++) {
+				double start = timing_now_ms();
+				run_kernel(op, &buffers);
+				if (i >= options->warmup) {
+					total += timing_now_ms() - start;
+				}
+			}
+			result->kernel_ms[op] = total / options->repetitions;
+
+			if (op == KERNEL_DEPTH_SPAN) {
+				if (level == CPU_KERNELS_SCALAR) {
+					memcpy(reference_span_x, buffers.span_x, sizeof(int) * KERNEL_PIXELS);
+					memcpy(reference_span_y, buffers.span_y, sizeof(int) * KERNEL_PIXELS);
+					memcpy(reference_span_depth, buffers.span_depth, sizeof(double) * KERNEL_PIXELS);
+				} else if (memcmp(reference_span_x, buffers.span_x, sizeof(int) * KERNEL_PIXELS) != 0 ||
+						   memcmp(reference_span_y, buffers.span_y, sizeof(int) * KERNEL_PIXELS) != 0 ||
+						   memcmp(reference_span_depth, buffers.span_depth, sizeof(double) * KERNEL_PIXELS) != 0) {
+					result->mismatched_kernels++;
+				}
+			} else if (op == KERNEL_TRANSFORM) {
+				if (level == CPU_KERNELS_SCALAR) {
+					memcpy(reference_points, buffers.transformed, sizeof(vec3) * KERNEL_POINTS);
+				} else if (memcmp(reference_points, buffers.transformed, sizeof(vec3) * KERNEL_POINTS) != 0) {
+					result->mismatched_kernels++;
+				}
+			} else if (level == CPU_KERNELS_SCALAR) {
+				reference_colors[op] = malloc(sizeof(packed_color) * KERNEL_PIXELS);
+				memcpy(reference_colors[op], buffers.colors, sizeof(packed_color) * KERNEL_PIXELS);
+			} else if (memcmp(reference_colors[op], buffers.colors, sizeof(packed_color) * KERNEL_PIXELS) != 0) {
+				result->mismatched_kernels++;
+			}
+		}
+
+		result->frame = run_benchmark(bench_scene, resolution, AA_MSAA4, options, level == CPU_KERNELS_SCALAR ? reference_image : image);
+		if (level != CPU_KERNELS_SCALAR) {
+			for (int i = 0; i < pixel_count; i++) {
+				result->mismatched_pixels += image[i] != reference_image[i];
+			}
+		}
+	}
+	cpu_kernels_select(initial);
+
+	for (int op = 0; op < KERNEL_OP_COUNT; op++) {
+		free(reference_colors[op]);
+	}
+	free(reference_points);
+	free(reference_span_x);
+	free(reference_span_y);
+	free(reference_span_depth);
+	free(reference_image);
+	free(image);
+	free(buffers.samples);
+	free(buffers.points);
+	free(buffers.colors);
+	free(buffers.transformed);
+	free(buffers.span_x);
+	free(buffers.span_y);
+	free(buffers.span_depth);
+	return count;
+}
+
+// ********** Output **********
+
+static void print_summary_json(FILE *fp, const char *name, struct summary s) {
+	fprintf(fp, "\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f}",
+			name, s.mean, s.min, s.p50, s.p90, s.p99);
+}
+
+static void print_stats_json(FILE *fp, struct pipeline_stats *st) {
+	fprintf(fp, "{\"instances_submitted\": %ld, \"instances_culled\": %ld, \"instances_occluded\": %ld, "
+			"\"faces_submitted\": %ld, \"faces_back_face_culled\": %ld, \"faces_outside_bounds\": %ld, "
+			"\"fragments_generated\": %ld, \"fragments_depth_rejected\": %ld, \"shader_invocations\": %ld, \"texture_samples\": %ld}",
+			st->instances_submitted, st->instances_culled, st->instances_occluded, st->faces_submitted, st->faces_back_face_culled, st->faces_outside_bounds,
+			st->fragments_generated, st->fragments_depth_rejected, st->shader_invocations, st->texture_samples);
+}
+
+static void write_json(FILE *fp, struct bench_report *report, struct bench_options *options) {
+	fprintf(fp, "{\n  \"benchmark\": \"c3do\",\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"depth_format\": \"%s\",\n  \"kernel_level\": \"%s\",\n  \"results\": [\n",
+			options->warmup, options->repetitions, depth_format_name(options->depth_format), cpu_kernel_level_name(cpu_kernels_active()->level));
+	for (int i = 0; i < report->result_count; i++) {
+		struct bench_result *r = &report->results[i];
+		double seconds = r->frame.mean / 1000.0;
+		fprintf(fp, "    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"aa\": \"%s\", ",
+				r->scene, r->resolution.width, r->resolution.height, aa_mode_names[r->aa]);
+		fprintf(fp, "\"triangles\": %d, \"visible_triangles\": %d, \"fragments\": %ld, ", r->triangles, r->visible_triangles, r->fragments);
+		fprintf(fp, "\"triangles_per_second\": %.1f, \"fragments_per_second\": %.1f,\n     ",
+				r->triangles / seconds, r->fragments / seconds);
+		fprintf(fp, "\"stats\": ");
+		print_stats_json(fp, &r->stats);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_ms", r->frame);
+		fprintf(fp, ",\n     \"stages_ms\": {");
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			fprintf(fp, "%s\n       ", s > 0 ? "," : "");
+			print_summary_json(fp, stage_names[s], r->stages[s]);
+		}
+		fprintf(fp, "},\n     ");
+		print_summary_json(fp, "depth_only_ms", r->depth_only);
+		fprintf(fp, ",\n     \"arena_high_water\": %zu, \"arena_allocations\": %ld", r->arena_high_water, r->arena_allocations);
+		fprintf(fp, "}%s\n", i < report->result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n  \"depth_clear\": [\n");
+	for (int i = 0; i < DEPTH_FORMAT_COUNT; i++) {
+		struct depth_clear_result *r = &report->depth_clears[i];
+		fprintf(fp, "    {\"format\": \"%s\", \"width\": %d, \"height\": %d,\n     ", depth_format_name(r->format), CLEAR_WIDTH, CLEAR_HEIGHT);
+		print_summary_json(fp, "lazy_ms", r->lazy);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "first_touch_ms", r->first_touch);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "full_fill_ms", r->full_fill);
+		fprintf(fp, "}%s\n", i < DEPTH_FORMAT_COUNT - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n  \"instancing\": [\n");
+	for (int i = 0; i < report->instancing_result_count; i++) {
+		struct instancing_result *r = &report->instancing_results[i];
+		fprintf(fp, "    {\"mode\": \"%s\", \"width\": %d, \"height\": %d, \"instances\": %d,\n     \"stats\": ",
+				instancing_mode_names[r->mode], r->resolution.width, r->resolution.height, r->instances);
+		print_stats_json(fp, &r->stats);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_ms", r->frame);
+		fprintf(fp, ",\n     \"arena_high_water\": %zu, \"arena_allocations\": %ld", r->arena_high_water, r->arena_allocations);
+		fprintf(fp, "}%s\n", i < report->instancing_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n  \"occlusion\": [\n");
+	for (int i = 0; i < report->occlusion_result_count; i++) {
+		struct occlusion_result *r = &report->occlusion_results[i];
+		fprintf(fp, "    {\"width\": %d, \"height\": %d, \"cubes\": %d, \"mismatched_pixels\": %d,\n     \"stats_off\": ",
+				r->resolution.width, r->resolution.height, r->cubes, r->mismatched_pixels);
+		print_stats_json(fp, &r->stats_off);
+		fprintf(fp, ",\n     \"stats_on\": ");
+		print_stats_json(fp, &r->stats_on);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_off_ms", r->frame_off);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_on_ms", r->frame_on);
+		fprintf(fp, "}%s\n", i < report->occlusion_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n  \"lights\": [\n");
+	for (int i = 0; i < report->light_result_count; i++) {
+		struct light_result *r = &report->light_results[i];
+		fprintf(fp, "    {\"width\": %d, \"height\": %d, \"lights\": %d, \"instances\": %d, \"tile_size\": %d, "
+				"\"lights_per_tile\": %.2f, \"max_lights_per_tile\": %d, \"mismatched_pixels\": %d,\n     ",
+				r->resolution.width, r->resolution.height, r->lights, r->instances, LIGHT_TILE_SIZE,
+				r->lights_per_tile, r->max_lights_per_tile, r->mismatched_pixels);
+		print_summary_json(fp, "build_ms", r->build);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_naive_ms", r->frame_naive);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_tiled_ms", r->frame_tiled);
+		fprintf(fp, "}%s\n", i < report->light_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+	if (report->has_bvh) {
+		struct bvh_result *r = &report->bvh;
+		fprintf(fp, "  \"bvh\": {\"scene\": \"head\", \"width\": %d, \"height\": %d, \"faces\": %d, \"nodes\": %d, \"depth\": %d, \"sah_cost\": %.2f,\n    ",
+				r->resolution.width, r->resolution.height, r->faces, r->nodes, r->depth, r->sah_cost);
+		print_summary_json(fp, "build_single_thread_ms", r->build_single_thread);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "build_parallel_ms", r->build_parallel);
+		fprintf(fp, ",\n    \"picks\": %d, \"pick_hits\": %d, \"pick_mismatches\": %d, \"pick_bvh_us\": %.3f, \"pick_brute_force_us\": %.3f,\n    ",
+				r->picks, r->pick_hits, r->pick_mismatches, r->pick_bvh_us, r->pick_brute_force_us);
+		fprintf(fp, "\"zoom\": %d, \"faces_bvh\": %ld, \"faces_brute_force\": %ld,\n    ", BVH_ZOOM, r->faces_bvh, r->faces_brute_force);
+		print_summary_json(fp, "frame_bvh_ms", r->frame_bvh);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "frame_brute_force_ms", r->frame_brute_force);
+		fprintf(fp, "},\n");
+	}
+	if (report->has_shadow) {
+		struct shadow_result *r = &report->shadow;
+		fprintf(fp, "  \"shadow\": {\"scene\": \"head\", \"width\": %d, \"height\": %d, \"map_size\": %d,\n    ",
+				r->resolution.width, r->resolution.height, r->map_size);
+		print_summary_json(fp, "shadow_map_ms", r->shadow_map);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "frame_plain_ms", r->frame_plain);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "frame_shadowed_ms", r->frame_shadowed);
+		fprintf(fp, "},\n");
+	}
+	if (report->has_wireframe) {
+		struct wireframe_result *r = &report->wireframe;
+		fprintf(fp, "  \"wireframe\": {\"scene\": \"head\", \"width\": %d, \"height\": %d, \"faces\": %d, \"edges\": %d,\n    \"frame_ms\": {",
+				r->resolution.width, r->resolution.height, r->faces, r->edges);
+		for (int mode = 0; mode < WIREFRAME_MODE_COUNT; mode++) {
+			fprintf(fp, "%s\n      ", mode > 0 ? "," : "");
+			print_summary_json(fp, wireframe_mode_names[mode], r->frame[mode]);
+		}
+		fprintf(fp, "},\n    \"lines_ms\": {");
+		for (int mode = WIREFRAME_LERP_PER_FACE; mode < WIREFRAME_MODE_COUNT; mode++) {
+			fprintf(fp, "%s\n      ", mode > WIREFRAME_LERP_PER_FACE ? "," : "");
+			print_summary_json(fp, wireframe_mode_names[mode], r->lines[mode]);
+		}
+		fprintf(fp, "}},\n");
+	}
+	if (report->has_checkerboard) {
+		struct checkerboard_result *r = &report->checkerboard;
+		fprintf(fp, "  \"checkerboard\": {\"scene\": \"head\", \"width\": %d, \"height\": %d, \"frames\": %d, "
+				"\"shaded_full\": %ld, \"shaded_checkerboard\": %ld, \"reprojected\": %ld, \"interpolated\": %ld, "
+				"\"background\": %ld, \"mean_error\": %.4f, \"model_error\": %.4f,\n    ",
+				r->resolution.width, r->resolution.height, r->frames, r->shaded_full, r->shaded_checkerboard,
+				r->stats.reprojected, r->stats.interpolated, r->stats.background, r->mean_error, r->model_error);
+		print_summary_json(fp, "frame_full_ms", r->frame_full);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "frame_checkerboard_ms", r->frame_checkerboard);
+		fprintf(fp, ",\n    ");
+		print_summary_json(fp, "reconstruction_ms", r->reconstruction);
+		fprintf(fp, "},\n");
+	}
+	if (report->has_multiprocess) {
+		struct multiprocess_result *r = &report->multiprocess;
+		fprintf(fp, "  \"multiprocess\": {\"scene\": \"head\", \"width\": %d, \"height\": %d, \"frames\": %d,\n    ",
+				r->resolution.width, r->resolution.height, r->frames);
+		print_summary_json(fp, "frame_single_ms", r->frame_single);
+		fprintf(fp, ",\n    \"workers\": [");
+		for (int i = 0; i < r->worker_count_count; i++) {
+			fprintf(fp, "%s\n      {\"workers\": %d", i > 0 ? "," : "", r->worker_counts[i]);
+			for (int variant = 0; variant < MULTIPROCESS_VARIANT_COUNT; variant++) {
+				struct multiprocess_run *run = &r->runs[i][variant];
+				fprintf(fp, ",\n       \"%s\": {\"composite_ms\": %.4f, \"imbalance\": %.3f, \"mismatched_pixels\": %ld, ",
+						multiprocess_variant_names[variant], run->composite_ms, run->imbalance, run->mismatched_pixels);
+				print_summary_json(fp, "frame_ms", run->frame);
+				fprintf(fp, "}");
+			}
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "]},\n");
+	}
+	if (report->has_stream) {
+		struct stream_result *r = &report->stream;
+		fprintf(fp, "  \"stream\": {\"scene\": \"grid\", \"width\": %d, \"height\": %d, \"faces\": %d, \"chunks\": %d, "
+				"\"file_bytes\": %ld, \"budget_bytes\": %zu, \"peak_resident_bytes\": %zu, \"loads\": %ld, \"evictions\": %ld, "
+				"\"prefetched_chunks\": %ld, \"missing_chunks\": %.2f, \"frames_to_complete\": %d, \"mismatched_pixels\": %d,\n    ",
+				r->resolution.width, r->resolution.height, r->faces, r->stats.chunks, r->file_bytes, r->stats.memory_budget,
+				r->stats.peak_resident_bytes, r->stats.loads, r->stats.evictions, r->prefetched_chunks, r->missing_chunks,
+				r->frames_to_complete, r->mismatched_pixels);
+		print_summary_json(fp, "frame_ms", r->frame);
+		fprintf(fp, "},\n");
+	}
+	fprintf(fp, "  \"assets\": {\"files\": %d, \"requests\": %d, \"loads\": %d, \"sequential_ms\": %.3f, "
+			"\"asynchronous_ms\": %.3f, \"slowest_ms\": %.3f},\n",
+			report->assets.files, report->assets.requests, report->assets.loads, report->assets.sequential_ms,
+			report->assets.asynchronous_ms, report->assets.slowest_ms);
+	fprintf(fp, "  \"compact_mesh\": [\n");
+	for (int i = 0; i < report->compact_result_count; i++) {
+		struct compact_result *r = &report->compact_results[i];
+		fprintf(fp, "    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"faces\": %d, \"compact_vertices\": %d, "
+				"\"model_bytes\": %zu, \"compact_bytes\": %zu, \"mismatched_pixels\": %d, \"max_error\": %.2f,\n     ",
+				r->scene, r->resolution.width, r->resolution.height, r->faces, r->compact_vertices,
+				r->model_bytes, r->compact_bytes, r->mismatched_pixels, r->max_error);
+		print_summary_json(fp, "vertex_model_ms", r->vertex_model);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "vertex_compact_ms", r->vertex_compact);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_model_ms", r->frame_model);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "frame_compact_ms", r->frame_compact);
+		fprintf(fp, "}%s\n", i < report->compact_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+	fprintf(fp, "  \"antialiasing\": [\n");
+	for (int i = 0; i < report->aa_result_count; i++) {
+		struct aa_result *r = &report->aa_results[i];
+		fprintf(fp, "    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"aa\": \"%s\", \"shader_invocations\": %ld, "
+				"\"mean_error\": %.4f, \"silhouette_error\": %.4f,\n     ",
+				r->result.scene, r->result.resolution.width, r->result.resolution.height, aa_mode_names[r->result.aa],
+				r->result.stats.shader_invocations, r->mean_error, r->edge_error);
+		print_summary_json(fp, "frame_ms", r->result.frame);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "shading_ms", r->result.stages[STAGE_SHADING]);
+		fprintf(fp, "}%s\n", i < report->aa_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+	fprintf(fp, "  \"kernels\": [\n");
+	for (int i = 0; i < report->kernel_result_count; i++) {
+		struct kernel_result *r = &report->kernel_results[i];
+		fprintf(fp, "    {\"level\": \"%s\", \"width\": %d, \"height\": %d, \"aa\": \"%s\", "
+				"\"mismatched_kernels\": %d, \"mismatched_pixels\": %ld,\n     \"kernel_ms\": {",
+				cpu_kernel_level_name(r->level), r->frame.resolution.width, r->frame.resolution.height,
+				aa_mode_names[r->frame.aa], r->mismatched_kernels, r->mismatched_pixels);
+		for (int op = 0; op < KERNEL_OP_COUNT; op++) {
+			fprintf(fp, "%s\"%s\": %.4f", op > 0 ? ", " : "", kernel_op_names[op], r->kernel_ms[op]);
+		}
+		fprintf(fp, "},\n     ");
+		print_summary_json(fp, "frame_ms", r->frame.frame);
+		fprintf(fp, ",\n     ");
+		print_summary_json(fp, "depth_only_ms", r->frame.depth_only);
+		fprintf(fp, "}%s\n", i < report->kernel_result_count - 1 ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+}
+
+static void print_result(struct bench_result *r) {
+	double seconds = r->frame.mean / 1000.0;
+	printf("%-10s %5dx%-5d %-6s %9d tris %10.2f ms (p90 %8.2f) %8.2f Mtri/s %8.2f Mfrag/s |",
+		   r->scene, r->resolution.width, r->resolution.height, aa_mode_names[r->aa], r->triangles,
+		   r->frame.mean, r->frame.p90, r->triangles / seconds / 1e6, r->fragments / seconds / 1e6);
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		printf(" %s %.2f", stage_names[s], r->stages[s].mean);
+	}
+	printf(" | depth-only %.2f | arena %zu KB, %ld mallocs\n", r->depth_only.mean, r->arena_high_water / 1024, r->arena_allocations);
+	fflush(stdout);
+}
+
+// ********** Main **********
+
+static void usage(void) {
+	fputs("Usage: c3do_bench [options]\n"
+		  "  --warmup N          untimed frames per benchmark (default 2)\n"
+		  "  --repetitions N     timed frames per benchmark (default 10)\n"
+		  "  --resolutions LIST  comma separated WxH list (default 320x240,800x800,1920x1080)\n"
+		  "  --scenes LIST       comma separated subset of triangle,cube,sphere,head,grid\n"
+		  "  --grid N            the grid scene has N x N quads (default 1024)\n"
+		  "  --instances N       sphere instances in the instancing benchmark (default 1000, 0 skips it)\n"
+		  "  --cubes N           cubes behind the wall in the occlusion benchmark (default 400, 0 skips it)\n"
+		  "  --lights N          point and spot lights in the instancing scene (default 256, 0 skips it)\n"
+		  "  --stream-budget MB  memory for loaded chunks when streaming the grid (default 16)\n"
+		  "  --workers N         most worker processes in the multi-process benchmark (default 8, 0 skips it)\n"
+		  "  --json FILE         write machine readable results to FILE ('-' for stdout)\n"
+		  "  --heatmap DIR       write an overdraw heatmap BMP per benchmark into DIR\n"
+		  "  --depth-format F    float32 (default), unorm24 or unorm16\n"
+		  "  --aa MODE           none (default), msaa4, msaa8, ssaa4 or ssaa16\n"
+		  "  --aa-compare        compare the cost and quality of every AA mode on head.obj\n"
+		  "  --kernel-compare    time every kernel level this CPU supports, and check they render the same images\n"
+		  "\n"
+		  "Set C3DO_KERNELS to scalar, sse2, avx2 or avx512 to use those kernels instead of the best ones.\n", stderr);
+}
+
+static bool parse_options(int argc, char *argv[], struct bench_options *options) {
+	static char default_resolutions[] = "320x240,800x800,1920x1080";
+	static char default_scenes[] = "triangle,cube,sphere,head,grid";
+	char *resolutions = default_resolutions;
+	char *scenes = default_scenes;
+
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+			options->warmup = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--repetitions") == 0 && has_value) {
+			options->repetitions = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--resolutions") == 0 && has_value) {
+			resolutions = argv[++i];
+		} else if (strcmp(argv[i], "--scenes") == 0 && has_value) {
+			scenes = argv[++i];
+		} else if (strcmp(argv[i], "--grid") == 0 && has_value) {
+			options->grid_size = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--instances") == 0 && has_value) {
+			options->instances = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--cubes") == 0 && has_value) {
+			options->cubes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--lights") == 0 && has_value) {
+			options->lights = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--stream-budget") == 0 && has_value) {
+			options->stream_budget = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--workers") == 0 && has_value) {
+			options->workers = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--json") == 0 && has_value) {
+			options->json_path = argv[++i];
+		} else if (strcmp(argv[i], "--heatmap") == 0 && has_value) {
+			options->heatmap_directory = argv[++i];
+		} else if (strcmp(argv[i], "--aa-compare") == 0) {
+			options->aa_compare = true;
+		} else if (strcmp(argv[i], "--kernel-compare") == 0) {
+			options->kernel_compare = true;
+		} else if (strcmp(argv[i], "--aa") == 0 && has_value) {
+			const char *mode = argv[++i];
+			bool found = false;
+			for (int aa = 0; aa < AA_MODE_COUNT; aa++) {
+				if (strcmp(mode, aa_mode_names[aa]) == 0) {
+					options->aa = aa;
+					found = true;
+				}
+			}
+			if (!found) {
+				return false;
+			}
+		} else if (strcmp(argv[i], "--depth-format") == 0 && has_value) {
+			const char *format = argv[++i];
+			bool found = false;
+			for (int f = 0; f < DEPTH_FORMAT_COUNT; f++) {
+				if (strcmp(format, depth_format_name(f)) == 0) {
+					options->depth_format = f;
+					found = true;
+				}
+			}
+			if (!found) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+	}
+
+	for (char *token = strtok(resolutions, ","); token && options->resolution_count < MAX_RESOLUTIONS; token = strtok(NULL, ",")) {
+		struct resolution r;
+		if (sscanf(token, "%dx%d", &r.width, &r.height) != 2 || r.width <= 0 || r.height <= 0) {
+			return false;
+		}
+		options->resolutions[options->resolution_count++] = r;
+	}
+	for (char *token = strtok(scenes, ","); token && options->scene_count < MAX_SCENES; token = strtok(NULL, ",")) {
+		options->scene_names[options->scene_count++] = token;
+	}
+	return options->repetitions > 0 && options->warmup >= 0 && options->grid_size > 0 && options->instances >= 0 && options->cubes >= 0 && options->lights >= 0 && options->stream_budget > 0 && options->workers >= 0 && options->workers <= MULTIPROCESS_MAX_WORKERS;
+}
+
+int main(int argc, char *argv[]) {
+	struct bench_options options = {.warmup = 2, .repetitions = 10, .grid_size = 1024, .instances = 1000, .cubes = 400, .lights = 256, .stream_budget = 16, .workers = 8};
+	if (!parse_options(argc, argv, &options)) {
+		usage();
+		return 1;
+	}
+
+	struct texture texture = create_checkerboard_texture(256, 16);
+	struct bench_report report = {0};
+	report.results = malloc(sizeof(struct bench_result) * options.scene_count * options.resolution_count);
+	report.compact_results = malloc(sizeof(struct compact_result) * options.scene_count);
+
+	printf("kernels    %s (best on this CPU: %s)\n", cpu_kernel_level_name(cpu_kernels_active()->level),
+		   cpu_kernel_level_name(cpu_kernels_best_level()));
+
+	for (int f = 0; f < DEPTH_FORMAT_COUNT; f++) {
+		struct depth_clear_result *r = &report.depth_clears[f];
+		*r = run_depth_clear_benchmark(f, &options);
+		printf("depth clear %-8s %dx%d: lazy %.4f ms, first touch of every tile %.3f ms, full fill %.3f ms\n",
+			   depth_format_name(f), CLEAR_WIDTH, CLEAR_HEIGHT, r->lazy.mean, r->first_touch.mean, r->full_fill.mean);
+	}
+
+	report.assets = run_asset_benchmark();
+	printf("assets     %d requests for %d files: %.2f ms loading each in turn, %.2f ms through the asset manager (%d loads), "
+		   "%.2f ms for the slowest file\n",
+		   report.assets.requests, report.assets.files, report.assets.sequential_ms, report.assets.asynchronous_ms,
+		   report.assets.loads, report.assets.slowest_ms);
+
+	for (int i = 0; i < options.scene_count; i++) {
+		// The single triangle is modelled facing away from the default camera, so turn it around
+		struct bench_scene bench_scene = {.name = options.scene_names[i], .rotation_y = 0.3};
+		if (strcmp(bench_scene.name, "triangle") == 0) {
+			bench_scene.rotation_y += 3.14159265358979;
+		}
+		if (strcmp(bench_scene.name, "grid") == 0) {
+			bench_scene.object.model = make_grid_model(options.grid_size);
+		} else {
+			char file[256];
+			snprintf(file, sizeof(file), "model/%s.obj", bench_scene.name);
+			if (!load_model_file(file, &bench_scene.object.model)) {
+				return 1;
+			}
+		}
+		bench_scene.object.texture = texture;
+		bench_scene.object.normal_map = texture;
+
+		for (int r = 0; r < options.resolution_count; r++) {
+			report.results[report.result_count] = run_benchmark(&bench_scene, options.resolutions[r], options.aa, &options, NULL);
+			print_result(&report.results[report.result_count++]);
+		}
+
+		struct compact_result *compact = &report.compact_results[report.compact_result_count++];
+		*compact = run_compact_benchmark(&bench_scene, &options);
+		double faces = compact->faces;
+		printf("compact    %5dx%-5d %d faces: %.1f KB as a model, %.1f KB compact (%d vertices), vertex stage "
+			   "%.1f Mvert/s -> %.1f Mvert/s, frame %.2f ms -> %.2f ms, %d pixels differ (max error %.1f)\n",
+			   compact->resolution.width, compact->resolution.height, compact->faces, compact->model_bytes / 1024.0,
+			   compact->compact_bytes / 1024.0, compact->compact_vertices, faces * 3 / compact->vertex_model.mean / 1e3,
+			   faces * 3 / compact->vertex_compact.mean / 1e3, compact->frame_model.mean, compact->frame_compact.mean,
+			   compact->mismatched_pixels, compact->max_error);
+
+		if (strcmp(bench_scene.name, "head") == 0) {
+			struct bvh_result *r = &report.bvh;
+			*r = run_bvh_benchmark(&bench_scene, &options);
+			report.has_bvh = true;
+			printf("bvh        %5dx%-5d %d faces: %d nodes, depth %d, SAH cost %.1f, build %.2f ms (1 thread) %.2f ms (all CPUs)\n",
+				   r->resolution.width, r->resolution.height, r->faces, r->nodes, r->depth, r->sah_cost,
+				   r->build_single_thread.mean, r->build_parallel.mean);
+			printf("           pick %.2f us with BVH, %.2f us testing every face (%d of %d hits, %d mismatches)\n",
+				   r->pick_bvh_us, r->pick_brute_force_us, r->pick_hits, r->picks, r->pick_mismatches);
+			printf("           %dx zoom: %.2f ms, %ld faces shaded with BVH culling, %.2f ms, %ld faces without\n",
+				   BVH_ZOOM, r->frame_bvh.mean, r->faces_bvh, r->frame_brute_force.mean, r->faces_brute_force);
+		}
+
+		if (strcmp(bench_scene.name, "head") == 0) {
+			struct shadow_result *r = &report.shadow;
+			*r = run_shadow_benchmark(&bench_scene, &options);
+			report.has_shadow = true;
+			printf("shadow     %5dx%-5d %dx%d map: %.2f ms to render the map, frame %.2f ms without shadows, %.2f ms with\n",
+				   r->resolution.width, r->resolution.height, r->map_size, r->map_size,
+				   r->shadow_map.mean, r->frame_plain.mean, r->frame_shadowed.mean);
+		}
+
+		if (strcmp(bench_scene.name, "head") == 0) {
+			struct wireframe_result *r = &report.wireframe;
+			*r = run_wireframe_benchmark(&bench_scene, &options);
+			report.has_wireframe = true;
+			printf("wireframe  %5dx%-5d %d faces, %d edges: frame %.2f ms without |",
+				   r->resolution.width, r->resolution.height, r->faces, r->edges, r->frame[WIREFRAME_NONE].mean);
+			for (int mode = WIREFRAME_NONE + 1; mode < WIREFRAME_MODE_COUNT; mode++) {
+				printf(" %s %.2f", wireframe_mode_names[mode], r->frame[mode].mean);
+			}
+			printf("\n           lines %.3f ms per face with a lerp per pixel, %.3f ms from the edge list, %.3f ms depth tested\n",
+				   r->lines[WIREFRAME_LERP_PER_FACE].mean, r->lines[WIREFRAME_EDGE_LIST].mean,
+				   r->lines[WIREFRAME_EDGE_LIST_DEPTH].mean);
+		}
+
+		if (strcmp(bench_scene.name, "head") == 0) {
+			struct checkerboard_result *r = &report.checkerboard;
+			*r = run_checkerboard_benchmark(&bench_scene, &options);
+			report.has_checkerboard = true;
+			printf("checker    %5dx%-5d %.2f ms at full rate, %.2f ms checkerboard (%.2f ms filling in), %ld -> %ld fragments shaded\n",
+				   r->resolution.width, r->resolution.height, r->frame_full.mean, r->frame_checkerboard.mean,
+				   r->reconstruction.mean, r->shaded_full, r->shaded_checkerboard);
+			printf("           %ld pixels reprojected, %ld interpolated, %ld background, error vs full rate: mean %.3f, on the model %.3f\n",
+				   r->stats.reprojected, r->stats.interpolated, r->stats.background, r->mean_error, r->model_error);
+		}
+
+		if (strcmp(bench_scene.name, "head") == 0 && options.workers > 0) {
+			struct multiprocess_result *r = &report.multiprocess;
+			*r = run_multiprocess_benchmark(&bench_scene, &options);
+			report.has_multiprocess = true;
+			printf("multiproc  %5dx%-5d %.2f ms in this process\n", r->resolution.width, r->resolution.height, r->frame_single.mean);
+			for (int i = 0; i < r->worker_count_count; i++) {
+				printf("           %d worker%s:", r->worker_counts[i], r->worker_counts[i] > 1 ? "s" : " ");
+				for (int variant = 0; variant < MULTIPROCESS_VARIANT_COUNT; variant++) {
+					struct multiprocess_run *run = &r->runs[i][variant];
+					printf(" %s %.2f ms (%.2fx, imbalance %.2f, composite %.2f ms, %ld differ)%s", multiprocess_variant_names[variant],
+						   run->frame.mean, run->frame.mean > 0.0 ? r->frame_single.mean / run->frame.mean : 0.0,
+						   run->imbalance, run->composite_ms, run->mismatched_pixels,
+						   variant + 1 < MULTIPROCESS_VARIANT_COUNT ? "\n                     " : "\n");
+				}
+			}
+		}
+
+		if (strcmp(bench_scene.name, "grid") == 0) {
+			struct stream_result *r = &report.stream;
+			*r = run_stream_benchmark(&bench_scene, &options);
+			report.has_stream = true;
+			printf("stream     %5dx%-5d %d faces in %d chunks, %.1f MB file, %d MB budget: %.2f ms per frame, %.1f chunks missing per frame\n",
+				   r->resolution.width, r->resolution.height, r->faces, r->stats.chunks, r->file_bytes / 1048576.0,
+				   options.stream_budget, r->frame.mean, r->missing_chunks);
+			printf("           peak %.1f MB loaded, %ld loads, %ld evictions, %ld prefetched, complete after %d frames, %d pixels differ\n",
+				   r->stats.peak_resident_bytes / 1048576.0, r->stats.loads, r->stats.evictions, r->prefetched_chunks,
+				   r->frames_to_complete, r->mismatched_pixels);
+		}
+
+		if (options.aa_compare && strcmp(bench_scene.name, "head") == 0) {
+			report.aa_result_count = run_aa_comparison(&bench_scene, &options, report.aa_results);
+			for (int aa = 0; aa < report.aa_result_count; aa++) {
+				struct aa_result *r = &report.aa_results[aa];
+				print_result(&r->result);
+				printf("    error vs ssaa16: mean %.3f, silhouette %.3f\n", r->mean_error, r->edge_error);
+			}
+		}
+
+		if (options.kernel_compare && strcmp(bench_scene.name, "head") == 0) {
+			report.kernel_result_count = run_kernel_comparison(&bench_scene, &options, report.kernel_results);
+			for (int i = 0; i < report.kernel_result_count; i++) {
+				struct kernel_result *r = &report.kernel_results[i];
+				printf("kernels    %-7s", cpu_kernel_level_name(r->level));
+				for (int op = 0; op < KERNEL_OP_COUNT; op++) {
+					printf(" %s %.3f", kernel_op_names[op], r->kernel_ms[op]);
+				}
+				printf(" ms\n           %dx%d msaa4 frame %.2f ms, depth-only %.2f ms | %d kernels and %ld pixels differ from scalar\n",
+					   r->frame.resolution.width, r->frame.resolution.height, r->frame.frame.mean, r->frame.depth_only.mean,
+					   r->mismatched_kernels, r->mismatched_pixels);
+			}
+		}
+		unload_model(bench_scene.object.model);
+	}
+
+	if (options.instances > 0) {
+		struct model sphere;
+		if (!load_model_file("model/sphere.obj", &sphere)) {
+			return 1;
+		}
+		struct texture second_texture = create_checkerboard_texture(256, 4);
+		struct mesh *meshes[INSTANCE_MESHES] = {create_mesh(sphere, texture, texture), create_mesh(sphere, second_texture, second_texture)};
+		report.instancing_results = malloc(sizeof(struct instancing_result) * INSTANCING_MODE_COUNT * options.resolution_count);
+		for (int r = 0; r < options.resolution_count; r++) {
+			struct instancing_result *results = &report.instancing_results[report.instancing_result_count];
+			report.instancing_result_count += run_instancing_benchmark(meshes, options.resolutions[r], &options, results);
+			for (int mode = 0; mode < INSTANCING_MODE_COUNT; mode++) {
+				struct instancing_result *result = &results[mode];
+				printf("instances  %5dx%-5d %-14s %5d spheres %9.2f ms (p90 %8.2f) | culled %ld, shaded %ld, depth rejected %ld "
+					   "| arena %zu KB, %ld mallocs\n",
+					   result->resolution.width, result->resolution.height, instancing_mode_names[mode], result->instances,
+					   result->frame.mean, result->frame.p90, result->stats.instances_culled,
+					   result->stats.shader_invocations, result->stats.fragments_depth_rejected,
+					   result->arena_high_water / 1024, result->arena_allocations);
+			}
+		}
+		if (options.lights > 0) {
+			report.light_results = malloc(sizeof(struct light_result) * options.resolution_count);
+			for (int r = 0; r < options.resolution_count; r++) {
+				struct light_result *result = &report.light_results[report.light_result_count++];
+				*result = run_light_benchmark(meshes, options.resolutions[r], &options);
+				printf("lights     %5dx%-5d %5d lights: naive %.2f ms | tiled %.2f ms (binning %.3f ms, %.1f lights per tile, at most %d) "
+					   "| %d pixels differ\n",
+					   result->resolution.width, result->resolution.height, result->lights, result->frame_naive.mean,
+					   result->frame_tiled.mean, result->build.mean, result->lights_per_tile, result->max_lights_per_tile,
+					   result->mismatched_pixels);
+			}
+		}
+		for (int m = 0; m < INSTANCE_MESHES; m++) {
+			destroy_mesh(meshes[m]);
+		}
+		unload_texture(second_texture);
+		unload_model(sphere);
+	}
+
+	if (options.cubes > 0) {
+		struct model cube_model;
+		if (!load_model_file("model/cube.obj", &cube_model)) {
+			return 1;
+		}
+		struct mesh *cube = create_mesh(cube_model, texture, texture);
+		report.occlusion_results = malloc(sizeof(struct occlusion_result) * options.resolution_count);
+		for (int r = 0; r < options.resolution_count; r++) {
+			struct occlusion_result *result = &report.occlusion_results[report.occlusion_result_count++];
+			*result = run_occlusion_benchmark(cube, options.resolutions[r], &options);
+			printf("occlusion  %5dx%-5d %5d cubes: off %.2f ms, %ld faces submitted | on %.2f ms, %ld faces submitted, "
+				   "%ld cubes occluded | %d pixels differ\n",
+				   result->resolution.width, result->resolution.height, result->cubes,
+				   result->frame_off.mean, result->stats_off.faces_submitted, result->frame_on.mean,
+				   result->stats_on.faces_submitted, result->stats_on.instances_occluded, result->mismatched_pixels);
+		}
+		destroy_mesh(cube);
+		unload_model(cube_model);
+	}
+
+	if (options.json_path) {
+		FILE *fp = strcmp(options.json_path, "-") == 0 ? stdout : fopen(options.json_path, "w");
+		if (!fp) {
+			fprintf(stderr, "Failed to open %s\n", options.json_path);
+			return 1;
+		}
+		write_json(fp, &report, &options);
+		if (fp != stdout) {
+			fclose(fp);
+		}
+	}
+
+	free(report.results);
+	free(report.instancing_results);
+	free(report.occlusion_results);
+	free(report.light_results);
+	free(report.compact_results);
+	unload_texture(texture);
+	return 0;
+}
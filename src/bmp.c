@@ -0,0 +1,200 @@
+#include "bmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_MAX_SIZE (1 << 16) // Largest width or height read
+
+enum bmp_compression {
+	BI_RGB = 0,
+	BI_BITFIELDS = 3
+};
+
+static uint32_t read_u16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_u16(uint8_t *p, uint32_t value) {
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+static void write_u32(uint8_t *p, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		p[i] = (value >> (8 * i)) & 0xff;
+	}
+}
+
+/**
+ Reads the whole file into memory
+ */
+static uint8_t *read_file(const char *file_name, size_t *size) {
+	FILE *fp = fopen(file_name, "rb");
+	if (!fp) {
+		return NULL;
+	}
+	uint8_t *data = NULL;
+	size_t capacity = 0;
+	*size = 0;
+	while (true) {
+		if (*size == capacity) {
+			capacity = capacity ? capacity * 2 : 64 * 1024;
+			data = realloc(data, capacity);
+		}
+		size_t read = fread(data + *size, 1, capacity - *size, fp);
+		if (read == 0) {
+			break;
+		}
+		*size += read;
+	}
+	fclose(fp);
+	return data;
+}
+
+/**
+ A channel of a BI_BITFIELDS pixel, scaled to 8 bits
+ */
+static uint32_t mask_channel(uint32_t pixel, uint32_t mask) {
+	if (!mask) {
+		return 0;
+	}
+	int shift = 0;
+	while (!(mask & (1u << shift))) {
+		shift++;
+	}
+	uint32_t max = mask >> shift;
+	return (((pixel & mask) >> shift) * 255 + max / 2) / max;
+}
+
+bool bmp_read(const char *file_name, uint32_t **pixels, int *width, int *height) {
+	size_t size;
+	uint8_t *data = read_file(file_name, &size);
+	if (!data) {
+		return false;
+	}
+	if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') {
+		free(data);
+		return false;
+	}
+
+	uint32_t offset = read_u32(&data[10]);
+	uint8_t *info = &data[BMP_FILE_HEADER_SIZE];
+	uint32_t info_size = read_u32(&info[0]);
+	int w = (int32_t)read_u32(&info[4]);
+	int h = (int32_t)read_u32(&info[8]);
+	int bits = read_u16(&info[14]);
+	uint32_t compression = read_u32(&info[16]);
+	uint32_t colors_used = read_u32(&info[32]);
+	// Checked before negating, which INT_MIN doesn't survive
+	if (w > BMP_MAX_SIZE || h > BMP_MAX_SIZE || h < -BMP_MAX_SIZE ||
+		info_size < BMP_INFO_HEADER_SIZE || BMP_FILE_HEADER_SIZE + (size_t)info_size > size) {
+		free(data);
+		return false;
+	}
+
+	// BI_BITFIELDS masks follow a BITMAPINFOHEADER, and are part of the later headers
+	uint32_t masks[4] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0};
+	if (compression == BI_BITFIELDS && bits == 32 &&
+		BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 12 <= size) {
+		for (int i = 0; i < 3; i++) {
+			masks[i] = read_u32(&info[BMP_INFO_HEADER_SIZE + 4 * i]);
+		}
+		masks[3] = info_size >= 56 ? read_u32(&info[BMP_INFO_HEADER_SIZE + 12]) : 0;
+	}
+
+	bool top_down = h < 0;
+	h = top_down ? -h : h;
+
+	size_t stride = ((size_t)w * bits + 31) / 32 * 4;
+	uint8_t *palette = &info[info_size];
+	size_t palette_size = colors_used && colors_used < 256 ? colors_used : 256;
+	bool supported = w > 0 && h > 0 &&
+		(compression == BI_RGB || (compression == BI_BITFIELDS && bits == 32)) &&
+		(bits == 8 || bits == 24 || bits == 32) &&
+		offset <= size && stride <= (size - offset) / h &&
+		(bits != 8 || BMP_FILE_HEADER_SIZE + info_size + palette_size * 4 <= offset);
+	if (!supported) {
+		free(data);
+		return false;
+	}
+
+	uint32_t *result = malloc(sizeof(uint32_t) * w * h);
+	for (int y = 0; y < h; y++) {
+		uint8_t *row = &data[offset + stride * (top_down ? y : h - 1 - y)];
+		uint32_t *out = &result[(size_t)w * y];
+		for (int x = 0; x < w; x++) {
+			uint32_t r, g, b, a = 0xff;
+			if (bits == 8) {
+				uint8_t *entry = &palette[4 * (row[x] < palette_size ? row[x] : 0)];
+				b = entry[0];
+				g = entry[1];
+				r = entry[2];
+			} else if (bits == 24) {
+				b = row[3 * x];
+				g = row[3 * x + 1];
+				r = row[3 * x + 2];
+			} else {
+				uint32_t pixel = read_u32(&row[4 * x]);
+				r = mask_channel(pixel, masks[0]);
+				g = mask_channel(pixel, masks[1]);
+				b = mask_channel(pixel, masks[2]);
+				a = masks[3] ? mask_channel(pixel, masks[3]) : 0xff;
+			}
+			out[x] = (r << 24) | (g << 16) | (b << 8) | a;
+		}
+	}
+	free(data);
+
+	*pixels = result;
+	*width = w;
+	*height = h;
+	return true;
+}
+
+uint8_t *bmp_encode(const uint32_t *pixels, int width, int height, size_t *size) {
+	size_t offset = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+	size_t image_size = sizeof(uint32_t) * width * height;
+	uint8_t *data = calloc(1, offset + image_size);
+
+	data[0] = 'B';
+	data[1] = 'M';
+	write_u32(&data[2], offset + image_size);
+	write_u32(&data[10], offset);
+	uint8_t *info = &data[BMP_FILE_HEADER_SIZE];
+	write_u32(&info[0], BMP_INFO_HEADER_SIZE);
+	write_u32(&info[4], width);
+	write_u32(&info[8], -height); // Top-down, so rows are in the same order as pixel_buffer
+	write_u16(&info[12], 1);
+	write_u16(&info[14], 32);
+	write_u32(&info[16], BI_RGB);
+	write_u32(&info[20], image_size);
+
+	// BI_RGB stores blue, green, red and an unused byte
+	uint8_t *out = &data[offset];
+	for (int i = 0; i < width * height; i++) {
+		uint32_t pixel = pixels[i];
+		out[4 * i] = (pixel >> 8) & 0xff;
+		out[4 * i + 1] = (pixel >> 16) & 0xff;
+		out[4 * i + 2] = pixel >> 24;
+		out[4 * i + 3] = 0;
+	}
+	*size = offset + image_size;
+	return data;
+}
+
+bool bmp_write(const char *file_name, const uint32_t *pixels, int width, int height) {
+	FILE *fp = fopen(file_name, "wb");
+	if (!fp) {
+		return false;
+	}
+	size_t size;
+	uint8_t *data = bmp_encode(pixels, width, height, &size);
+	bool written = fwrite(data, 1, size, fp) == size;
+	free(data);
+	return fclose(fp) == 0 && written;
+}
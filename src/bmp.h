@@ -0,0 +1,29 @@
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ Reading and writing uncompressed BMP files, with pixels in the layout of
+ pixel_buffer and textures (0xRRGGBBAA, top row first).
+
+ Reads 8-bit paletted, 24-bit and 32-bit files (with the default masks or
+ BI_BITFIELDS masks), bottom-up or top-down. Writes 32-bit files.
+ */
+
+/**
+ Returns false if the file can't be opened or isn't a BMP this can read.
+ Otherwise *pixels is allocated with malloc.
+ */
+bool bmp_read(const char *file_name, uint32_t **pixels, int *width, int *height);
+
+/**
+ Encodes pixels as a BMP file in memory, allocated with malloc
+ */
+uint8_t *bmp_encode(const uint32_t *pixels, int width, int height, size_t *size);
+
+bool bmp_write(const char *file_name, const uint32_t *pixels, int width, int height);
+
+#endif
@@ -0,0 +1,318 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "bvh.h"
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define BIN_COUNT 16
+#define MAX_LEAF_SIZE 8
+#define TRAVERSAL_COST 1.0
+#define INTERSECTION_COST 1.0
+
+// Subtrees with fewer primitives than this are always built on the current thread
+#define PARALLEL_THRESHOLD 4096
+
+struct build_node {
+	vec3 min;
+	vec3 max;
+	struct build_node *children[2];
+	int first;
+	int count;
+	int node_count; // Nodes in this subtree, including this one
+	int depth;		// Levels in this subtree
+};
+
+struct build_context {
+	const vec3 *mins;
+	const vec3 *maxes;
+	vec3 *centroids;
+	int *primitives;
+	int parallel_depth;
+};
+
+struct build_task {
+	struct build_context *context;
+	int first;
+	int count;
+	int depth;
+	struct build_node *result;
+};
+
+static struct build_node *build_node(struct build_context *context, int first, int count, int depth);
+
+static double box_area(vec3 min, vec3 max) {
+	vec3 d = vec3_subtract(max, min);
+	return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void box_grow(vec3 *min, vec3 *max, vec3 box_min, vec3 box_max) {
+	*min = (vec3){fmin(min->x, box_min.x), fmin(min->y, box_min.y), fmin(min->z, box_min.z)};
+	*max = (vec3){fmax(max->x, box_max.x), fmax(max->y, box_max.y), fmax(max->z, box_max.z)};
+}
+
+static double axis(vec3 v, int a) {
+	return a == 0 ? v.x : (a == 1 ? v.y : v.z);
+}
+
+static void *build_task_run(void *argument) {
+	struct build_task *task = argument;
+	task->result = build_node(task->context, task->first, task->count, task->depth);
+	return NULL;
+}
+
+static struct build_node *make_leaf(struct build_node *node, int first, int count) {
+	node->first = first;
+	node->count = count;
+	node->children[0] = node->children[1] = NULL;
+	node->node_count = 1;
+	node->depth = 1;
+	return node;
+}
+
+/**
+ Finds the best binned SAH split over all three axes. Returns the sum of
+ area * count of both sides (INFINITY if nothing can be split), and the axis
+ and bin boundary (primitives in bins < split go left) of the split.
+ */
+static double find_split(struct build_context *context, int first, int count, vec3 centroid_min, vec3 centroid_max,
+						 int *best_axis, int *best_split)
+{
+	double best_cost = INFINITY;
+	for (int a = 0; a < 3; a++) {
+		double low = axis(centroid_min, a);
+		double extent = axis(centroid_max, a) - low;
+		if (extent <= 0.0) {
+			continue;
+		}
+
+		int counts[BIN_COUNT] = {0};
+		vec3 bin_min[BIN_COUNT];
+		vec3 bin_max[BIN_COUNT];
+		for (int b = 0; b < BIN_COUNT; b++) {
+			bin_min[b] = (vec3){INFINITY, INFINITY, INFINITY};
+			bin_max[b] = (vec3){-INFINITY, -INFINITY, -INFINITY};
+		}
+		for (int i = first; i < first + count; i++) {
+			int p = context->primitives[i];
+			int b = (int)((axis(context->centroids[p], a) - low) / extent * BIN_COUNT);
+			b = b >= BIN_COUNT ? BIN_COUNT - 1 : b;
+			counts[b]++;
+			box_grow(&bin_min[b], &bin_max[b], context->mins[p], context->maxes[p]);
+		}
+
+		// Sweep from the right to get the area and count of every right side,
+		// then from the left to evaluate each split
+		double right_area[BIN_COUNT];
+		int right_count[BIN_COUNT];
+		vec3 min = {INFINITY, INFINITY, INFINITY};
+		vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+		int total = 0;
+		for (int b = BIN_COUNT - 1; b > 0; b--) {
+			if (counts[b] > 0) {
+				box_grow(&min, &max, bin_min[b], bin_max[b]);
+			}
+			total += counts[b];
+			right_area[b] = total > 0 ? box_area(min, max) : 0.0;
+			right_count[b] = total;
+		}
+
+		min = (vec3){INFINITY, INFINITY, INFINITY};
+		max = (vec3){-INFINITY, -INFINITY, -INFINITY};
+		total = 0;
+		for (int b = 1; b < BIN_COUNT; b++) {
+			if (counts[b - 1] > 0) {
+				box_grow(&min, &max, bin_min[b - 1], bin_max[b - 1]);
+			}
+			total += counts[b - 1];
+			if (total == 0 || right_count[b] == 0) {
+				continue;
+			}
+			double cost = box_area(min, max) * total + right_area[b] * right_count[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				*best_axis = a;
+				*best_split = b;
+			}
+		}
+	}
+	return best_cost;
+}
+
+static struct build_node *build_node(struct build_context *context, int first, int count, int depth) {
+	struct build_node *node = malloc(sizeof(struct build_node));
+	node->min = (vec3){INFINITY, INFINITY, INFINITY};
+	node->max = (vec3){-INFINITY, -INFINITY, -INFINITY};
+	vec3 centroid_min = node->min;
+	vec3 centroid_max = node->max;
+	for (int i = first; i < first + count; i++) {
+		int p = context->primitives[i];
+		box_grow(&node->min, &node->max, context->mins[p], context->maxes[p]);
+		box_grow(&centroid_min, &centroid_max, context->centroids[p], context->centroids[p]);
+	}
+
+	if (count <= 1 || depth >= BVH_MAX_DEPTH - 1) {
+		return make_leaf(node, first, count);
+	}
+
+	int split_axis = 0;
+	int split_bin = 0;
+	double split_area = find_split(context, first, count, centroid_min, centroid_max, &split_axis, &split_bin);
+	double area = box_area(node->min, node->max);
+	double leaf_cost = INTERSECTION_COST * count;
+	double split_cost = TRAVERSAL_COST + INTERSECTION_COST * (area > 0.0 ? split_area / area : count);
+
+	int middle;
+	if (split_area == INFINITY) {
+		// All centroids in the same place, so SAH can't separate them
+		if (count <= MAX_LEAF_SIZE) {
+			return make_leaf(node, first, count);
+		}
+		middle = first + count / 2;
+	} else {
+		if (split_cost >= leaf_cost && count <= MAX_LEAF_SIZE) {
+			return make_leaf(node, first, count);
+		}
+
+		// Partition the primitives in place around the split
+		double low = axis(centroid_min, split_axis);
+		double extent = axis(centroid_max, split_axis) - low;
+		int i = first;
+		int j = first + count - 1;
+		while (i <= j) {
+			int b = (int)((axis(context->centroids[context->primitives[i]], split_axis) - low) / extent * BIN_COUNT);
+			b = b >= BIN_COUNT ? BIN_COUNT - 1 : b;
+			if (b < split_bin) {
+				i++;
+			} else {
+				int tmp = context->primitives[i];
+				context->primitives[i] = context->primitives[j];
+				context->primitives[j--] = tmp;
+			}
+		}
+		middle = i;
+	}
+
+	int left_count = middle - first;
+	int right_count = count - left_count;
+	if (depth < context->parallel_depth && left_count >= PARALLEL_THRESHOLD && right_count >= PARALLEL_THRESHOLD) {
+		struct build_task task = {.context = context, .first = first, .count = left_count, .depth = depth + 1};
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, &build_task_run, &task) == 0) {
+			node->children[1] = build_node(context, middle, right_count, depth + 1);
+			pthread_join(thread, NULL);
+			node->children[0] = task.result;
+		} else {
+			node->children[0] = build_node(context, first, left_count, depth + 1);
+			node->children[1] = build_node(context, middle, right_count, depth + 1);
+		}
+	} else {
+		node->children[0] = build_node(context, first, left_count, depth + 1);
+		node->children[1] = build_node(context, middle, right_count, depth + 1);
+	}
+
+	node->first = first;
+	node->count = 0;
+	node->node_count = 1 + node->children[0]->node_count + node->children[1]->node_count;
+	int child_depth = node->children[0]->depth > node->children[1]->depth ? node->children[0]->depth : node->children[1]->depth;
+	node->depth = 1 + child_depth;
+	return node;
+}
+
+static float round_down(double value) {
+	float f = (float)value;
+	return (double)f > value ? nextafterf(f, -INFINITY) : f;
+}
+
+static float round_up(double value) {
+	float f = (float)value;
+	return (double)f < value ? nextafterf(f, INFINITY) : f;
+}
+
+/**
+ Writes a subtree depth first into the node array, and frees it
+ */
+static void flatten(struct build_node *node, struct bvh_node *nodes, int index) {
+	struct bvh_node *flat = &nodes[index];
+	flat->min[0] = round_down(node->min.x);
+	flat->min[1] = round_down(node->min.y);
+	flat->min[2] = round_down(node->min.z);
+	flat->max[0] = round_up(node->max.x);
+	flat->max[1] = round_up(node->max.y);
+	flat->max[2] = round_up(node->max.z);
+
+	if (node->count > 0) {
+		flat->offset = node->first;
+		flat->count = node->count;
+	} else {
+		int second = index + 1 + node->children[0]->node_count;
+		flat->offset = second;
+		flat->count = 0;
+		flatten(node->children[0], nodes, index + 1);
+		flatten(node->children[1], nodes, second);
+	}
+	free(node);
+}
+
+struct bvh *build_bvh(const vec3 *mins, const vec3 *maxes, int count, int threads) {
+	if (threads <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (int)cpus : 1;
+	}
+
+	struct build_context context = {.mins = mins, .maxes = maxes};
+	context.centroids = malloc(sizeof(vec3) * (count > 0 ? count : 1));
+	context.primitives = malloc(sizeof(int) * (count > 0 ? count : 1));
+	for (int i = 0; i < count; i++) {
+		context.centroids[i] = vec3_scale(vec3_add(mins[i], maxes[i]), 0.5);
+		context.primitives[i] = i;
+	}
+
+	// Every parallel split doubles the number of threads, so stop after log2(threads) levels
+	context.parallel_depth = 0;
+	while ((1 << context.parallel_depth) < threads) {
+		context.parallel_depth++;
+	}
+
+	struct bvh *bvh = malloc(sizeof(struct bvh));
+	bvh->primitives = context.primitives;
+	bvh->primitive_count = count;
+	bvh->node_count = 0;
+	bvh->depth = 0;
+	bvh->nodes = NULL;
+	if (count > 0) {
+		struct build_node *root = build_node(&context, 0, count, 0);
+		bvh->node_count = root->node_count;
+		bvh->depth = root->depth;
+		bvh->nodes = malloc(sizeof(struct bvh_node) * bvh->node_count);
+		flatten(root, bvh->nodes, 0);
+	}
+
+	free(context.centroids);
+	return bvh;
+}
+
+void destroy_bvh(struct bvh *bvh) {
+	free(bvh->nodes);
+	free(bvh->primitives);
+	free(bvh);
+}
+
+double bvh_sah_cost(struct bvh *bvh) {
+	if (bvh->node_count == 0) {
+		return 0.0;
+	}
+	double root_area = box_area(bvh_node_min(&bvh->nodes[0]), bvh_node_max(&bvh->nodes[0]));
+	if (root_area <= 0.0) {
+		return INTERSECTION_COST * bvh->primitive_count;
+	}
+
+	double cost = 0.0;
+	for (int i = 0; i < bvh->node_count; i++) {
+		struct bvh_node *node = &bvh->nodes[i];
+		double probability = box_area(bvh_node_min(node), bvh_node_max(node)) / root_area;
+		cost += probability * (bvh_node_is_leaf(node) ? INTERSECTION_COST * node->count : TRAVERSAL_COST);
+	}
+	return cost;
+}
@@ -0,0 +1,65 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "geometry.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/**
+ Traversal stacks of this size can never overflow, the builder stops
+ splitting at this depth.
+ */
+#define BVH_MAX_DEPTH 64
+
+/**
+ A node in the flattened, depth-first node array. The first child of an
+ interior node is always the next node in the array, so only the second
+ child's index is stored. Bounds are single precision, rounded outwards.
+ */
+struct bvh_node {
+	float min[3];
+	float max[3];
+	int32_t offset;	// Leaves: first index in bvh->primitives. Interior nodes: index of the second child
+	int32_t count;	// Primitives in a leaf, 0 for interior nodes
+};
+
+/**
+ A bounding volume hierarchy over a set of axis-aligned boxes, built with
+ the surface area heuristic. The primitives of a leaf are
+ primitives[offset] to primitives[offset + count - 1], as indices into the
+ boxes that were passed to build_bvh(). A BVH over no boxes has no nodes.
+ */
+struct bvh {
+	struct bvh_node *nodes;
+	int node_count;
+	int *primitives;
+	int primitive_count;
+	int depth;
+};
+
+/**
+ Builds a BVH over count boxes. Large subtrees are built in parallel on up
+ to threads threads (0 uses one per CPU, 1 builds on the calling thread).
+ */
+struct bvh *build_bvh(const vec3 *mins, const vec3 *maxes, int count, int threads);
+void destroy_bvh(struct bvh *bvh);
+
+/**
+ Expected cost of a traversal according to the surface area heuristic, in
+ units of one primitive test. Useful to compare builds.
+ */
+double bvh_sah_cost(struct bvh *bvh);
+
+static inline bool bvh_node_is_leaf(const struct bvh_node *node) {
+	return node->count > 0;
+}
+
+static inline vec3 bvh_node_min(const struct bvh_node *node) {
+	return (vec3){node->min[0], node->min[1], node->min[2]};
+}
+
+static inline vec3 bvh_node_max(const struct bvh_node *node) {
+	return (vec3){node->max[0], node->max[1], node->max[2]};
+}
+
+#endif
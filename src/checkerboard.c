@@ -0,0 +1,218 @@
+#include "checkerboard.h"
+#include "shaders.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ How far (in Z-values) the previous depth at a reprojected pixel can be from
+ the expected depth before the previous color is rejected. Covers rounding
+ to the nearest previous pixel on sloped surfaces.
+ */
+#define REPROJECTION_DEPTH_TOLERANCE 4.0
+
+struct checkerboard *create_checkerboard(int width, int height) {
+	struct checkerboard *checkerboard = calloc(1, sizeof(struct checkerboard));
+	checkerboard->width = width;
+	checkerboard->height = height;
+	checkerboard->history = malloc(sizeof(uint32_t) * width * height);
+	checkerboard->history_depth = malloc(sizeof(float) * width * height);
+	checkerboard->depth = malloc(sizeof(float) * width * height);
+	checkerboard->motion = calloc(width * height * 2, sizeof(float));
+	return checkerboard;
+}
+
+void destroy_checkerboard(struct checkerboard *checkerboard) {
+	free(checkerboard->history);
+	free(checkerboard->history_depth);
+	free(checkerboard->depth);
+	free(checkerboard->motion);
+	free(checkerboard);
+}
+
+void checkerboard_reset(struct checkerboard *checkerboard) {
+	checkerboard->has_history = false;
+	checkerboard->stats = (struct checkerboard_stats){0};
+}
+
+static bool can_use_checkerboard(struct checkerboard *checkerboard, struct graphics_context *context) {
+	return context->depth_buffer && !context->msaa &&
+		   context->width == checkerboard->width && context->height == checkerboard->height;
+}
+
+void checkerboard_begin_frame(struct checkerboard *checkerboard, struct graphics_context *context) {
+	context_set_checkerboard(context, can_use_checkerboard(checkerboard, context) ? checkerboard->frame & 1 : -1);
+}
+
+/**
+ The pixels above, below, left and right of (x, y), which are all shaded in
+ the frame that (x, y) is missing from: their average, and the smallest and
+ largest value of each channel. At the borders, the neighbors on the other
+ side are used twice.
+ */
+static void get_neighborhood(uint32_t *pixels, int width, int height, int x, int y,
+							 packed_color *average, packed_color *min, packed_color *max)
+{
+	int left = x > 0 ? x - 1 : x + 1;
+	int right = x + 1 < width ? x + 1 : x - 1;
+	int up = y > 0 ? y - 1 : y + 1;
+	int down = y + 1 < height ? y + 1 : y - 1;
+	packed_color colors[4] = {
+		pixels[width * y + (left < width ? left : x)],
+		pixels[width * y + (right >= 0 ? right : x)],
+		pixels[width * (up < height ? up : y) + x],
+		pixels[width * (down >= 0 ? down : y) + x]
+	};
+
+	// Sums of two channels at a time, in 16-bit lanes
+	uint32_t even = 0;
+	uint32_t odd = 0;
+	packed_color low = colors[0];
+	packed_color high = colors[0];
+	for (int n = 0; n < 4; n++) {
+		even += colors[n] & PACKED_COLOR_EVEN_CHANNELS;
+		odd += (colors[n] >> 8) & PACKED_COLOR_EVEN_CHANNELS;
+	}
+	for (int n = 1; n < 4; n++) {
+		low = packed_min(low, colors[n]);
+		high = packed_max(high, colors[n]);
+	}
+	even = ((even + 0x00020002u) >> 2) & PACKED_COLOR_EVEN_CHANNELS;
+	odd = ((odd + 0x00020002u) << 6) & ~PACKED_COLOR_EVEN_CHANNELS;
+	*average = even | odd | PACKED_COLOR_ALPHA;
+	*min = low;
+	*max = high;
+}
+
+/**
+ Bilinear sample of the previous frame, at a position within the frame
+ */
+static packed_color sample_history(struct checkerboard *checkerboard, double x, double y) {
+	x = x < 0.0 ? 0.0 : x;
+	y = y < 0.0 ? 0.0 : y;
+	int x0 = (int)x;
+	int y0 = (int)y;
+	int x1 = x0 + 1 < checkerboard->width ? x0 + 1 : x0;
+	int y1 = y0 + 1 < checkerboard->height ? y0 + 1 : y0;
+	uint32_t tx = color_factor(x - x0);
+	uint32_t ty = color_factor(y - y0);
+	uint32_t *row0 = &checkerboard->history[checkerboard->width * y0];
+	uint32_t *row1 = &checkerboard->history[checkerboard->width * y1];
+	return packed_lerp(packed_lerp(row0[x0], row0[x1], tx), packed_lerp(row1[x0], row1[x1], tx), ty);
+}
+
+/**
+ What's needed to find where a pixel was in the previous frame
+ */
+struct reprojection {
+	transform_3d to_previous; // From view space back to model space, and then with the previous transform
+	vec3 eye;
+	double amount;
+};
+
+static void fill_in_pixel(struct checkerboard *checkerboard,
+						  struct graphics_context *context,
+						  struct reprojection *reprojection,
+						  int x,
+						  int y)
+{
+	int width = checkerboard->width;
+	int height = checkerboard->height;
+	int i = width * y + x;
+	float z = checkerboard->depth[i];
+
+	vec3 previous = {x, y, z};
+	if (z < context->depth_buffer->far) {
+		// remove_perspective(), the transform and apply_perspective(), with the eye position from above
+		vec3 eye = reprojection->eye;
+		double amount = reprojection->amount;
+		double scale = 1.0 / (1.0 - z * amount);
+		vec3 view = {eye.x + (x - eye.x) * scale, eye.y + (y - eye.y) * scale, z};
+		vec3 p = transform_3d_apply(view, reprojection->to_previous);
+		previous = (vec3){p.x + p.z * (eye.x - p.x) * amount, p.y + p.z * (eye.y - p.y) * amount, p.z};
+	}
+	checkerboard->motion[i * 2] = previous.x - x;
+	checkerboard->motion[i * 2 + 1] = previous.y - y;
+
+	packed_color average, min, max;
+	get_neighborhood(context->pixel_buffer, width, height, x, y, &average, &min, &max);
+
+	// The comparisons are written so that NaN coordinates fail them
+	bool reprojected = false;
+	if (checkerboard->has_history && previous.x >= -0.5 && previous.x < width - 0.5 &&
+		previous.y >= -0.5 && previous.y < height - 0.5) {
+		int h = width * (int)(previous.y + 0.5) + (int)(previous.x + 0.5);
+		reprojected = fabs(checkerboard->history_depth[h] - previous.z) <= REPROJECTION_DEPTH_TOLERANCE;
+	}
+
+	// Where the colors around are all the same (like the background), that's the color
+	if (min == max) {
+		context->pixel_buffer[i] = min;
+		checkerboard->stats.reprojected += reprojected;
+		checkerboard->stats.interpolated += !reprojected;
+	} else if (reprojected) {
+		context->pixel_buffer[i] = packed_min(packed_max(sample_history(checkerboard, previous.x, previous.y), min), max);
+		checkerboard->stats.reprojected++;
+	} else {
+		context->pixel_buffer[i] = average;
+		checkerboard->stats.interpolated++;
+	}
+}
+
+void checkerboard_end_frame(struct checkerboard *checkerboard,
+							struct graphics_context *context,
+							transform_3d model_view,
+							struct scene scene)
+{
+	if (context->checkerboard < 0) {
+		return;
+	}
+	int parity = context->checkerboard;
+	context_set_checkerboard(context, -1);
+
+	int width = checkerboard->width;
+	int height = checkerboard->height;
+	struct depth_buffer *depth = context->depth_buffer;
+	struct reprojection reprojection = {
+		.to_previous = transform_3d_multiply(transform_3d_inverse(model_view), checkerboard->previous_model_view),
+		.eye = transform_3d_apply((vec3){0, 0, 0}, scene.view),
+		.amount = scene.perspective
+	};
+
+	for (int y = 0; y < height; y++) {
+		depth_buffer_get_row(depth, y, &checkerboard->depth[width * y]);
+		int tile_y = y & (DEPTH_TILE_SIZE - 1);
+		for (int span = 0; span < width; span += DEPTH_TILE_SIZE) {
+			int span_end = span + DEPTH_TILE_SIZE < width ? span + DEPTH_TILE_SIZE : width;
+			int first = span + (((y + parity) & 1) ^ 1);
+
+			// In a depth tile that nothing was drawn to, the missing pixels away
+			// from the edges of the tile only have background around them, and
+			// already have the clear color
+			if (tile_y != 0 && tile_y != DEPTH_TILE_SIZE - 1 && depth->tile_cleared[depth_buffer_tile(depth, span, y)]) {
+				memset(&checkerboard->motion[(width * y + span) * 2], 0, sizeof(float) * 2 * (span_end - span));
+				checkerboard->stats.background += (span_end - first + 1) / 2;
+				int edges[2] = {span, span_end - 1};
+				for (int e = 0; e < (span_end - span > 1 ? 2 : 1); e++) {
+					if (((edges[e] + y) & 1) != parity) {
+						fill_in_pixel(checkerboard, context, &reprojection, edges[e], y);
+						checkerboard->stats.background--;
+					}
+				}
+				continue;
+			}
+
+			for (int x = first; x < span_end; x += 2) {
+				fill_in_pixel(checkerboard, context, &reprojection, x, y);
+			}
+		}
+	}
+
+	memcpy(checkerboard->history, context->pixel_buffer, sizeof(uint32_t) * width * height);
+	float *history_depth = checkerboard->history_depth;
+	checkerboard->history_depth = checkerboard->depth;
+	checkerboard->depth = history_depth;
+	checkerboard->previous_model_view = model_view;
+	checkerboard->has_history = true;
+	checkerboard->frame++;
+}
@@ -0,0 +1,73 @@
+#ifndef CHECKERBOARD_H
+#define CHECKERBOARD_H
+
+#include "graphics_context.h"
+#include "scene.h"
+#include <stdbool.h>
+
+/**
+ Temporal checkerboard rendering: every frame shades half of the pixels, in
+ a checkerboard pattern that flips from one frame to the next, and fills in
+ the other half from the previous frame.
+
+ A missing pixel is reprojected with its depth and the change in the
+ model-view transform since the previous frame, which gives its motion
+ vector. The previous color there is used if the previous depth there
+ matches, and otherwise (e.g. where the model uncovers something that was
+ hidden, or at the edges of the screen) the pixel is interpolated from the
+ four shaded pixels around it. Reprojected colors are clamped to the range of
+ those four, which hides most of what changed since the previous frame.
+
+ The whole frame is expected to move with one transform, like a single model
+ being turned around in the viewer.
+
+ Usage:
+	checkerboard_begin_frame(checkerboard, context);
+	clear(context, color);
+	render_object(...);
+	checkerboard_end_frame(checkerboard, context, model_view, scene);
+ */
+struct checkerboard_stats {
+	long reprojected;  // Missing pixels taken from the previous frame
+	long interpolated; // Missing pixels interpolated from their neighbors
+	long background;   // Missing pixels in empty depth tiles, which keep the clear color
+};
+
+struct checkerboard {
+	int width;
+	int height;
+	int frame;
+	bool has_history;
+	uint32_t *history;     // The previous frame, after reconstruction
+	float *history_depth;  // Z-values of the previous frame
+	float *depth;          // Z-values of the current frame, swapped with history_depth at the end of it
+	float *motion;         // Motion vector (x, y) of each missing pixel to the previous frame, in pixels
+	transform_3d previous_model_view;
+	struct checkerboard_stats stats; // Accumulated until reset
+};
+
+struct checkerboard *create_checkerboard(int width, int height);
+void destroy_checkerboard(struct checkerboard *checkerboard);
+
+/**
+ Sets the context up to shade this frame's half of the pixels
+ */
+void checkerboard_begin_frame(struct checkerboard *checkerboard, struct graphics_context *context);
+
+/**
+ Fills in the pixels that weren't shaded, keeps the frame as the history of
+ the next one, and sets the context back to shading every pixel. model_view
+ is the transform the frame was rendered with.
+ */
+void checkerboard_end_frame(struct checkerboard *checkerboard,
+							struct graphics_context *context,
+							transform_3d model_view,
+							struct scene scene);
+
+/**
+ Forgets the previous frame, e.g. after a cut. The next frame is only
+ interpolated.
+ */
+void checkerboard_reset(struct checkerboard *checkerboard);
+
+#endif
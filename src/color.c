@@ -1,40 +1,47 @@
 #include "color.h"
-#include "geometry.h"
+#include "cpu_kernels.h"
+
+// The rgb_color functions are thin wrappers around the packed ones, so both
+// use the same fixed point math and give identical results.
 
 rgb_color interpolate_color(rgb_color c1, rgb_color c2, double value) {
-	rgb_color result = { .r = lerp(c1.r, c2.r, value),
-						 .g = lerp(c1.g, c2.g, value),
-                         .b = lerp(c1.b, c2.b, value)};
-	return result;
+	return color_from_rgba(packed_lerp(rgba_from_color(c1), rgba_from_color(c2), color_factor(value)));
 }
 
 rgb_color scale_color(rgb_color color, double value) {
-	rgb_color result = { .r = color.r * value,
-                         .g = color.g * value,
-                         .b = color.b * value };
-	return result;
+	return color_from_rgba(packed_scale(rgba_from_color(color), color_factor(value)));
 }
 
 rgb_color multiply_colors(rgb_color c1, rgb_color c2) {
-	rgb_color result = { .r = c1.r * (c2.r / 255.0),
-                         .g = c1.g * (c2.g / 255.0),
-                         .b = c1.b * (c2.b / 255.0)};
-	return result;
+	return color_from_rgba(packed_modulate(rgba_from_color(c1), rgba_from_color(c2)));
 }
 
 rgb_color add_color(rgb_color color, rgb_color other_color) {
-	int r = color.r + other_color.r;
-	int g = color.g + other_color.g;
-	int b = color.b + other_color.b;
-	rgb_color result = {r <= 255 ? r : 255, g <= 255 ? g : 255, b <= 255 ? b : 255};
-	return result;
+	return color_from_rgba(packed_add_saturate(rgba_from_color(color), rgba_from_color(other_color)));
 }
 
 uint32_t rgba_from_color(rgb_color color) {
 	uint32_t result = 0;
-	result |= (color.r << 24);
-	result |= (color.g << 16);
-	result |= (color.b << 8);
+	result |= ((uint32_t)color.r << 24);
+	result |= ((uint32_t)color.g << 16);
+	result |= ((uint32_t)color.b << 8);
 	result |= 0xff;
 	return result;
 }
+
+rgb_color color_from_rgba(uint32_t rgba) {
+	rgb_color color = {.r = rgba >> 24, .g = rgba >> 16, .b = rgba >> 8};
+	return color;
+}
+
+// ********** Span kernels **********
+
+// Built for each instruction set in cpu_kernels.inc
+
+void packed_fill(packed_color *destination, packed_color color, int count) {
+	cpu_kernels_active()->packed_fill(destination, color, count);
+}
+
+void packed_average_samples(packed_color *destination, const packed_color *source, int samples, int count) {
+	cpu_kernels_active()->packed_average_samples(destination, source, samples, count);
+}
@@ -9,10 +9,121 @@ typedef struct {
 	uint8_t b;
 } rgb_color;
 
+/**
+ A color packed as 0xRRGGBBAA, the same layout as the pixel buffer and the
+ textures. The pipeline keeps colors packed from the vertex shaders to the
+ pixel buffer, and rgb_color is only used to describe colors in the API
+ (lights, clear colors, wireframes).
+
+ Factors passed to the packed functions are 8.8 fixed point in [0, 256],
+ where 256 is 1.0. Alpha is always kept at 0xff.
+ */
+typedef uint32_t packed_color;
+
+#define PACKED_COLOR_ALPHA 0x000000ffu
+#define PACKED_COLOR_EVEN_CHANNELS 0x00ff00ffu
+
 rgb_color interpolate_color(rgb_color c1, rgb_color c2, double value);
 rgb_color scale_color(rgb_color color, double value);
 rgb_color multiply_colors(rgb_color c1, rgb_color c2);
 rgb_color add_color(rgb_color color, rgb_color other_color);
 uint32_t rgba_from_color(rgb_color color);
+rgb_color color_from_rgba(uint32_t rgba);
+
+/**
+ Converts a factor in [0, 1] to 8.8 fixed point, clamped to [0, 256]
+ */
+static inline uint32_t color_factor(double value) {
+	return value <= 0.0 ? 0 : (value >= 1.0 ? 256 : (uint32_t)(value * 256.0 + 0.5));
+}
+
+// ********** Single packed colors **********
+
+static inline packed_color packed_lerp(packed_color a, packed_color b, uint32_t t) {
+	// Two channels at a time, each in its own 16-bit lane
+	uint32_t even = ((a & PACKED_COLOR_EVEN_CHANNELS) * (256 - t) + (b & PACKED_COLOR_EVEN_CHANNELS) * t) >> 8;
+	uint32_t odd = ((a >> 8) & PACKED_COLOR_EVEN_CHANNELS) * (256 - t) + ((b >> 8) & PACKED_COLOR_EVEN_CHANNELS) * t;
+	return (even & PACKED_COLOR_EVEN_CHANNELS) | (odd & ~PACKED_COLOR_EVEN_CHANNELS);
+}
+
+static inline packed_color packed_scale(packed_color color, uint32_t factor) {
+	uint32_t even = ((color & PACKED_COLOR_EVEN_CHANNELS) * factor) >> 8;
+	uint32_t odd = ((color >> 8) & PACKED_COLOR_EVEN_CHANNELS) * factor;
+	return (even & PACKED_COLOR_EVEN_CHANNELS) | (odd & ~PACKED_COLOR_EVEN_CHANNELS) | PACKED_COLOR_ALPHA;
+}
+
+/**
+ Per channel a * b / 255, rounded
+ */
+static inline packed_color packed_modulate(packed_color a, packed_color b) {
+	packed_color result = PACKED_COLOR_ALPHA;
+	for (int shift = 8; shift <= 24; shift += 8) {
+		uint32_t x = ((a >> shift) & 0xff) * ((b >> shift) & 0xff) + 128;
+		result |= ((x + (x >> 8)) >> 8) << shift;
+	}
+	return result;
+}
+
+/**
+ 0xff in every 16-bit lane where a >= b, for 8-bit values in 16-bit lanes.
+ Adding 256 to a lane of a and subtracting b leaves bit 8 set exactly then.
+ */
+static inline uint32_t packed_lanes_greater_equal(uint32_t a, uint32_t b) {
+	return ((((a | 0x01000100u) - b) >> 8) & 0x00010001u) * 0xff;
+}
+
+/**
+ Per channel minimum and maximum, without branches
+ */
+static inline packed_color packed_max(packed_color a, packed_color b) {
+	uint32_t a_even = a & PACKED_COLOR_EVEN_CHANNELS, b_even = b & PACKED_COLOR_EVEN_CHANNELS;
+	uint32_t a_odd = (a >> 8) & PACKED_COLOR_EVEN_CHANNELS, b_odd = (b >> 8) & PACKED_COLOR_EVEN_CHANNELS;
+	uint32_t even = packed_lanes_greater_equal(a_even, b_even);
+	uint32_t odd = packed_lanes_greater_equal(a_odd, b_odd);
+	return ((a_even & even) | (b_even & ~even)) | (((a_odd & odd) | (b_odd & ~odd)) << 8);
+}
+
+static inline packed_color packed_min(packed_color a, packed_color b) {
+	uint32_t a_even = a & PACKED_COLOR_EVEN_CHANNELS, b_even = b & PACKED_COLOR_EVEN_CHANNELS;
+	uint32_t a_odd = (a >> 8) & PACKED_COLOR_EVEN_CHANNELS, b_odd = (b >> 8) & PACKED_COLOR_EVEN_CHANNELS;
+	uint32_t even = packed_lanes_greater_equal(a_even, b_even);
+	uint32_t odd = packed_lanes_greater_equal(a_odd, b_odd);
+	return ((b_even & even) | (a_even & ~even)) | (((b_odd & odd) | (a_odd & ~odd)) << 8);
+}
+
+/**
+ Per channel saturating addition, all four channels at once
+ */
+static inline packed_color packed_add_saturate(packed_color a, packed_color b) {
+	uint32_t high_bits = 0x80808080u;
+	uint32_t different = (a ^ b) & high_bits;
+	uint32_t carry = a & b & high_bits;
+	uint32_t sum = (a & ~high_bits) + (b & ~high_bits);
+	carry |= different & sum;
+	carry = (carry << 1) - (carry >> 7); // 0xff in every channel that overflowed
+	return (sum ^ different) | carry;
+}
+
+/**
+ Weighted sum of three colors, with 8.8 fixed point weights that add up to 256
+ */
+static inline packed_color packed_blend3(packed_color a, packed_color b, packed_color c, uint32_t wa, uint32_t wb, uint32_t wc) {
+	uint32_t even = ((a & PACKED_COLOR_EVEN_CHANNELS) * wa + (b & PACKED_COLOR_EVEN_CHANNELS) * wb + (c & PACKED_COLOR_EVEN_CHANNELS) * wc) >> 8;
+	uint32_t odd = ((a >> 8) & PACKED_COLOR_EVEN_CHANNELS) * wa + ((b >> 8) & PACKED_COLOR_EVEN_CHANNELS) * wb + ((c >> 8) & PACKED_COLOR_EVEN_CHANNELS) * wc;
+	return (even & PACKED_COLOR_EVEN_CHANNELS) | (odd & ~PACKED_COLOR_EVEN_CHANNELS);
+}
+
+// ********** Spans of packed colors **********
+// These use the widest vectors the CPU has (see cpu_kernels.h). Only fills
+// and the MSAA resolve work on spans; the shading math above runs once per
+// vertex or fragment and stays scalar.
+
+void packed_fill(packed_color *destination, packed_color color, int count);
+
+/**
+ Averages groups of `samples` (4 or 8) consecutive colors, e.g. to resolve a
+ multisample buffer. source holds count * samples colors.
+ */
+void packed_average_samples(packed_color *destination, const packed_color *source, int samples, int count);
 
 #endif
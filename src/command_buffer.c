@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "command_buffer.h"
+#include <pthread.h>
+#include <string.h>
+
+struct draw_command {
+	struct mesh *mesh;
+	transform_3d transform;
+	transform_3d model_view;
+	int state;
+	double depth;
+};
+
+struct draw_key {
+	int state;
+	double depth;
+	int command;
+};
+
+struct command_buffer {
+	struct scene scene;
+	struct directional_light *lights;
+	int light_capacity;
+	struct local_light *local_lights;
+	int local_light_capacity;
+	bool clear;
+	rgb_color clear_color;
+
+	struct draw_state *states;
+	int state_count;
+	int state_capacity;
+
+	struct draw_command *commands;
+	int command_count;
+	int command_capacity;
+
+	// Visible draws, sorted on execution. From the executing context's frame arena.
+	struct draw_key *keys;
+};
+
+struct command_buffer *create_command_buffer(void) {
+	return calloc(1, sizeof(struct command_buffer));
+}
+
+void destroy_command_buffer(struct command_buffer *buffer) {
+	free(buffer->lights);
+	free(buffer->local_lights);
+	free(buffer->states);
+	free(buffer->commands);
+	free(buffer);
+}
+
+void command_buffer_begin(struct command_buffer *buffer, struct scene scene) {
+	// Copy the lights, so the caller can change them while this frame is executed
+	if (buffer->light_capacity < scene.directional_light_count) {
+		buffer->light_capacity = scene.directional_light_count;
+		buffer->lights = realloc(buffer->lights, sizeof(struct directional_light) * buffer->light_capacity);
+	}
+	if (scene.directional_light_count > 0) {
+		memcpy(buffer->lights, scene.directional_lights, sizeof(struct directional_light) * scene.directional_light_count);
+	}
+	if (buffer->local_light_capacity < scene.local_light_count) {
+		buffer->local_light_capacity = scene.local_light_count;
+		buffer->local_lights = realloc(buffer->local_lights, sizeof(struct local_light) * buffer->local_light_capacity);
+	}
+	if (scene.local_light_count > 0) {
+		memcpy(buffer->local_lights, scene.local_lights, sizeof(struct local_light) * scene.local_light_count);
+	}
+	buffer->scene = scene;
+	buffer->scene.directional_lights = buffer->lights;
+	buffer->scene.local_lights = buffer->local_lights;
+	buffer->clear = false;
+	buffer->state_count = 0;
+	buffer->command_count = 0;
+}
+
+void command_buffer_clear(struct command_buffer *buffer, rgb_color color) {
+	buffer->clear = true;
+	buffer->clear_color = color;
+}
+
+static bool draw_states_equal(struct draw_state *a, struct draw_state *b) {
+	return a->vertex_shader == b->vertex_shader &&
+		a->fragment_shader == b->fragment_shader &&
+		a->texture == b->texture &&
+		a->normal_map == b->normal_map &&
+		a->cull_back_faces == b->cull_back_faces;
+}
+
+/**
+ Returns the index of a state in the buffer's state table, adding it if needed.
+ Frames rarely have more than a handful of states, so a linear search is fine.
+ */
+static int intern_state(struct command_buffer *buffer, struct draw_state state) {
+	for (int i = 0; i < buffer->state_count; i++) {
+		if (draw_states_equal(&buffer->states[i], &state)) {
+			return i;
+		}
+	}
+	if (buffer->state_count == buffer->state_capacity) {
+		buffer->state_capacity = buffer->state_capacity > 0 ? buffer->state_capacity * 2 : 8;
+		buffer->states = realloc(buffer->states, sizeof(struct draw_state) * buffer->state_capacity);
+	}
+	buffer->states[buffer->state_count] = state;
+	return buffer->state_count++;
+}
+
+void command_buffer_draw(struct command_buffer *buffer, struct mesh *mesh, transform_3d transform, struct draw_state state) {
+	if (!state.texture) {
+		state.texture = &mesh->texture;
+	}
+	if (!state.normal_map) {
+		state.normal_map = &mesh->normal_map;
+	}
+
+	if (buffer->command_count == buffer->command_capacity) {
+		buffer->command_capacity = buffer->command_capacity > 0 ? buffer->command_capacity * 2 : 64;
+		buffer->commands = realloc(buffer->commands, sizeof(struct draw_command) * buffer->command_capacity);
+	}
+
+	// Per-draw setup is done once here, instead of for every face on execution
+	struct draw_command *command = &buffer->commands[buffer->command_count++];
+	command->mesh = mesh;
+	command->transform = transform;
+	command->model_view = transform_3d_multiply(transform, buffer->scene.view);
+	command->state = intern_state(buffer, state);
+	command->depth = transform_3d_apply(mesh->bounds_center, command->model_view).z;
+}
+
+int command_buffer_draw_count(struct command_buffer *buffer) {
+	return buffer->command_count;
+}
+
+static int compare_draw_keys(const void *a, const void *b) {
+	const struct draw_key *k1 = (const struct draw_key *)a;
+	const struct draw_key *k2 = (const struct draw_key *)b;
+	if (k1->state != k2->state) return k1->state - k2->state;
+	if (k1->depth < k2->depth) return -1;
+	if (k1->depth > k2->depth) return 1;
+	return k1->command - k2->command;
+}
+
+void command_buffer_execute(struct command_buffer *buffer, struct graphics_context *context) {
+	if (buffer->clear) {
+		clear(context, buffer->clear_color);
+	}
+
+	buffer->keys = frame_arena_alloc(context->arena, sizeof(struct draw_key) * buffer->command_count);
+
+	int count = 0;
+	for (int i = 0; i < buffer->command_count; i++) {
+		struct draw_command *command = &buffer->commands[i];
+		COUNT_STAT(context->stats, instances_submitted);
+		if (!mesh_is_visible(command->mesh, command->model_view, buffer->scene, context)) {
+			COUNT_STAT(context->stats, instances_culled);
+			continue;
+		}
+		buffer->keys[count++] = (struct draw_key){.state = command->state, .depth = command->depth, .command = i};
+	}
+
+	// Group draws by state, and front to back (lower Z-values first) within a state
+	qsort(buffer->keys, count, sizeof(struct draw_key), &compare_draw_keys);
+
+	for (int first = 0; first < count;) {
+		struct draw_state *state = &buffer->states[buffer->keys[first].state];
+		struct fragment_shader_input input;
+		input.texture = state->texture;
+		input.normal_map = state->normal_map;
+		input.scene = buffer->scene;
+		input.stats = context->stats;
+
+		int last = first;
+		while (last < count && buffer->keys[last].state == buffer->keys[first].state) {
+			struct draw_command *command = &buffer->commands[buffer->keys[last++].command];
+			render_mesh(command->mesh, command->transform, command->model_view, buffer->scene,
+						state->vertex_shader, state->fragment_shader, input, state->cull_back_faces, context);
+		}
+		first = last;
+	}
+}
+
+// ********** Command queue **********
+
+struct command_queue {
+	struct graphics_context *context;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t submitted;
+	pthread_cond_t finished;
+	struct command_buffer *pending; // Submitted or executing, NULL when idle
+	bool quit;
+};
+
+static void *command_queue_thread(void *argument) {
+	struct command_queue *queue = argument;
+	pthread_mutex_lock(&queue->mutex);
+	while (true) {
+		while (!queue->pending && !queue->quit) {
+			pthread_cond_wait(&queue->submitted, &queue->mutex);
+		}
+		if (!queue->pending) {
+			break;
+		}
+
+		struct command_buffer *buffer = queue->pending;
+		pthread_mutex_unlock(&queue->mutex);
+		command_buffer_execute(buffer, queue->context);
+		pthread_mutex_lock(&queue->mutex);
+
+		queue->pending = NULL;
+		pthread_cond_broadcast(&queue->finished);
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return NULL;
+}
+
+struct command_queue *create_command_queue(struct graphics_context *context) {
+	struct command_queue *queue = calloc(1, sizeof(struct command_queue));
+	queue->context = context;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->submitted, NULL);
+	pthread_cond_init(&queue->finished, NULL);
+	pthread_create(&queue->thread, NULL, &command_queue_thread, queue);
+	return queue;
+}
+
+void destroy_command_queue(struct command_queue *queue) {
+	command_queue_wait(queue);
+	pthread_mutex_lock(&queue->mutex);
+	queue->quit = true;
+	pthread_cond_signal(&queue->submitted);
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_join(queue->thread, NULL);
+
+	pthread_cond_destroy(&queue->finished);
+	pthread_cond_destroy(&queue->submitted);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue);
+}
+
+void command_queue_submit(struct command_queue *queue, struct command_buffer *buffer) {
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->pending) {
+		pthread_cond_wait(&queue->finished, &queue->mutex);
+	}
+	queue->pending = buffer;
+	pthread_cond_signal(&queue->submitted);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+void command_queue_wait(struct command_queue *queue) {
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->pending) {
+		pthread_cond_wait(&queue->finished, &queue->mutex);
+	}
+	pthread_mutex_unlock(&queue->mutex);
+}
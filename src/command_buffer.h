@@ -0,0 +1,81 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include "graphics_context.h"
+#include "scene_graph.h"
+#include "shaders.h"
+#include "scene.h"
+#include <stdbool.h>
+
+/**
+ Pipeline state of a draw. Draws with equal state are executed as one batch,
+ which shares the fragment shader setup. NULL textures use the mesh's own.
+ */
+struct draw_state {
+	vertex_shader *vertex_shader;
+	fragment_shader *fragment_shader;
+	struct texture *texture;
+	struct texture *normal_map;
+	bool cull_back_faces;
+};
+
+/**
+ A retained list of draws for one frame. Recording copies everything it needs
+ (transforms, state, the scene and its lights) except meshes, textures and
+ the scene's light tiles, which must stay alive (and the tiles unchanged)
+ until the buffer has been executed.
+
+ Executing a buffer culls draws outside the view, sorts the rest by pipeline
+ state and then front to back, and draws each run of equal state as a batch.
+ */
+struct command_buffer;
+
+struct command_buffer *create_command_buffer(void);
+void destroy_command_buffer(struct command_buffer *buffer);
+
+/**
+ Starts recording a new frame, dropping any previously recorded commands
+ */
+void command_buffer_begin(struct command_buffer *buffer, struct scene scene);
+
+/**
+ Clears the color and depth buffers before any of the draws
+ */
+void command_buffer_clear(struct command_buffer *buffer, rgb_color color);
+void command_buffer_draw(struct command_buffer *buffer, struct mesh *mesh, transform_3d transform, struct draw_state state);
+int command_buffer_draw_count(struct command_buffer *buffer);
+
+/**
+ Executes a recorded buffer on the calling thread. A buffer can be executed
+ any number of times.
+ */
+void command_buffer_execute(struct command_buffer *buffer, struct graphics_context *context);
+
+/**
+ Executes command buffers on a render thread, so the caller can record the
+ next frame while the previous one is drawn:
+
+	command_queue_submit(queue, buffers[frame % 2]);
+	... record buffers[(frame + 1) % 2] ...
+	command_queue_wait(queue);
+	context_refresh_window(context);
+
+ The context belongs to the render thread between submit and wait.
+ */
+struct command_queue;
+
+struct command_queue *create_command_queue(struct graphics_context *context);
+
+/**
+ Waits for any pending buffer and stops the render thread
+ */
+void destroy_command_queue(struct command_queue *queue);
+
+/**
+ Hands a buffer to the render thread. Waits first if a buffer is still being
+ executed. The buffer must not be recorded into until command_queue_wait().
+ */
+void command_queue_submit(struct command_queue *queue, struct command_buffer *buffer);
+void command_queue_wait(struct command_queue *queue);
+
+#endif
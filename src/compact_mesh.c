@@ -0,0 +1,305 @@
+#include "compact_mesh.h"
+#include "object.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#define QUANTIZATION_STEPS 65535.0
+#define NORMAL_STEPS 32767.0
+
+// ********** Encoding **********
+
+/**
+ Rounds a double to the nearest half float (round half to even). Values too
+ large for a half float become infinity.
+ */
+static uint16_t half_from_double(double value) {
+	union {
+		float f;
+		uint32_t u;
+	} bits = {.f = (float)value};
+	uint16_t sign = (bits.u >> 16) & 0x8000;
+	int exponent = (int)((bits.u >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits.u & 0x7fffff;
+
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+	int shift = 13;
+	uint32_t half;
+	if (exponent <= 0) {
+		// Subnormal: the implicit leading one becomes part of the mantissa
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		shift = 14 - exponent;
+		half = mantissa >> shift;
+	} else {
+		half = ((uint32_t)exponent << 10) | (mantissa >> shift);
+	}
+
+	// A carry out of the mantissa correctly moves on to the next exponent
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	if (rest > halfway || (rest == halfway && (half & 1))) {
+		half++;
+	}
+	return sign | (uint16_t)half;
+}
+
+static double double_from_half(uint16_t half) {
+#if defined(__F16C__)
+	return _cvtsh_ss(half);
+#else
+	union {
+		float f;
+		uint32_t u;
+	} bits;
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	if (exponent == 0) {
+		// Zero or subnormal, which is exact as a float
+		bits.f = mantissa * (1.0f / 16777216.0f);
+		bits.u |= sign;
+	} else if (exponent == 31) {
+		bits.u = sign | 0x7f800000 | (mantissa << 13);
+	} else {
+		bits.u = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	return bits.f;
+#endif
+}
+
+/**
+ Maps a unit vector onto the octahedron |x| + |y| + |z| = 1, unfolds the
+ lower half over the upper, and stores x and y as 16 bit signed values
+ */
+static uint32_t encode_normal(vec3 n) {
+	double length = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (length == 0.0) {
+		return 0;
+	}
+	double x = n.x / length;
+	double y = n.y / length;
+	if (n.z < 0.0) {
+		double folded_x = (1.0 - fabs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+		double folded_y = (1.0 - fabs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+		x = folded_x;
+		y = folded_y;
+	}
+	int16_t ex = (int16_t)lround(fmax(-1.0, fmin(1.0, x)) * NORMAL_STEPS);
+	int16_t ey = (int16_t)lround(fmax(-1.0, fmin(1.0, y)) * NORMAL_STEPS);
+	return (uint32_t)(uint16_t)ex | (uint32_t)(uint16_t)ey << 16;
+}
+
+static vec3 decode_normal(uint32_t encoded) {
+	vec3 n;
+	n.x = (int16_t)(encoded & 0xffff) / NORMAL_STEPS;
+	n.y = (int16_t)(encoded >> 16) / NORMAL_STEPS;
+	n.z = 1.0 - fabs(n.x) - fabs(n.y);
+
+	// Points on the lower half were folded over the edges, fold them back
+	double t = fmax(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+
+	double length = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+	return length > 0.0 ? vec3_scale(n, 1.0 / length) : (vec3){0.0, 0.0, 1.0};
+}
+
+// ********** Building **********
+
+/**
+ A face corner, as indices into the position, normal and texture coordinate
+ arrays of a model (-1 if missing)
+ */
+struct corner_key {
+	int position;
+	int normal;
+	int texture;
+};
+
+static uint32_t hash_corner(struct corner_key key) {
+	uint32_t h = (uint32_t)key.position * 0x9e3779b1u;
+	h ^= (uint32_t)key.normal * 0x85ebca77u;
+	h ^= (uint32_t)key.texture * 0xc2b2ae3du;
+	return h ^ (h >> 15);
+}
+
+static vec3 face_normal(vec3 a, vec3 b, vec3 c) {
+	return vec3_unit(cross_product(vec3_subtract(b, a), vec3_subtract(c, a)));
+}
+
+struct compact_mesh *create_compact_mesh(struct model model) {
+	vec3 min = {INFINITY, INFINITY, INFINITY};
+	vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < model.num_vertices; i++) {
+		vec3 p = model.vertices[i];
+		min = (vec3){fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z)};
+		max = (vec3){fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z)};
+	}
+	if (model.num_vertices == 0) {
+		min = max = (vec3){0.0, 0.0, 0.0};
+	}
+	return create_compact_mesh_in_bounds(model, min, max);
+}
+
+struct compact_mesh *create_compact_mesh_in_bounds(struct model model, vec3 min, vec3 max) {
+	struct compact_mesh *mesh = malloc(sizeof(struct compact_mesh));
+	mesh->num_faces = model.num_faces;
+	mesh->indices = malloc(sizeof(uint32_t) * 3 * (model.num_faces > 0 ? model.num_faces : 1));
+	mesh->position_offset = min;
+	mesh->position_scale = vec3_scale(vec3_subtract(max, min), 1.0 / QUANTIZATION_STEPS);
+
+	// Weld equal corners into one vertex with an open addressing hash table
+	int corners = model.num_faces * 3;
+	int table_size = 16;
+	while (table_size < corners * 2) {
+		table_size *= 2;
+	}
+	int *table = malloc(sizeof(int) * table_size);
+	for (int i = 0; i < table_size; i++) {
+		table[i] = -1;
+	}
+	struct corner_key *keys = malloc(sizeof(struct corner_key) * (corners > 0 ? corners : 1));
+	vec3 *normal_sums = calloc(corners > 0 ? corners : 1, sizeof(vec3));
+	int count = 0;
+
+	for (int f = 0; f < model.num_faces; f++) {
+		struct face face = model.faces[f];
+		vec3 normal = face_normal(*face.vertices[0], *face.vertices[1], *face.vertices[2]);
+		for (int c = 0; c < 3; c++) {
+			struct corner_key key = {
+				.position = (int)(face.vertices[c] - model.vertices),
+				.normal = face.normals[c] ? (int)(face.normals[c] - model.normals) : -1,
+				.texture = face.textures[c] ? (int)(face.textures[c] - model.textures) : -1
+			};
+			uint32_t slot = hash_corner(key) & (table_size - 1);
+			while (table[slot] >= 0) {
+				struct corner_key *other = &keys[table[slot]];
+				if (other->position == key.position && other->normal == key.normal && other->texture == key.texture) {
+					break;
+				}
+				slot = (slot + 1) & (table_size - 1);
+			}
+			if (table[slot] < 0) {
+				table[slot] = count;
+				keys[count++] = key;
+			}
+
+			// Corners without a normal get the average of the faces around them
+			normal_sums[table[slot]] = vec3_add(normal_sums[table[slot]], normal);
+			mesh->indices[f * 3 + c] = table[slot];
+		}
+	}
+
+	mesh->num_vertices = count;
+	mesh->vertices = malloc(sizeof(struct compact_vertex) * (count > 0 ? count : 1));
+	for (int i = 0; i < count; i++) {
+		struct corner_key key = keys[i];
+		struct compact_vertex *v = &mesh->vertices[i];
+		vec3 p = model.vertices[key.position];
+		double q[3] = {p.x - min.x, p.y - min.y, p.z - min.z};
+		double scale[3] = {mesh->position_scale.x, mesh->position_scale.y, mesh->position_scale.z};
+		for (int axis = 0; axis < 3; axis++) {
+			v->position[axis] = scale[axis] > 0.0 ? (uint16_t)lround(fmin(q[axis] / scale[axis], QUANTIZATION_STEPS)) : 0;
+		}
+		v->normal = encode_normal(key.normal >= 0 ? model.normals[key.normal] : normal_sums[i]);
+		vec2 uv = key.texture >= 0 ? model.textures[key.texture] : (vec2){0.0, 0.0};
+		v->texture_coordinate[0] = half_from_double(uv.x);
+		v->texture_coordinate[1] = half_from_double(uv.y);
+	}
+
+	free(normal_sums);
+	free(keys);
+	free(table);
+	return mesh;
+}
+
+void destroy_compact_mesh(struct compact_mesh *mesh) {
+	free(mesh->vertices);
+	free(mesh->indices);
+	free(mesh);
+}
+
+size_t compact_mesh_memory(struct compact_mesh *mesh) {
+	return sizeof(struct compact_mesh) + sizeof(struct compact_vertex) * mesh->num_vertices + sizeof(uint32_t) * 3 * mesh->num_faces;
+}
+
+size_t model_memory(struct model model) {
+	return sizeof(vec3) * (model.num_vertices + model.num_normals) + sizeof(vec2) * model.num_textures +
+		   sizeof(struct face) * model.num_faces;
+}
+
+// ********** Decoding **********
+
+struct vertex compact_mesh_vertex(struct compact_mesh *mesh, int index) {
+	struct compact_vertex *v = &mesh->vertices[index];
+	struct vertex result;
+	result.coordinate.x = mesh->position_offset.x + v->position[0] * mesh->position_scale.x;
+	result.coordinate.y = mesh->position_offset.y + v->position[1] * mesh->position_scale.y;
+	result.coordinate.z = mesh->position_offset.z + v->position[2] * mesh->position_scale.z;
+	result.normal = decode_normal(v->normal);
+	result.texture_coordinate.x = double_from_half(v->texture_coordinate[0]);
+	result.texture_coordinate.y = double_from_half(v->texture_coordinate[1]);
+	result.color = 0;
+	return result;
+}
+
+void compact_mesh_shade_face(struct compact_mesh *mesh,
+							 int face_index,
+							 transform_3d model,
+							 transform_3d model_view,
+							 struct scene scene,
+							 vertex_shader *vertex_shader,
+							 struct vertex vertices[3])
+{
+	uint32_t *corners = &mesh->indices[face_index * 3];
+	struct vertex decoded[3];
+	for (int i = 0; i < 3; i++) {
+		decoded[i] = compact_mesh_vertex(mesh, corners[i]);
+	}
+
+	struct vertex_shader_input input = {.face_normal = face_normal(decoded[0].coordinate, decoded[1].coordinate, decoded[2].coordinate),
+										.model = model,
+										.model_view = model_view,
+										.scene = scene};
+	for (int i = 0; i < 3; i++) {
+		input.vertex = decoded[i];
+		vertices[i] = vertex_shader(input);
+	}
+}
+
+void render_compact_mesh(struct compact_mesh *mesh,
+						 transform_3d transform,
+						 struct texture *texture,
+						 struct texture *normal_map,
+						 struct scene scene,
+						 vertex_shader *vertex_shader,
+						 fragment_shader *fragment_shader,
+						 struct graphics_context *context)
+{
+	struct fragment_shader_input input;
+	input.texture = texture;
+	input.normal_map = normal_map;
+	input.scene = scene;
+	input.stats = context->stats;
+
+	transform_3d model_view = transform_3d_multiply(transform, scene.view);
+	for (int i = 0; i < mesh->num_faces; i++) {
+		struct vertex vertices[3];
+		compact_mesh_shade_face(mesh, i, transform, model_view, scene, vertex_shader, vertices);
+		COUNT_STAT(context->stats, faces_submitted);
+
+		if (!face_is_front_facing(vertices)) {
+			COUNT_STAT(context->stats, faces_back_face_culled);
+			continue;
+		}
+		triangle(vertices, input, fragment_shader, context);
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef COMPACT_MESH_H
+#define COMPACT_MESH_H
+
+#include "graphics_context.h"
+#include "textures.h"
+#include "shaders.h"
+#include "scene.h"
+#include "obj.h"
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ A vertex in 16 bytes, instead of the 64 bytes that a position, a normal and
+ a texture coordinate take in struct model:
+ - the normal, octahedral encoded into two 16 bit signed values
+ - the position, quantized to 16 bits per axis within the bounds of the mesh
+ - the texture coordinate, as half floats
+ */
+struct compact_vertex {
+	uint32_t normal;
+	uint16_t position[3];
+	uint16_t texture_coordinate[2];
+};
+
+/**
+ A model stored as compact vertices. Each distinct combination of position,
+ normal and texture coordinate used by the faces becomes one vertex, and the
+ faces refer to them by index instead of pointing to three separate arrays.
+
+ Vertices are decoded as they are fed to the vertex shader, so a full
+ precision copy of the mesh never exists. Positions are accurate to 1/65535
+ of the size of the mesh along each axis.
+ */
+struct compact_mesh {
+	int num_vertices;
+	int num_faces;
+	vec3 position_offset; // Minimum corner of the bounds
+	vec3 position_scale;  // Size of the bounds / 65535
+	struct compact_vertex *vertices;
+	uint32_t *indices; // Three per face
+};
+
+struct compact_mesh *create_compact_mesh(struct model model);
+
+/**
+ Same as create_compact_mesh, quantizing positions within the given bounds
+ instead of the bounds of the model's vertices. Parts of a mesh that are
+ quantized within the same bounds decode shared positions identically, so
+ they meet without cracks.
+ */
+struct compact_mesh *create_compact_mesh_in_bounds(struct model model, vec3 min, vec3 max);
+void destroy_compact_mesh(struct compact_mesh *mesh);
+
+/**
+ Bytes used by the vertex data and faces, to compare with model_memory()
+ */
+size_t compact_mesh_memory(struct compact_mesh *mesh);
+size_t model_memory(struct model model);
+
+/**
+ Decodes a vertex to model space, with a unit normal
+ */
+struct vertex compact_mesh_vertex(struct compact_mesh *mesh, int index);
+
+/**
+ Same as shade_face, for a compact mesh. Each corner is decoded straight into
+ the input of the vertex shader.
+ */
+void compact_mesh_shade_face(struct compact_mesh *mesh,
+							 int face_index,
+							 transform_3d model,
+							 transform_3d model_view,
+							 struct scene scene,
+							 vertex_shader *vertex_shader,
+							 struct vertex vertices[3]);
+
+/**
+ Same as render_object, for a compact mesh
+ */
+void render_compact_mesh(struct compact_mesh *mesh,
+						 transform_3d transform,
+						 struct texture *texture,
+						 struct texture *normal_map,
+						 struct scene scene,
+						 vertex_shader *vertex_shader,
+						 fragment_shader *fragment_shader,
+						 struct graphics_context *context);
+
+#endif
@@ -0,0 +1,103 @@
+#include "cpu_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_KERNELS_X86
+#endif
+
+// Defined by cpu_kernels.inc, once in each cpu_kernels_<level>.c
+extern const struct cpu_kernels cpu_kernels_scalar;
+extern const struct cpu_kernels cpu_kernels_sse2;
+extern const struct cpu_kernels cpu_kernels_avx2;
+extern const struct cpu_kernels cpu_kernels_avx512;
+
+static const struct cpu_kernels *const variants[CPU_KERNEL_LEVEL_COUNT] = {
+	&cpu_kernels_scalar, &cpu_kernels_sse2, &cpu_kernels_avx2, &cpu_kernels_avx512
+};
+
+static const char *level_names[CPU_KERNEL_LEVEL_COUNT] = {"scalar", "sse2", "avx2", "avx512"};
+
+static const struct cpu_kernels *active;
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+
+static bool cpu_has(enum cpu_kernel_level level) {
+#if defined(CPU_KERNELS_X86)
+	// Also checks that the OS saves the wider registers
+	__builtin_cpu_init();
+	switch (level) {
+	case CPU_KERNELS_SCALAR:
+		return true;
+	case CPU_KERNELS_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case CPU_KERNELS_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case CPU_KERNELS_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+	default:
+		return false;
+	}
+#else
+	return level == CPU_KERNELS_SCALAR;
+#endif
+}
+
+bool cpu_kernels_supported(enum cpu_kernel_level level) {
+	if (level < 0 || level >= CPU_KERNEL_LEVEL_COUNT) {
+		return false;
+	}
+	// A variant built without the flags of its level (e.g. on other CPU
+	// architectures) reports the level it actually got
+	return variants[level]->level == level && cpu_has(level);
+}
+
+enum cpu_kernel_level cpu_kernels_best_level(void) {
+	enum cpu_kernel_level best = CPU_KERNELS_SCALAR;
+	for (int level = CPU_KERNELS_SCALAR + 1; level < CPU_KERNEL_LEVEL_COUNT; level++) {
+		if (cpu_kernels_supported(level)) {
+			best = level;
+		}
+	}
+	return best;
+}
+
+static void select_initial_kernels(void) {
+	enum cpu_kernel_level best = cpu_kernels_best_level();
+	active = variants[best];
+
+	const char *name = getenv("C3DO_KERNELS");
+	if (!name || !*name) {
+		return;
+	}
+	for (int level = 0; level < CPU_KERNEL_LEVEL_COUNT; level++) {
+		if (strcmp(name, level_names[level]) == 0) {
+			if (cpu_kernels_supported(level)) {
+				active = variants[level];
+			} else {
+				fprintf(stderr, "C3DO_KERNELS=%s is not supported here, using %s\n", name, level_names[best]);
+			}
+			return;
+		}
+	}
+	fprintf(stderr, "Unknown C3DO_KERNELS=%s (scalar, sse2, avx2 or avx512), using %s\n", name, level_names[best]);
+}
+
+const struct cpu_kernels *cpu_kernels_active(void) {
+	pthread_once(&active_once, &select_initial_kernels);
+	return active;
+}
+
+bool cpu_kernels_select(enum cpu_kernel_level level) {
+	pthread_once(&active_once, &select_initial_kernels);
+	if (!cpu_kernels_supported(level)) {
+		return false;
+	}
+	active = variants[level];
+	return true;
+}
+
+const char *cpu_kernel_level_name(enum cpu_kernel_level level) {
+	return level >= 0 && level < CPU_KERNEL_LEVEL_COUNT ? level_names[level] : "unknown";
+}
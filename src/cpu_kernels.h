@@ -0,0 +1,56 @@
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include "color.h"
+#include "geometry.h"
+#include <stdbool.h>
+
+/**
+ The span kernels behind color.h (fills and the MSAA resolve), the
+ depth-only rasterizer's spans and the batched vertex transform, built once per instruction set in the same
+ binary. cpu_kernels.inc is compiled by cpu_kernels_<level>.c with the flags
+ of that level, and the best level this CPU supports is picked the first
+ time a kernel is used.
+
+ Setting C3DO_KERNELS to a level name (scalar, sse2, avx2, avx512) picks
+ that level instead, if the CPU supports it. Every level gives exactly the
+ same results, only faster.
+ */
+enum cpu_kernel_level {
+	CPU_KERNELS_SCALAR,
+	CPU_KERNELS_SSE2,
+	CPU_KERNELS_AVX2,
+	CPU_KERNELS_AVX512, // AVX-512F and BW
+	CPU_KERNEL_LEVEL_COUNT
+};
+
+struct cpu_kernels {
+	enum cpu_kernel_level level;
+	void (*packed_fill)(packed_color *destination, packed_color color, int count);
+	void (*packed_average_samples)(packed_color *destination, const packed_color *source, int samples, int count);
+	// Pixels and normalized depths (see depth_buffer_normalize) of a span
+	void (*depth_span)(int *x, int *y, double *depth, vec3 left, vec3 right, int width, int first, int count, double far, double scale);
+	void (*transform_points)(vec3 *destination, const vec3 *source, int count, transform_3d t);
+};
+
+/**
+ The kernels in use
+ */
+const struct cpu_kernels *cpu_kernels_active(void);
+
+/**
+ Whether a level was built into this binary and this CPU can run it
+ */
+bool cpu_kernels_supported(enum cpu_kernel_level level);
+enum cpu_kernel_level cpu_kernels_best_level(void);
+
+/**
+ Switches to the kernels of a level, e.g. to compare them. Returns false,
+ and keeps the current kernels, if the level isn't supported. Not safe
+ while other threads are rendering.
+ */
+bool cpu_kernels_select(enum cpu_kernel_level level);
+
+const char *cpu_kernel_level_name(enum cpu_kernel_level level);
+
+#endif
@@ -0,0 +1,3 @@
+// Compiled with -mavx2, see CMakeLists.txt and the makefile
+#define CPU_KERNELS_NAME cpu_kernels_avx2
+#include "cpu_kernels.inc"
@@ -0,0 +1,3 @@
+// Compiled with -mavx512f -mavx512bw, see CMakeLists.txt and the makefile
+#define CPU_KERNELS_NAME cpu_kernels_avx512
+#include "cpu_kernels.inc"
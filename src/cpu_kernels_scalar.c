@@ -0,0 +1,4 @@
+// The same kernels without vector code, for every CPU
+#define CPU_KERNELS_NO_VECTORS
+#define CPU_KERNELS_NAME cpu_kernels_scalar
+#include "cpu_kernels.inc"
@@ -0,0 +1,3 @@
+// Compiled with -msse2, see CMakeLists.txt and the makefile
+#define CPU_KERNELS_NAME cpu_kernels_sse2
+#include "cpu_kernels.inc"
@@ -0,0 +1,704 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "render_service.h"
+#include "timing.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ Render daemon: keeps a render service (render_service.h) running behind a
+ Unix domain socket, so that rendering an image doesn't start a process and
+ load the model again.
+
+ Clients send one job per line, as the key=value pairs of render_job_parse()
+ applied to render_job_default(). Each job is answered in order, with either
+
+	OK <size>\n followed by <size> bytes of BMP file, or
+	ERROR <message>\n
+
+ A line with just "stats" is answered right away with one line of counters
+ and latency percentiles.
+
+ Jobs are collected for up to --batch-window milliseconds after the first
+ one arrives (or until --max-batch of them), and rendered as one batch.
+ Answers are queued per client and sent as its socket takes them, so a
+ client that doesn't read can't hold up the others; one with more than
+ MAX_QUEUED bytes of answers unread is disconnected. Latency is measured from
+ reading a job to having sent all of its answer, and its percentiles are
+ logged to stderr every --log-every jobs.
+
+ With --client, sends jobs to a running daemon instead and reports the
+ latencies it sees.
+ */
+
+#define MAX_CLIENTS 64
+#define MAX_LINE 4096
+#define MAX_QUEUED (128 * 1024 * 1024)
+
+// The end of a job's answer in the output of a client
+struct queued_answer {
+	size_t end;
+	double received_ms;
+};
+
+struct client {
+	int fd; // -1 for a free slot
+	char buffer[MAX_LINE];
+	size_t length;
+
+	// Answers not sent yet, from output[sent] to output[queued]
+	uint8_t *output;
+	size_t sent;
+	size_t queued;
+	size_t capacity;
+	struct queued_answer *answers;
+	int answer_count;
+	int answer_capacity;
+};
+
+struct pending_job {
+	int client; // -1 once the client has disconnected
+	bool valid;
+	char error[128];
+	struct render_job job;
+	double received_ms;
+};
+
+struct latency_log {
+	double *samples; // Every job's latency, in milliseconds
+	int count;
+	int capacity;
+	int logged; // Samples already covered by a log line
+	double render_ms;
+	long batches;
+};
+
+struct daemon_options {
+	const char *socket_path;
+	double batch_window;
+	int max_batch;
+	int log_every;
+	int loaders;
+	int contexts;
+	bool client;
+	int repeat;
+	int pipeline;
+	double turn;
+	const char *output;
+	const char *job;
+};
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int signal) {
+	(void)signal;
+	quit = 1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double percentile(double *sorted, int count, double p) {
+	int index = (int)(p / 100.0 * (count - 1) + 0.5);
+	return sorted[index];
+}
+
+/**
+ Formats the percentiles of count samples into text
+ */
+static void describe_latency(double *samples, int count, char *text, size_t size) {
+	if (count == 0) {
+		snprintf(text, size, "no jobs");
+		return;
+	}
+	double *sorted = malloc(sizeof(double) * count);
+	memcpy(sorted, samples, sizeof(double) * count);
+	qsort(sorted, count, sizeof(double), &compare_doubles);
+	snprintf(text, size, "p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms",
+			 percentile(sorted, count, 50.0), percentile(sorted, count, 90.0),
+			 percentile(sorted, count, 99.0), sorted[count - 1]);
+	free(sorted);
+}
+
+static void log_latency(struct latency_log *log, struct render_service *service) {
+	char text[256];
+	describe_latency(&log->samples[log->logged], log->count - log->logged, text, sizeof(text));
+	struct render_service_stats stats = render_service_get_stats(service);
+	fprintf(stderr, "c3do_daemon: %d jobs in %ld batches (%ld rendered, %d files loaded), last %d: %s\n",
+			log->count, stats.batches, stats.rendered, stats.files_loaded, log->count - log->logged, text);
+	log->logged = log->count;
+}
+
+// ********** Sockets **********
+
+static bool send_all(int fd, const void *data, size_t size) {
+	const char *p = data;
+	while (size > 0) {
+		ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		p += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static bool send_line(int fd, const char *line) {
+	return send_all(fd, line, strlen(line));
+}
+
+static void log_sample(struct latency_log *log, double latency) {
+	if (log->count == log->capacity) {
+		log->capacity = log->capacity ? log->capacity * 2 : 1024;
+		log->samples = realloc(log->samples, sizeof(double) * log->capacity);
+	}
+	log->samples[log->count++] = latency;
+}
+
+static void queue_output(struct client *client, const void *data, size_t size) {
+	// Moves what is left to send to the front first
+	if (client->sent > 0) {
+		memmove(client->output, client->output + client->sent, client->queued - client->sent);
+		for (int i = 0; i < client->answer_count; i++) {
+			client->answers[i].end -= client->sent;
+		}
+		client->queued -= client->sent;
+		client->sent = 0;
+	}
+	if (client->queued + size > client->capacity) {
+		client->capacity = client->queued + size > client->capacity * 2 ? client->queued + size : client->capacity * 2;
+		client->output = realloc(client->output, client->capacity);
+	}
+	memcpy(client->output + client->queued, data, size);
+	client->queued += size;
+}
+
+static void queue_line(struct client *client, const char *line) {
+	queue_output(client, line, strlen(line));
+}
+
+/**
+ Marks the end of a job's answer, to log its latency once it's sent
+ */
+static void queue_answer_end(struct client *client, double received_ms) {
+	if (client->answer_count == client->answer_capacity) {
+		client->answer_capacity = client->answer_capacity ? client->answer_capacity * 2 : 16;
+		client->answers = realloc(client->answers, sizeof(struct queued_answer) * client->answer_capacity);
+	}
+	client->answers[client->answer_count++] = (struct queued_answer){.end = client->queued, .received_ms = received_ms};
+}
+
+/**
+ Sends as much of the queued output as the socket takes without blocking.
+ Returns false if the client has to be disconnected.
+ */
+static bool flush_client(struct client *client, struct latency_log *log) {
+	while (client->sent < client->queued) {
+		ssize_t sent = send(client->fd, client->output + client->sent, client->queued - client->sent, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		client->sent += sent;
+	}
+
+	int done = 0;
+	while (done < client->answer_count && client->answers[done].end <= client->sent) {
+		log_sample(log, timing_now_ms() - client->answers[done].received_ms);
+		done++;
+	}
+	client->answer_count -= done;
+	memmove(client->answers, client->answers + done, sizeof(struct queued_answer) * client->answer_count);
+	if (client->sent == client->queued) {
+		client->sent = client->queued = 0;
+	}
+	return client->queued - client->sent <= MAX_QUEUED;
+}
+
+static struct sockaddr_un socket_address(const char *path) {
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	return address;
+}
+
+static int listen_on(const char *path) {
+	if (strlen(path) >= sizeof(((struct sockaddr_un *)NULL)->sun_path)) {
+		fprintf(stderr, "Socket path is too long: %s\n", path);
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	struct sockaddr_un address = socket_address(path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, MAX_CLIENTS) != 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void close_client(struct client *clients, int c, struct pending_job *pending, int pending_count) {
+	close(clients[c].fd);
+	clients[c].fd = -1;
+	free(clients[c].output);
+	free(clients[c].answers);
+	for (int i = 0; i < pending_count; i++) {
+		if (pending[i].client == c) {
+			pending[i].client = -1;
+		}
+	}
+}
+
+// ********** Daemon **********
+
+/**
+ Renders the pending jobs as one batch and answers them
+ */
+static void run_batch(struct render_service *service, struct client *clients, struct pending_job *pending, int count, struct latency_log *log) {
+	struct render_job *jobs = malloc(sizeof(struct render_job) * count);
+	struct render_result *results = malloc(sizeof(struct render_result) * count);
+	int *result_index = malloc(sizeof(int) * count);
+	int job_count = 0;
+	for (int i = 0; i < count; i++) {
+		result_index[i] = -1;
+		if (pending[i].valid && pending[i].client >= 0) {
+			result_index[i] = job_count;
+			jobs[job_count++] = pending[i].job;
+		}
+	}
+	render_service_render(service, jobs, job_count, results);
+
+	for (int i = 0; i < count; i++) {
+		struct render_result *result = result_index[i] >= 0 ? &results[result_index[i]] : NULL;
+		int c = pending[i].client;
+		if (c >= 0) {
+			char header[sizeof(result->error) + 16];
+			if (result && result->ok) {
+				snprintf(header, sizeof(header), "OK %zu\n", result->image_size);
+				queue_line(&clients[c], header);
+				queue_output(&clients[c], result->image, result->image_size);
+				log->render_ms += result->render_ms;
+			} else {
+				snprintf(header, sizeof(header), "ERROR %s\n", result ? result->error : pending[i].error);
+				queue_line(&clients[c], header);
+			}
+			queue_answer_end(&clients[c], pending[i].received_ms);
+			if (!flush_client(&clients[c], log)) {
+				close_client(clients, c, pending, count);
+			}
+		}
+		if (result) {
+			render_result_free(result);
+		}
+	}
+	log->batches++;
+
+	free(result_index);
+	free(results);
+	free(jobs);
+}
+
+/**
+ Handles one line from a client. Jobs are added to pending.
+ */
+static void handle_line(struct client *clients, int c, char *line, struct pending_job *pending, int *pending_count,
+						struct render_service *service, struct latency_log *log)
+{
+	if (strcmp(line, "stats") == 0) {
+		char text[256];
+		char answer[512];
+		describe_latency(log->samples, log->count, text, sizeof(text));
+		struct render_service_stats stats = render_service_get_stats(service);
+		snprintf(answer, sizeof(answer), "jobs %d batches %ld rendered %ld files %d contexts %ld latency %s\n",
+				 log->count, stats.batches, stats.rendered, stats.files_loaded, stats.contexts_created, text);
+		queue_line(&clients[c], answer);
+		return;
+	}
+
+	struct pending_job *p = &pending[(*pending_count)++];
+	p->client = c;
+	p->job = render_job_default();
+	p->valid = render_job_parse(line, &p->job, p->error, sizeof(p->error));
+	p->received_ms = timing_now_ms();
+}
+
+/**
+ Handles the complete lines a client has sent, while the batch has room for
+ them. Returns false if the client has to be disconnected.
+ */
+static bool process_lines(struct client *clients, int c, struct pending_job *pending, int *pending_count, int max_batch,
+						  struct render_service *service, struct latency_log *log)
+{
+	struct client *client = &clients[c];
+	char *start = client->buffer;
+	char *end;
+	while (*pending_count < max_batch && (end = memchr(start, '\n', client->buffer + client->length - start))) {
+		*end = '\0';
+		handle_line(clients, c, start, pending, pending_count, service, log);
+		start = end + 1;
+	}
+	client->length -= start - client->buffer;
+	memmove(client->buffer, start, client->length);
+	if (client->length == sizeof(client->buffer) && !memchr(client->buffer, '\n', client->length)) {
+		queue_line(client, "ERROR Line too long\n");
+		flush_client(client, log);
+		return false;
+	}
+	return flush_client(client, log);
+}
+
+/**
+ Reads what a client has sent. Returns false once the client is gone.
+ */
+static bool read_client(struct client *client) {
+	if (client->length == sizeof(client->buffer)) {
+		return true; // Full of lines waiting for the next batch
+	}
+	ssize_t received = recv(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length, 0);
+	if (received <= 0) {
+		return received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+	client->length += received;
+	return true;
+}
+
+/**
+ Adds the lines clients have sent to the batch, and starts timing the batch
+ window with its first job
+ */
+static void process_clients(struct client *clients, struct pending_job *pending, int *pending_count, double *batch_start,
+							struct daemon_options *options, struct render_service *service, struct latency_log *log)
+{
+	for (int c = 0; c < MAX_CLIENTS; c++) {
+		if (clients[c].fd < 0) {
+			continue;
+		}
+		int before = *pending_count;
+		if (!process_lines(clients, c, pending, pending_count, options->max_batch, service, log)) {
+			close_client(clients, c, pending, *pending_count);
+		}
+		if (before == 0 && *pending_count > 0) {
+			*batch_start = timing_now_ms();
+		}
+	}
+}
+
+static int run_daemon(struct daemon_options *options) {
+	int listener = listen_on(options->socket_path);
+	if (listener < 0) {
+		return 1;
+	}
+	struct render_service *service = create_render_service(options->loaders, options->contexts);
+	struct client clients[MAX_CLIENTS];
+	for (int c = 0; c < MAX_CLIENTS; c++) {
+		clients[c].fd = -1;
+	}
+	struct pending_job *pending = malloc(sizeof(struct pending_job) * options->max_batch);
+	int pending_count = 0;
+	double batch_start = 0.0;
+	struct latency_log log = {0};
+	fprintf(stderr, "c3do_daemon: listening on %s\n", options->socket_path);
+
+	while (!quit) {
+		process_clients(clients, pending, &pending_count, &batch_start, options, service, &log);
+
+		struct pollfd fds[MAX_CLIENTS + 1];
+		int clients_polled[MAX_CLIENTS + 1];
+		int fd_count = 0;
+		fds[fd_count++] = (struct pollfd){.fd = listener, .events = POLLIN};
+		for (int c = 0; c < MAX_CLIENTS; c++) {
+			if (clients[c].fd >= 0) {
+				clients_polled[fd_count] = c;
+				short events = clients[c].sent < clients[c].queued ? POLLIN | POLLOUT : POLLIN;
+				fds[fd_count++] = (struct pollfd){.fd = clients[c].fd, .events = events};
+			}
+		}
+
+		int timeout = -1;
+		if (pending_count > 0) {
+			double left = batch_start + options->batch_window - timing_now_ms();
+			timeout = left > 0.0 ? (int)(left + 0.999) : 0;
+		}
+		if (poll(fds, fd_count, timeout) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listener, NULL, NULL);
+			int c = 0;
+			while (c < MAX_CLIENTS && clients[c].fd >= 0) {
+				c++;
+			}
+			if (fd >= 0 && c < MAX_CLIENTS) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				clients[c] = (struct client){.fd = fd};
+			} else if (fd >= 0) {
+				send_line(fd, "ERROR Too many clients\n");
+				close(fd);
+			}
+		}
+		for (int i = 1; i < fd_count; i++) {
+			int c = clients_polled[i];
+			if ((fds[i].revents & POLLOUT) && clients[c].fd >= 0 && !flush_client(&clients[c], &log)) {
+				close_client(clients, c, pending, pending_count);
+			}
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) || clients[c].fd < 0) {
+				continue;
+			}
+			if (!read_client(&clients[c])) {
+				close_client(clients, c, pending, pending_count);
+			}
+		}
+		process_clients(clients, pending, &pending_count, &batch_start, options, service, &log);
+
+		if (pending_count > 0 && (pending_count >= options->max_batch || timing_now_ms() >= batch_start + options->batch_window)) {
+			run_batch(service, clients, pending, pending_count, &log);
+			pending_count = 0;
+			if (log.count - log.logged >= options->log_every) {
+				log_latency(&log, service);
+			}
+		}
+	}
+
+	if (log.count > log.logged) {
+		log_latency(&log, service);
+	}
+	if (log.count > 0) {
+		char text[256];
+		describe_latency(log.samples, log.count, text, sizeof(text));
+		fprintf(stderr, "c3do_daemon: all %d jobs: %s, %.2f ms rendering per job, %.1f jobs per batch\n",
+				log.count, text, log.render_ms / log.count, (double)log.count / log.batches);
+	}
+
+	for (int c = 0; c < MAX_CLIENTS; c++) {
+		if (clients[c].fd >= 0) {
+			close_client(clients, c, pending, 0);
+		}
+	}
+	close(listener);
+	unlink(options->socket_path);
+	destroy_render_service(service);
+	free(pending);
+	free(log.samples);
+	return 0;
+}
+
+// ********** Client **********
+
+/**
+ Reads one line, up to and without the newline
+ */
+static bool receive_line(int fd, char *line, size_t size) {
+	size_t length = 0;
+	while (length + 1 < size) {
+		ssize_t received = recv(fd, &line[length], 1, 0);
+		if (received <= 0) {
+			return false;
+		}
+		if (line[length] == '\n') {
+			break;
+		}
+		length++;
+	}
+	line[length] = '\0';
+	return true;
+}
+
+static bool receive_all(int fd, uint8_t *data, size_t size) {
+	while (size > 0) {
+		ssize_t received = recv(fd, data, size, 0);
+		if (received <= 0) {
+			return false;
+		}
+		data += received;
+		size -= received;
+	}
+	return true;
+}
+
+/**
+ Sends the job --repeat times, keeping up to --pipeline of them in flight,
+ and reports how long each took to be answered
+ */
+static int run_client(struct daemon_options *options) {
+	// Checked here for a clearer message, and for the yaw to turn from
+	struct render_job job = render_job_default();
+	char error[128];
+	if (!render_job_parse(options->job, &job, error, sizeof(error))) {
+		fprintf(stderr, "%s\n", error);
+		return 1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un address = socket_address(options->socket_path);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		perror(options->socket_path);
+		return 1;
+	}
+	size_t line_size = strlen(options->job) + 64;
+	char *line = malloc(line_size);
+	double *sent_at = malloc(sizeof(double) * options->repeat);
+	double *latencies = malloc(sizeof(double) * options->repeat);
+	int sent = 0;
+	int status = 0;
+	size_t total_bytes = 0;
+	double start = timing_now_ms();
+
+	for (int i = 0; i < options->repeat && status == 0; i++) {
+		while (sent < options->repeat && sent < i + options->pipeline) {
+			snprintf(line, line_size, "%s yaw=%.17g\n", options->job, job.yaw + options->turn * sent);
+			sent_at[sent] = timing_now_ms();
+			if (!send_line(fd, line)) {
+				perror("send");
+				status = 1;
+				break;
+			}
+			sent++;
+		}
+
+		char header[512];
+		size_t size;
+		if (status != 0 || !receive_line(fd, header, sizeof(header))) {
+			fprintf(stderr, "Connection closed\n");
+			status = 1;
+			break;
+		}
+		if (sscanf(header, "OK %zu", &size) != 1) {
+			fprintf(stderr, "%s\n", header);
+			status = 1;
+			break;
+		}
+		uint8_t *image = malloc(size);
+		if (!receive_all(fd, image, size)) {
+			fprintf(stderr, "Connection closed\n");
+			status = 1;
+		}
+		latencies[i] = timing_now_ms() - sent_at[i];
+		total_bytes += size;
+		if (status == 0 && i == 0 && options->output) {
+			FILE *fp = fopen(options->output, "wb");
+			if (!fp || fwrite(image, 1, size, fp) != size) {
+				perror(options->output);
+				status = 1;
+			}
+			if (fp) {
+				fclose(fp);
+			}
+		}
+		free(image);
+	}
+
+	if (status == 0) {
+		char text[256];
+		double total = timing_now_ms() - start;
+		describe_latency(latencies, options->repeat, text, sizeof(text));
+		printf("%d images, %.1f MB in %.2f ms (%.1f images/s), latency %s\n", options->repeat,
+			   total_bytes / 1048576.0, total, options->repeat * 1000.0 / total, text);
+	}
+	free(latencies);
+	free(sent_at);
+	free(line);
+	close(fd);
+	return status;
+}
+
+// ********** Main **********
+
+static void usage(void) {
+	fputs("Usage: c3do_daemon [options]\n"
+		  "       c3do_daemon --client [options] [key=value ...]\n"
+		  "  --socket PATH       Unix domain socket (default /tmp/c3do.sock)\n"
+		  "  --batch-window MS   how long to collect jobs into a batch (default 2)\n"
+		  "  --max-batch N       most jobs in a batch (default 32)\n"
+		  "  --log-every N       log latency percentiles every N jobs (default 100)\n"
+		  "  --loaders N         threads loading models and textures (default one per CPU)\n"
+		  "  --contexts N        contexts kept for different resolutions (default 4)\n"
+		  "  --client            send the job given by the key=value pairs to a running daemon\n"
+		  "  --repeat N          with --client, send the job N times (default 1)\n"
+		  "  --pipeline N        with --client, jobs sent before waiting for an answer (default 8)\n"
+		  "  --turn RADIANS      with --client, add to the yaw of every repeated job (default 0)\n"
+		  "  --output FILE       with --client, write the first image to FILE\n", stderr);
+}
+
+static bool parse_options(int argc, char *argv[], struct daemon_options *options, char *job, size_t job_size) {
+	job[0] = '\0';
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--socket") == 0 && has_value) {
+			options->socket_path = argv[++i];
+		} else if (strcmp(argv[i], "--batch-window") == 0 && has_value) {
+			options->batch_window = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--max-batch") == 0 && has_value) {
+			options->max_batch = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--log-every") == 0 && has_value) {
+			options->log_every = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--loaders") == 0 && has_value) {
+			options->loaders = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--contexts") == 0 && has_value) {
+			options->contexts = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--client") == 0) {
+			options->client = true;
+		} else if (strcmp(argv[i], "--repeat") == 0 && has_value) {
+			options->repeat = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--pipeline") == 0 && has_value) {
+			options->pipeline = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--turn") == 0 && has_value) {
+			options->turn = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--output") == 0 && has_value) {
+			options->output = argv[++i];
+		} else if (options->client && strchr(argv[i], '=') && strlen(job) + strlen(argv[i]) + 2 <= job_size) {
+			strcat(job, " ");
+			strcat(job, argv[i]);
+		} else {
+			return false;
+		}
+	}
+	options->job = job;
+	return options->batch_window >= 0.0 && options->max_batch > 0 && options->log_every > 0 &&
+		   options->loaders >= 0 && options->contexts > 0 && options->repeat > 0 && options->pipeline > 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct daemon_options options = {.socket_path = "/tmp/c3do.sock", .batch_window = 2.0, .max_batch = 32,
+									 .log_every = 100, .contexts = 4, .repeat = 1, .pipeline = 8};
+	char job[MAX_LINE];
+	if (!parse_options(argc, argv, &options, job, sizeof(job))) {
+		usage();
+		return 1;
+	}
+	if (options.client) {
+		return run_client(&options);
+	}
+
+	struct sigaction action = {.sa_handler = &on_signal};
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	return run_daemon(&options);
+}
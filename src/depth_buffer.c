@@ -0,0 +1,117 @@
+#include "depth_buffer.h"
+#include <stdlib.h>
+
+static size_t depth_format_size(enum depth_format format) {
+	switch (format) {
+	case DEPTH_FORMAT_FLOAT32: return sizeof(float);
+	case DEPTH_FORMAT_UNORM24: return sizeof(uint32_t);
+	case DEPTH_FORMAT_UNORM16: return sizeof(uint16_t);
+	}
+	return sizeof(float);
+}
+
+const char *depth_format_name(enum depth_format format) {
+	switch (format) {
+	case DEPTH_FORMAT_FLOAT32: return "float32";
+	case DEPTH_FORMAT_UNORM24: return "unorm24";
+	case DEPTH_FORMAT_UNORM16: return "unorm16";
+	}
+	return "unknown";
+}
+
+struct depth_buffer *create_depth_buffer(int width, int height, enum depth_format format) {
+	struct depth_buffer *buffer = malloc(sizeof(struct depth_buffer));
+	buffer->width = width;
+	buffer->height = height;
+	buffer->format = format;
+	buffer->tiles_x = (width + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+	buffer->tiles_y = (height + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+	buffer->tile_cleared = malloc(buffer->tiles_x * buffer->tiles_y);
+	buffer->data = malloc(depth_format_size(format) * width * height);
+	depth_buffer_set_range(buffer, -8192.0, 8192.0);
+	depth_buffer_clear(buffer);
+	return buffer;
+}
+
+void destroy_depth_buffer(struct depth_buffer *buffer) {
+	free(buffer->tile_cleared);
+	free(buffer->data);
+	free(buffer);
+}
+
+void depth_buffer_set_range(struct depth_buffer *buffer, double near, double far) {
+	buffer->near = near;
+	buffer->far = far;
+	buffer->scale = 1.0 / (far - near);
+}
+
+void depth_buffer_clear(struct depth_buffer *buffer) {
+	memset(buffer->tile_cleared, 1, buffer->tiles_x * buffer->tiles_y);
+}
+
+void depth_buffer_fill_tile(struct depth_buffer *buffer, int tile) {
+	int x = (tile % buffer->tiles_x) * DEPTH_TILE_SIZE;
+	int y = (tile / buffer->tiles_x) * DEPTH_TILE_SIZE;
+	int width = x + DEPTH_TILE_SIZE > buffer->width ? buffer->width - x : DEPTH_TILE_SIZE;
+	int height = y + DEPTH_TILE_SIZE > buffer->height ? buffer->height - y : DEPTH_TILE_SIZE;
+	size_t size = depth_format_size(buffer->format);
+
+	// Zero is the far plane in every format
+	for (int row = y; row < y + height; row++) {
+		memset((char *)buffer->data + (buffer->width * row + x) * size, 0, width * size);
+	}
+	buffer->tile_cleared[tile] = 0;
+}
+
+double depth_buffer_get(struct depth_buffer *buffer, int x, int y) {
+	if (buffer->tile_cleared[depth_buffer_tile(buffer, x, y)]) {
+		return buffer->far;
+	}
+
+	int i = buffer->width * y + x;
+	double d = 0.0;
+	switch (buffer->format) {
+	case DEPTH_FORMAT_FLOAT32:
+		d = ((float *)buffer->data)[i];
+		break;
+	case DEPTH_FORMAT_UNORM24:
+		d = ((uint32_t *)buffer->data)[i] / (double)0xffffff;
+		break;
+	case DEPTH_FORMAT_UNORM16:
+		d = ((uint16_t *)buffer->data)[i] / (double)0xffff;
+		break;
+	}
+	return buffer->far - d / buffer->scale;
+}
+
+void depth_buffer_get_row(struct depth_buffer *buffer, int y, float *z) {
+	int row = buffer->width * y;
+	double scale = 1.0 / buffer->scale;
+	for (int x = 0; x < buffer->width; x += DEPTH_TILE_SIZE) {
+		int end = x + DEPTH_TILE_SIZE < buffer->width ? x + DEPTH_TILE_SIZE : buffer->width;
+		if (buffer->tile_cleared[depth_buffer_tile(buffer, x, y)]) {
+			for (int i = x; i < end; i++) {
+				z[i] = buffer->far;
+			}
+			continue;
+		}
+
+		switch (buffer->format) {
+		case DEPTH_FORMAT_FLOAT32:
+			for (int i = x; i < end; i++) {
+				z[i] = buffer->far - ((float *)buffer->data)[row + i] * scale;
+			}
+			break;
+		case DEPTH_FORMAT_UNORM24:
+			for (int i = x; i < end; i++) {
+				z[i] = buffer->far - ((uint32_t *)buffer->data)[row + i] / (double)0xffffff * scale;
+			}
+			break;
+		case DEPTH_FORMAT_UNORM16:
+			for (int i = x; i < end; i++) {
+				z[i] = buffer->far - ((uint16_t *)buffer->data)[row + i] / (double)0xffff * scale;
+			}
+			break;
+		}
+	}
+}
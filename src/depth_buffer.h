@@ -0,0 +1,185 @@
+#ifndef DEPTH_BUFFER_H
+#define DEPTH_BUFFER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ The depth buffer is split into square tiles, each with a "cleared" flag.
+ Clearing the buffer only sets the flags; a tile is logically at the far
+ plane until the first write to it, which is when its memory is filled.
+ */
+#define DEPTH_TILE_SHIFT 5
+#define DEPTH_TILE_SIZE (1 << DEPTH_TILE_SHIFT)
+
+/**
+ All formats store depth reversed: the near end of the depth range maps to
+ the largest value and the far end to zero. A zero-filled tile is therefore
+ exactly the far plane, and every format uses the same "greater or equal
+ passes" comparison.
+ */
+enum depth_format {
+	DEPTH_FORMAT_FLOAT32,	// 32-bit float, 1.0 at near and 0.0 at far
+	DEPTH_FORMAT_UNORM24,	// 24-bit fixed point, stored in 32 bits
+	DEPTH_FORMAT_UNORM16	// 16-bit fixed point
+};
+
+/**
+ Comparison used when a fragment is depth tested, in terms of Z-values
+ */
+enum depth_test {
+	DEPTH_TEST_LESS_EQUAL,	// Nearer or equal passes and is written (the default)
+	DEPTH_TEST_EQUAL		// Only the stored Z-value passes, nothing is written. For color passes after a z-prepass.
+};
+
+struct depth_buffer {
+	int width;
+	int height;
+	enum depth_format format;
+
+	// Z-values are mapped linearly from [near, far] and clamped to that range.
+	// Lower Z-values are closer to the camera.
+	double near;
+	double far;
+	double scale;
+
+	int tiles_x;
+	int tiles_y;
+	uint8_t *tile_cleared;
+	void *data;
+};
+
+struct depth_buffer *create_depth_buffer(int width, int height, enum depth_format format);
+void destroy_depth_buffer(struct depth_buffer *buffer);
+
+/**
+ Sets the Z-range that is mapped to the depth format. Defaults to [-8192, 8192].
+ */
+void depth_buffer_set_range(struct depth_buffer *buffer, double near, double far);
+
+/**
+ Clears all tiles to the far plane. Only touches one byte per tile.
+ */
+void depth_buffer_clear(struct depth_buffer *buffer);
+
+/**
+ Returns the Z-value stored at a pixel (the far end of the range if cleared).
+ */
+double depth_buffer_get(struct depth_buffer *buffer, int x, int y);
+
+/**
+ Same as depth_buffer_get for a whole row of pixels at once, into z
+ */
+void depth_buffer_get_row(struct depth_buffer *buffer, int y, float *z);
+
+/**
+ Fills the memory of a logically cleared tile, and marks it as written.
+ */
+void depth_buffer_fill_tile(struct depth_buffer *buffer, int tile);
+
+const char *depth_format_name(enum depth_format format);
+
+// ********** Per-fragment functions, inlined into the rasterizer **********
+
+static inline int depth_buffer_tile(struct depth_buffer *buffer, int x, int y) {
+	return (y >> DEPTH_TILE_SHIFT) * buffer->tiles_x + (x >> DEPTH_TILE_SHIFT);
+}
+
+/**
+ Maps a Z-value to [0, 1], reversed so that 1.0 is the near end of the range.
+ */
+static inline double depth_buffer_normalize(struct depth_buffer *buffer, double z) {
+	double d = (buffer->far - z) * buffer->scale;
+	return d < 0.0 ? 0.0 : (d > 1.0 ? 1.0 : d);
+}
+
+/**
+ Returns true if a fragment at Z-value z is not occluded at (x, y).
+ */
+static inline bool depth_buffer_test(struct depth_buffer *buffer, int x, int y, double z) {
+	if (buffer->tile_cleared[depth_buffer_tile(buffer, x, y)]) {
+		return true;
+	}
+
+	int i = buffer->width * y + x;
+	double d = depth_buffer_normalize(buffer, z);
+	switch (buffer->format) {
+	case DEPTH_FORMAT_FLOAT32:
+		return (float)d >= ((float *)buffer->data)[i];
+	case DEPTH_FORMAT_UNORM24:
+		return (uint32_t)(d * 0xffffff + 0.5) >= ((uint32_t *)buffer->data)[i];
+	case DEPTH_FORMAT_UNORM16:
+		return (uint16_t)(d * 0xffff + 0.5) >= ((uint16_t *)buffer->data)[i];
+	}
+	return true;
+}
+
+/**
+ Returns true if a fragment at Z-value z has exactly the depth stored at
+ (x, y), after conversion to the buffer format. Cleared tiles never match.
+ */
+static inline bool depth_buffer_test_equal(struct depth_buffer *buffer, int x, int y, double z) {
+	if (buffer->tile_cleared[depth_buffer_tile(buffer, x, y)]) {
+		return false;
+	}
+
+	int i = buffer->width * y + x;
+	double d = depth_buffer_normalize(buffer, z);
+	switch (buffer->format) {
+	case DEPTH_FORMAT_FLOAT32:
+		return (float)d == ((float *)buffer->data)[i];
+	case DEPTH_FORMAT_UNORM24:
+		return (uint32_t)(d * 0xffffff + 0.5) == ((uint32_t *)buffer->data)[i];
+	case DEPTH_FORMAT_UNORM16:
+		return (uint16_t)(d * 0xffff + 0.5) == ((uint16_t *)buffer->data)[i];
+	}
+	return false;
+}
+
+/**
+ Same as depth_buffer_test_and_set, for a depth that was already mapped with
+ depth_buffer_normalize()
+ */
+static inline bool depth_buffer_test_and_set_normalized(struct depth_buffer *buffer, int x, int y, double d) {
+	int tile = depth_buffer_tile(buffer, x, y);
+	if (buffer->tile_cleared[tile]) {
+		depth_buffer_fill_tile(buffer, tile);
+	}
+
+	int i = buffer->width * y + x;
+	switch (buffer->format) {
+	case DEPTH_FORMAT_FLOAT32: {
+		float value = (float)d;
+		float *stored = (float *)buffer->data + i;
+		if (value < *stored) return false;
+		*stored = value;
+		return true;
+	}
+	case DEPTH_FORMAT_UNORM24: {
+		uint32_t value = (uint32_t)(d * 0xffffff + 0.5);
+		uint32_t *stored = (uint32_t *)buffer->data + i;
+		if (value < *stored) return false;
+		*stored = value;
+		return true;
+	}
+	case DEPTH_FORMAT_UNORM16: {
+		uint16_t value = (uint16_t)(d * 0xffff + 0.5);
+		uint16_t *stored = (uint16_t *)buffer->data + i;
+		if (value < *stored) return false;
+		*stored = value;
+		return true;
+	}
+	}
+	return true;
+}
+
+/**
+ Depth tests a fragment and stores its Z-value if it passes. Writing to a
+ cleared tile always passes, since the filled tile is at the far plane.
+ */
+static inline bool depth_buffer_test_and_set(struct depth_buffer *buffer, int x, int y, double z) {
+	return depth_buffer_test_and_set_normalized(buffer, x, y, depth_buffer_normalize(buffer, z));
+}
+
+#endif
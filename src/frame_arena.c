@@ -0,0 +1,88 @@
+#include "frame_arena.h"
+#include <stdlib.h>
+
+#define ALIGNMENT 16
+
+/**
+ A block that didn't fit in the main block, freed on reset
+ */
+struct overflow_block {
+	struct overflow_block *next;
+	char padding[ALIGNMENT - sizeof(struct overflow_block *)]; // Keeps the data after the header aligned
+};
+
+struct frame_arena {
+	char *block;
+	size_t capacity;
+	size_t offset;
+	struct overflow_block *overflow;
+	size_t overflow_bytes;
+	struct frame_arena_stats stats;
+};
+
+static size_t align_size(size_t size) {
+	return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+}
+
+struct frame_arena *create_frame_arena(size_t capacity) {
+	struct frame_arena *arena = calloc(1, sizeof(struct frame_arena));
+	arena->capacity = align_size(capacity > 0 ? capacity : ALIGNMENT);
+	arena->block = malloc(arena->capacity);
+	arena->stats.block_allocations = 1;
+	return arena;
+}
+
+static void free_overflow(struct frame_arena *arena) {
+	while (arena->overflow) {
+		struct overflow_block *next = arena->overflow->next;
+		free(arena->overflow);
+		arena->overflow = next;
+	}
+	arena->overflow_bytes = 0;
+}
+
+void destroy_frame_arena(struct frame_arena *arena) {
+	free_overflow(arena);
+	free(arena->block);
+	free(arena);
+}
+
+void *frame_arena_alloc(struct frame_arena *arena, size_t size) {
+	size = align_size(size > 0 ? size : 1);
+	void *memory;
+	if (arena->offset + size <= arena->capacity) {
+		memory = arena->block + arena->offset;
+		arena->offset += size;
+	} else {
+		struct overflow_block *block = malloc(sizeof(struct overflow_block) + size);
+		block->next = arena->overflow;
+		arena->overflow = block;
+		arena->overflow_bytes += size;
+		arena->stats.block_allocations++;
+		memory = block + 1;
+	}
+
+	size_t used = arena->offset + arena->overflow_bytes;
+	if (used > arena->stats.high_water) {
+		arena->stats.high_water = used;
+	}
+	return memory;
+}
+
+void frame_arena_reset(struct frame_arena *arena) {
+	if (arena->overflow) {
+		free_overflow(arena);
+		free(arena->block);
+		arena->capacity = align_size(arena->stats.high_water);
+		arena->block = malloc(arena->capacity);
+		arena->stats.block_allocations++;
+	}
+	arena->offset = 0;
+}
+
+struct frame_arena_stats frame_arena_get_stats(struct frame_arena *arena) {
+	struct frame_arena_stats stats = arena->stats;
+	stats.capacity = arena->capacity;
+	stats.used = arena->offset + arena->overflow_bytes;
+	return stats;
+}
@@ -0,0 +1,37 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stddef.h>
+
+/**
+ A linear allocator for data that only lives until the end of a frame.
+ Allocating moves a pointer forward, and resetting frees everything at once.
+
+ When the block runs out, allocations go to extra blocks from malloc. The next
+ reset replaces them all with one block as large as the most the arena has
+ held, so once frames stop growing, the arena stops calling malloc.
+
+ Not thread safe. Each graphics context has its own, so every thread that
+ renders into its own context allocates from its own arena.
+ */
+struct frame_arena;
+
+struct frame_arena_stats {
+	size_t capacity;   // Size of the main block
+	size_t used;       // Allocated since the last reset
+	size_t high_water; // Most ever allocated between two resets
+	long block_allocations; // Blocks allocated with malloc, including the first one
+};
+
+struct frame_arena *create_frame_arena(size_t capacity);
+void destroy_frame_arena(struct frame_arena *arena);
+
+/**
+ Returns size bytes aligned for any type, valid until the next reset
+ */
+void *frame_arena_alloc(struct frame_arena *arena, size_t size);
+void frame_arena_reset(struct frame_arena *arena);
+
+struct frame_arena_stats frame_arena_get_stats(struct frame_arena *arena);
+
+#endif
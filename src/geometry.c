@@ -116,6 +116,34 @@ vec3 transform_3d_apply(vec3 v, transform_3d t) {
 	return result;
 }
 
+transform_3d transform_3d_inverse(transform_3d t) {
+	// Inverse of the 3x3 part from its cofactors
+	double c00 = t.sy * t.sz - t.by * t.bz;
+	double c01 = t.by * t.az - t.ay * t.sz;
+	double c02 = t.ay * t.bz - t.sy * t.az;
+	double det = t.sx * c00 + t.ax * c01 + t.bx * c02;
+	double inverse_det = 1.0 / det;
+
+	transform_3d result = transform_3d_identity;
+	result.sx = c00 * inverse_det;
+	result.ax = (t.bx * t.bz - t.ax * t.sz) * inverse_det;
+	result.bx = (t.ax * t.by - t.bx * t.sy) * inverse_det;
+	result.ay = c01 * inverse_det;
+	result.sy = (t.sx * t.sz - t.bx * t.az) * inverse_det;
+	result.by = (t.bx * t.ay - t.sx * t.by) * inverse_det;
+	result.az = c02 * inverse_det;
+	result.bz = (t.ax * t.az - t.sx * t.bz) * inverse_det;
+	result.sz = (t.sx * t.sy - t.ax * t.ay) * inverse_det;
+
+	// Then the translation, moved back through the inverse
+	vec3 translation = {t.dm * t.tx, t.dm * t.ty, t.dm * t.tz};
+	vec3 moved = transform_3d_apply(translation, result);
+	result.tx = -moved.x;
+	result.ty = -moved.y;
+	result.tz = -moved.z;
+	return result;
+}
+
 transform_3d transform_3d_translate(transform_3d t, double tx, double ty, double tz) {
 	t.tx += tx;
 	t.ty += ty;
@@ -55,6 +55,12 @@ transform_3d transform_3d_make_rotation_z(double angle);
 transform_3d transform_3d_multiply(transform_3d t1, transform_3d t2);
 vec3 transform_3d_apply(vec3 v, transform_3d t);
 
+/**
+ Inverse of a transform, as applied by transform_3d_apply (which only uses
+ the rotation, scale and translation). NaN if the transform can't be inverted.
+ */
+transform_3d transform_3d_inverse(transform_3d t);
+
 transform_3d transform_3d_translate(transform_3d t, double tx, double ty, double sz);
 transform_3d transform_3d_scale(transform_3d t, double sx, double sy, double sz);
 transform_3d transform_3d_rotate_y_around_origin(transform_3d t, double angle);
@@ -1,111 +1,219 @@
 
 #include "graphics_context.h"
 #include "textures.h"
+#include "bmp.h"
+#include "cpu_kernels.h"
 #include <string.h>
-#include <limits.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdbool.h>
 
-#define Z_BUFFER_NONE UINT_MAX
-
-rgb_color texture_sample(struct texture t, vec2 coordinate);
+// Initial size of the frame arena, which grows to what frames need
+#define FRAME_ARENA_SIZE (64 * 1024)
 
 struct graphics_context *create_context(int width, int height) {
 	struct graphics_context *context = (struct graphics_context *)malloc(sizeof(struct graphics_context));
-	context->depth_buffer = (float *)malloc(sizeof(float) * width * height);
+	context->depth_buffer = create_depth_buffer(width, height, DEPTH_FORMAT_FLOAT32);
 	context->pixel_buffer = (uint32_t *)malloc(sizeof(uint32_t) * width * height);
-	memset(context->depth_buffer, Z_BUFFER_NONE, sizeof(float) * width * height);
 	context->width = width;
 	context->height = height;
+	context->max_height = height;
+	context->msaa = NULL;
+	context->depth_test = DEPTH_TEST_LESS_EQUAL;
+	context->stats = NULL;
+	context->heatmap_buffer = NULL;
+	context->checkerboard = -1;
+	context->arena = create_frame_arena(FRAME_ARENA_SIZE);
 	context->window_event_callback = NULL;
 	context->_internal = NULL;
 	return context;
 }
 
 void destroy_context(struct graphics_context *context) {
-	if (context->_internal) {
-		SDL_DestroyWindow(context->_internal);
-	}
 	free(context->pixel_buffer);
-	free(context->depth_buffer);
+	if (context->depth_buffer) {
+		destroy_depth_buffer(context->depth_buffer);
+	}
+	if (context->msaa) {
+		destroy_msaa_buffer(context->msaa);
+	}
+	free(context->stats);
+	free(context->heatmap_buffer);
+	destroy_frame_arena(context->arena);
 	free(context);
 }
 
-SDL_Surface *create_surface_from_context(struct graphics_context *context) {
-	return SDL_CreateRGBSurfaceFrom(context->pixel_buffer,
-									context->width,
-									context->height,
-									32,
-									context->width * sizeof(uint32_t),
-									0xff000000, 0x00ff0000, 0x0000ff00, 0);
+void context_set_depth_format(struct graphics_context *context, enum depth_format format) {
+	if (context->depth_buffer) {
+		destroy_depth_buffer(context->depth_buffer);
+	}
+	context->depth_buffer = create_depth_buffer(context->width, context->max_height, format);
+	if (context->msaa) {
+		context_set_msaa(context, context->msaa->samples);
+	}
+	context_set_height(context, context->height);
 }
 
-void context_activate_window(struct graphics_context *context) {
-	if (SDL_Init(SDL_INIT_VIDEO) != 0){
-		printf("SDL_Init Error: %s\n", SDL_GetError());
-		SDL_Quit();
+void context_set_msaa(struct graphics_context *context, int samples) {
+	if (context->msaa) {
+		destroy_msaa_buffer(context->msaa);
+		context->msaa = NULL;
 	}
-
-	SDL_Window *window = SDL_CreateWindow("c3do", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, context->width, context->height, SDL_WINDOW_OPENGL);
-	if (window == NULL) {
-		printf("Could not create window: %s\n", SDL_GetError());
+	if (samples == 4 || samples == 8) {
+		enum depth_format format = context->depth_buffer ? context->depth_buffer->format : DEPTH_FORMAT_FLOAT32;
+		context->msaa = create_msaa_buffer(context->width, context->max_height, samples, format);
+		if (context->depth_buffer) {
+			depth_buffer_set_range(context->msaa->depth, context->depth_buffer->near, context->depth_buffer->far);
+		}
+		msaa_clear(context->msaa, 0x000000ff);
+		context_set_height(context, context->height);
 	}
-	context->_internal = window;
+}
 
-	SDL_Event event;
-	while (SDL_WaitEvent(&event)) {
-		if (event.type == SDL_QUIT)
-			return;
+// Buffers are row-major with the full width as stride, so fewer rows only
+// means a shorter range of the same memory
+static void set_depth_rows(struct depth_buffer *buffer, int height) {
+	buffer->height = height;
+	buffer->tiles_y = (height + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+}
 
-		if (context->window_event_callback) {
-			context->window_event_callback(context, event);
-		}
+void context_set_height(struct graphics_context *context, int height) {
+	if (height < 1) {
+		height = 1;
+	} else if (height > context->max_height) {
+		height = context->max_height;
+	}
+	context->height = height;
+	if (context->depth_buffer) {
+		set_depth_rows(context->depth_buffer, height);
+	}
+	if (context->msaa) {
+		context->msaa->height = height;
+		set_depth_rows(context->msaa->depth, height);
 	}
 }
 
-void context_refresh_window(struct graphics_context *context) {
-	SDL_Surface *surface = create_surface_from_context(context);
-	SDL_BlitSurface(surface, NULL, SDL_GetWindowSurface(context->_internal), NULL);
-	SDL_UpdateWindowSurface(context->_internal);
-	SDL_FreeSurface(surface);
+void context_set_depth_test(struct graphics_context *context, enum depth_test test) {
+	context->depth_test = test;
+}
+
+void context_set_checkerboard(struct graphics_context *context, int parity) {
+	context->checkerboard = parity;
+}
+
+void context_resolve_msaa(struct graphics_context *context) {
+	if (context->msaa) {
+		msaa_resolve(context->msaa, context->pixel_buffer);
+	}
 }
 
 void context_save_BMP(struct graphics_context *context, char file_name[]) {
-	SDL_Surface *surface = create_surface_from_context(context);
-	SDL_SaveBMP(surface, file_name);
-	SDL_FreeSurface(surface);
+	context_resolve_msaa(context);
+	bmp_write(file_name, context->pixel_buffer, context->width, context->height);
+}
+
+// ********** Statistics ***************
+
+void context_enable_stats(struct graphics_context *context, bool enabled) {
+	if (enabled && !context->stats) {
+		context->stats = calloc(1, sizeof(struct pipeline_stats));
+	} else if (!enabled) {
+		free(context->stats);
+		context->stats = NULL;
+	}
+}
+
+void context_reset_stats(struct graphics_context *context) {
+	if (context->stats) {
+		memset(context->stats, 0, sizeof(struct pipeline_stats));
+	}
 }
 
-// ********** Z-buffering ***************
-double depth_buffer_get(int x, int y, struct graphics_context *context) {
-	return context->depth_buffer[context->width * x + y];
+struct pipeline_stats context_get_stats(struct graphics_context *context) {
+	struct pipeline_stats stats = {0};
+	return context->stats ? *context->stats : stats;
 }
 
-void depth_buffer_set(int x, int y, double value, struct graphics_context *context) {
-	context->depth_buffer[context->width * x + y] = value;
+void context_enable_heatmap(struct graphics_context *context, bool enabled) {
+	if (enabled && !context->heatmap_buffer) {
+		context->heatmap_buffer = calloc(context->width * context->max_height, sizeof(uint32_t));
+	} else if (!enabled) {
+		free(context->heatmap_buffer);
+		context->heatmap_buffer = NULL;
+	}
+}
+
+/**
+ Maps a value in [0, 1] onto a blue -> green -> yellow -> red ramp
+ */
+static uint32_t heatmap_color(double value) {
+	static const rgb_color ramp[] = {{0, 0, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+	int segments = sizeof(ramp) / sizeof(ramp[0]) - 1;
+	double position = value * segments;
+	int index = position >= segments ? segments - 1 : (int)position;
+	return rgba_from_color(interpolate_color(ramp[index], ramp[index + 1], position - index));
+}
+
+void context_save_heatmap(struct graphics_context *context, char file_name[]) {
+	if (!context->heatmap_buffer) {
+		return;
+	}
+
+	int pixel_count = context->width * context->height;
+	uint32_t max = 0;
+	for (int i = 0; i < pixel_count; i++) {
+		max = context->heatmap_buffer[i] > max ? context->heatmap_buffer[i] : max;
+	}
+
+	// Written straight from its own buffer, since context_save_BMP() would
+	// resolve MSAA samples over it
+	uint32_t *pixels = malloc(sizeof(uint32_t) * pixel_count);
+	for (int i = 0; i < pixel_count; i++) {
+		uint32_t count = context->heatmap_buffer[i];
+		pixels[i] = count == 0 ? 0x000000ff : heatmap_color(max > 1 ? (count - 1) / (double)(max - 1) : 1.0);
+	}
+	bmp_write(file_name, pixels, context->width, context->height);
+	free(pixels);
 }
 
 // ********** Drawing functions **********
 
-void draw_fragment(vec3 coordinate, rgb_color color, struct graphics_context *context) {
+/**
+ Depth tests a fragment against one of the context's depth buffers, with the
+ context's depth test
+ */
+static inline bool context_depth_test(struct graphics_context *context, struct depth_buffer *buffer, int x, int y, double z) {
+	if (context->depth_test == DEPTH_TEST_EQUAL) {
+		return depth_buffer_test_equal(buffer, x, y, z);
+	}
+	return depth_buffer_test_and_set(buffer, x, y, z);
+}
+
+/**
+ Bounds and depth tests a fragment, and returns its index in the pixel buffer,
+ or -1 if it should be discarded. The depth test runs before any shading, so
+ occluded fragments are never shaded.
+ */
+static int fragment_index(vec3 coordinate, struct graphics_context *context) {
 	int x = (int)round(coordinate.x);
 	int y = (int)round(coordinate.y);
 
 	// Discard fragments outside buffer bounds
 	if (x < 0 || x >= context->width || y < 0 || y >= context->height) {
-		return;
+		return -1;
 	}
-			
-	// Depth check (use the z-value for z-buffering)
-	if (context->depth_buffer) {
-		double current_depth = depth_buffer_get(x, y, context);
-		if (current_depth != Z_BUFFER_NONE && coordinate.z > current_depth)
-			return;
-		depth_buffer_set(x, y, coordinate.z, context);
+
+	COUNT_STAT(context->stats, fragments_generated);
+	if (context->heatmap_buffer) {
+		context->heatmap_buffer[context->width * y + x]++;
 	}
 
-	context->pixel_buffer[context->width * y + x] = rgba_from_color(color);
+	// Depth check (use the z-value for z-buffering)
+	if (context->depth_buffer && !context_depth_test(context, context->depth_buffer, x, y, coordinate.z)) {
+		COUNT_STAT(context->stats, fragments_depth_rejected);
+		return -1;
+	}
+	return context->width * y + x;
 }
 
 void swapf(double *a, double *b) {
@@ -114,45 +222,194 @@ void swapf(double *a, double *b) {
 	*b = tmp;
 }
 
+// ********** Lines **********
+
 /**
- Draws a 2D line between two points, ignoring Z-value
+ How much closer to the camera depth tested lines are, in Z-values, so that
+ the edges of triangles that have been drawn pass the depth test
  */
-void draw_line(vec2 p1, vec2 p2, struct graphics_context *context, rgb_color color) {
-	double line_width = fabs(p2.x - p1.x);
-	double line_height = fabs(p2.y - p1.y);
-	double length = (line_width > line_height) ? line_width : line_height;
-	
-    for (int i = 0; i < round(length); i++) {
-		double t = (double)i / length;
-		vec2 p = lerp(p1, p2, t);
+#define LINE_DEPTH_BIAS 2.0
+
+// Cohen-Sutherland outcodes
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+static int clip_code(vec3 p, double max_x, double max_y) {
+	int code = 0;
+	if (p.x < 0.0) {
+		code |= CLIP_LEFT;
+	} else if (p.x > max_x) {
+		code |= CLIP_RIGHT;
+	}
+	if (p.y < 0.0) {
+		code |= CLIP_TOP;
+	} else if (p.y > max_y) {
+		code |= CLIP_BOTTOM;
+	}
+	return code;
+}
+
+/**
+ Clips a line to the pixel centers of the context with Cohen-Sutherland, so
+ that every point on it rounds to a pixel inside the context. Returns false
+ if the line is entirely outside.
+ */
+static bool clip_line(vec3 *p1, vec3 *p2, struct graphics_context *context) {
+	double max_x = context->width - 1;
+	double max_y = context->height - 1;
+	int code1 = clip_code(*p1, max_x, max_y);
+	int code2 = clip_code(*p2, max_x, max_y);
+
+	while (code1 | code2) {
+		if (code1 & code2) {
+			return false; // Both ends on the outside of the same edge
+		}
+
+		// Move the end that is outside to the edge it is outside of
+		int code = code1 ? code1 : code2;
+		vec3 d = vec3_subtract(*p2, *p1);
+		double t;
+		if (code & CLIP_LEFT) {
+			t = -p1->x / d.x;
+		} else if (code & CLIP_RIGHT) {
+			t = (max_x - p1->x) / d.x;
+		} else if (code & CLIP_TOP) {
+			t = -p1->y / d.y;
+		} else {
+			t = (max_y - p1->y) / d.y;
+		}
+		vec3 p = vec3_add(*p1, vec3_scale(d, t));
+
+		// Snap the clipped coordinate to the edge, so rounding errors can't
+		// leave the point just outside it
+		if (code & (CLIP_LEFT | CLIP_RIGHT)) {
+			p.x = code & CLIP_LEFT ? 0.0 : max_x;
+		} else {
+			p.y = code & CLIP_TOP ? 0.0 : max_y;
+		}
+
+		if (code == code1) {
+			*p1 = p;
+			code1 = clip_code(p, max_x, max_y);
+		} else {
+			*p2 = p;
+			code2 = clip_code(p, max_x, max_y);
+		}
+	}
+	return true;
+}
+
+static inline void line_fragment(int x, int y, double z, packed_color color, bool depth_tested, struct graphics_context *context) {
+	if (context->msaa) {
+		struct msaa_buffer *msaa = context->msaa;
+		for (int s = 0; s < msaa->samples; s++) {
+			if (!depth_tested || depth_buffer_test(msaa->depth, x * msaa->samples + s, y, z)) {
+				msaa->color[(context->width * y + x) * msaa->samples + s] = color;
+			}
+		}
+	} else if (!depth_tested || depth_buffer_test(context->depth_buffer, x, y, z)) {
+		context->pixel_buffer[context->width * y + x] = color;
+	}
+}
 
-		struct vec3 coordinate = {.x = p.x, .y = p.y, .z = -9000.0};
-		draw_fragment(coordinate, color, context);
+void draw_line_3d(vec3 p1, vec3 p2, packed_color color, bool depth_tested, struct graphics_context *context) {
+	if (!clip_line(&p1, &p2, context)) {
+		return;
+	}
+	depth_tested = depth_tested && (context->msaa || context->depth_buffer);
+
+	// Bresenham: exactly one step along the major axis per pixel, with an
+	// integer error term for the minor axis
+	int x = (int)round(p1.x);
+	int y = (int)round(p1.y);
+	int x2 = (int)round(p2.x);
+	int y2 = (int)round(p2.y);
+	int dx = abs(x2 - x);
+	int dy = -abs(y2 - y);
+	int step_x = x < x2 ? 1 : -1;
+	int step_y = y < y2 ? 1 : -1;
+	int error = dx + dy;
+
+	int steps = dx > -dy ? dx : -dy;
+	double z = p1.z - LINE_DEPTH_BIAS;
+	double dz = steps > 0 ? (p2.z - p1.z) / steps : 0.0;
+
+	while (true) {
+		line_fragment(x, y, z, color, depth_tested, context);
+		if (x == x2 && y == y2) {
+			break;
+		}
+		int error2 = 2 * error;
+		if (error2 >= dy) {
+			error += dy;
+			x += step_x;
+		}
+		if (error2 <= dx) {
+			error += dx;
+			y += step_y;
+		}
+		z += dz;
 	}
 }
 
+void draw_line(vec2 p1, vec2 p2, struct graphics_context *context, rgb_color color) {
+	vec3 a = {p1.x, p1.y, 0.0};
+	vec3 b = {p2.x, p2.y, 0.0};
+	draw_line_3d(a, b, rgba_from_color(color), false, context);
+}
+
 void clear(struct graphics_context *context, rgb_color color) {
 	// Clear Z-buffer
-	memset(context->depth_buffer, Z_BUFFER_NONE, sizeof(double) * context->width * context->height);
+	if (context->depth_buffer) {
+		depth_buffer_clear(context->depth_buffer);
+	}
+	if (context->heatmap_buffer) {
+		memset(context->heatmap_buffer, 0, sizeof(uint32_t) * context->width * context->height);
+	}
 	uint32_t rgba = rgba_from_color(color);
-	for (int i = 0; i < context->width * context->height; i++) {
-		context->pixel_buffer[i] = rgba;
+	if (context->msaa) {
+		msaa_clear(context->msaa, rgba);
 	}
+	packed_fill(context->pixel_buffer, rgba, context->width * context->height);
+	frame_arena_reset(context->arena);
 }
 
 struct vertex vertex_lerp(struct vertex a, struct vertex b, double value) {
 	struct vertex result;
 	result.coordinate = lerp(a.coordinate, b.coordinate, value);
-	result.color = interpolate_color(a.color, b.color, value);
+	result.color = packed_lerp(a.color, b.color, color_factor(value));
 	result.normal = lerp(a.normal, b.normal, value);
 	result.texture_coordinate = lerp(a.texture_coordinate, b.texture_coordinate, value);
 	return result;
 }
 
-void draw_point(struct vertex p, struct fragment_shader_input shader_input, rgb_color (*fragment_shader)(struct fragment_shader_input), struct graphics_context *context) {
-	shader_input.interpolated_v = p;
-	rgb_color color = fragment_shader ? fragment_shader(shader_input) : p.color;
-	draw_fragment(p.coordinate, color, context);
+/**
+ True for the pixels that checkerboard rendering doesn't shade this frame
+ */
+static bool checkerboard_skips(vec3 coordinate, struct graphics_context *context) {
+	return context->checkerboard >= 0 &&
+		   (((int)round(coordinate.x) + (int)round(coordinate.y)) & 1) != context->checkerboard;
+}
+
+void draw_point(struct vertex p, struct fragment_shader_input shader_input, fragment_shader *fragment_shader, struct graphics_context *context) {
+	int index = fragment_index(p.coordinate, context);
+	if (index < 0) {
+		return;
+	}
+	if (checkerboard_skips(p.coordinate, context)) {
+		return; // Depth is written, color is filled in after the frame
+	}
+
+	packed_color color = p.color;
+	if (fragment_shader) {
+		COUNT_STAT(context->stats, shader_invocations);
+		shader_input.interpolated_v = p;
+		shader_input.stats = context->stats;
+		color = fragment_shader(shader_input);
+	}
+	context->pixel_buffer[index] = color;
 }
 
 int compare_vertices_x(const void *a, const void *b) {
@@ -186,12 +443,17 @@ int compare_vertices(const void *a, const void *b) {
  Calculates a rectangular bounding box for a triangle, and
  returns true if the triangle is visible within context bounds.
  */
+static bool coordinates_intersect_bounds(vec3 a, vec3 b, vec3 c, int width, int height) {
+	double top = fminf(fminf(a.y, b.y), c.y);
+	double left = fminf(fminf(a.x, b.x), c.x);
+	double bottom = fmaxf(fmaxf(a.y, b.y), c.y);
+	double right = fmaxf(fmaxf(a.x, b.x), c.x);
+	return !(right < 0 || bottom < 0 || left > width || top > height);
+}
+
 bool triangle_intersects_bounds(struct vertex vertices[3], struct graphics_context *context) {
-	double top = fminf(fminf(vertices[0].coordinate.y, vertices[1].coordinate.y), vertices[2].coordinate.y);
-	double left = fminf(fminf(vertices[0].coordinate.x, vertices[1].coordinate.x), vertices[2].coordinate.x);
-	double bottom = fmaxf(fmaxf(vertices[0].coordinate.y, vertices[1].coordinate.y), vertices[2].coordinate.y);
-	double right = fmaxf(fmaxf(vertices[0].coordinate.x, vertices[1].coordinate.x), vertices[2].coordinate.x);
-	return !(right < 0 || bottom < 0 || left > context->width || top > context->height);
+	return coordinates_intersect_bounds(vertices[0].coordinate, vertices[1].coordinate, vertices[2].coordinate,
+										context->width, context->height);
 }
 
 /**
@@ -202,7 +464,7 @@ void flat_triangle(struct vertex anchor,
 				   struct vertex left_leg,
 				   struct vertex right_leg,
 				   struct fragment_shader_input shader_input,
-				   rgb_color (*fragment_shader)(struct fragment_shader_input),
+				   fragment_shader *fragment_shader,
 				   struct graphics_context *context)
 {
 	int height = abs((int)round(anchor.coordinate.y) - (int)round(left_leg.coordinate.y));
@@ -221,21 +483,185 @@ void flat_triangle(struct vertex anchor,
 
 		for (int x = 0; x <= width; x++) {
 			double tx = (double)x / (double)width;
+			if (context->checkerboard >= 0) {
+				// Pixels that aren't shaded this frame only need their depth
+				vec3 coordinate = lerp(left_point.coordinate, right_point.coordinate, tx);
+				if (checkerboard_skips(coordinate, context)) {
+					fragment_index(coordinate, context);
+					continue;
+				}
+			}
 			struct vertex point_to_draw = vertex_lerp(left_point, right_point, tx);
 			draw_point(point_to_draw, shader_input, fragment_shader, context);
 		}
 	}
 }
 
+/**
+ Interpolates vertex attributes with barycentric weights
+ */
+static struct vertex vertex_interpolate(struct vertex vertices[3], double w0, double w1, double w2) {
+	struct vertex result;
+	result.coordinate = vec3_add(vec3_add(vec3_scale(vertices[0].coordinate, w0),
+										  vec3_scale(vertices[1].coordinate, w1)),
+								 vec3_scale(vertices[2].coordinate, w2));
+	result.normal = vec3_add(vec3_add(vec3_scale(vertices[0].normal, w0),
+									  vec3_scale(vertices[1].normal, w1)),
+							 vec3_scale(vertices[2].normal, w2));
+	result.texture_coordinate.x = vertices[0].texture_coordinate.x * w0 + vertices[1].texture_coordinate.x * w1 + vertices[2].texture_coordinate.x * w2;
+	result.texture_coordinate.y = vertices[0].texture_coordinate.y * w0 + vertices[1].texture_coordinate.y * w1 + vertices[2].texture_coordinate.y * w2;
+
+	// Fixed point weights that add up to exactly 256, so the channels can't overflow
+	uint32_t f0 = color_factor(w0);
+	uint32_t f1 = color_factor(w1);
+	f1 = f0 + f1 > 256 ? 256 - f0 : f1;
+	result.color = packed_blend3(vertices[0].color, vertices[1].color, vertices[2].color, f0, f1, 256 - f0 - f1);
+	return result;
+}
+
+struct msaa_setup {
+	vec3 a, b, c;
+	double edges[3][3];
+	int min_x, min_y, max_x, max_y;
+};
+
+/**
+ Sets up the edge functions and the pixel bounds of a triangle for
+ multisampling. Returns false if the triangle has no area.
+ */
+static bool setup_msaa_triangle(vec3 a, vec3 b, vec3 c, struct graphics_context *context, struct msaa_setup *setup) {
+	// Edge functions, normalized by the area so that they are the barycentric
+	// weights of each vertex, and positive inside regardless of winding
+	double area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0) {
+		return false;
+	}
+	setup->a = a;
+	setup->b = b;
+	setup->c = c;
+	double edges[3][3] = {
+		{(b.y - c.y) / area, (c.x - b.x) / area, (b.x * c.y - c.x * b.y) / area},
+		{(c.y - a.y) / area, (a.x - c.x) / area, (c.x * a.y - a.x * c.y) / area},
+		{(a.y - b.y) / area, (b.x - a.x) / area, (a.x * b.y - b.x * a.y) / area}
+	};
+	memcpy(setup->edges, edges, sizeof(edges));
+
+	// Pixel (x, y) covers [x - 0.5, x + 0.5), matching the rounding of the scanline rasterizer
+	int min_x = (int)ceil(fmin(fmin(a.x, b.x), c.x) - 0.5);
+	int max_x = (int)floor(fmax(fmax(a.x, b.x), c.x) + 0.5);
+	int min_y = (int)ceil(fmin(fmin(a.y, b.y), c.y) - 0.5);
+	int max_y = (int)floor(fmax(fmax(a.y, b.y), c.y) + 0.5);
+	setup->min_x = min_x < 0 ? 0 : min_x;
+	setup->min_y = min_y < 0 ? 0 : min_y;
+	setup->max_x = max_x >= context->width ? context->width - 1 : max_x;
+	setup->max_y = max_y >= context->height ? context->height - 1 : max_y;
+	return true;
+}
+
+/**
+ Returns true if a sample position is inside the triangle, and its Z-value in z
+ */
+static inline bool msaa_sample_depth(struct msaa_setup *setup, double px, double py, double *z) {
+	double w0 = setup->edges[0][0] * px + setup->edges[0][1] * py + setup->edges[0][2];
+	double w1 = setup->edges[1][0] * px + setup->edges[1][1] * py + setup->edges[1][2];
+	double w2 = setup->edges[2][0] * px + setup->edges[2][1] * py + setup->edges[2][2];
+	if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0) {
+		return false;
+	}
+	*z = w0 * setup->a.z + w1 * setup->b.z + w2 * setup->c.z;
+	return true;
+}
+
+/**
+ Rasterizes a triangle into the multisample buffer. Each pixel gets a coverage
+ mask from evaluating the edge functions at every sample position, and each
+ covered sample is depth tested on its own. The fragment shader then runs
+ once per pixel, at the centroid of the samples that passed, and its color is
+ written to those samples.
+ */
+static void msaa_triangle(struct vertex vertices[3],
+						  struct fragment_shader_input shader_input,
+						  fragment_shader *fragment_shader,
+						  struct graphics_context *context)
+{
+	struct msaa_buffer *msaa = context->msaa;
+	const double (*positions)[2] = msaa_sample_positions(msaa);
+	struct msaa_setup setup;
+	if (!setup_msaa_triangle(vertices[0].coordinate, vertices[1].coordinate, vertices[2].coordinate, context, &setup)) {
+		return;
+	}
+	double (*edges)[3] = setup.edges;
+
+	for (int y = setup.min_y; y <= setup.max_y; y++) {
+		for (int x = setup.min_x; x <= setup.max_x; x++) {
+			int covered = 0;
+			int visible = 0;
+			unsigned int mask = 0;
+			double centroid_x = 0.0;
+			double centroid_y = 0.0;
+			for (int s = 0; s < msaa->samples; s++) {
+				double px = x + positions[s][0];
+				double py = y + positions[s][1];
+				double z;
+				if (!msaa_sample_depth(&setup, px, py, &z)) {
+					continue;
+				}
+
+				covered++;
+				if (context_depth_test(context, msaa->depth, x * msaa->samples + s, y, z)) {
+					mask |= 1u << s;
+					visible++;
+					centroid_x += px;
+					centroid_y += py;
+				}
+			}
+
+			if (covered == 0) {
+				continue;
+			}
+			COUNT_STAT(context->stats, fragments_generated);
+			if (context->heatmap_buffer) {
+				context->heatmap_buffer[context->width * y + x]++;
+			}
+			if (mask == 0) {
+				COUNT_STAT(context->stats, fragments_depth_rejected);
+				continue;
+			}
+
+			// Shade once, at the centroid of the visible samples (which is always inside the triangle)
+			centroid_x /= visible;
+			centroid_y /= visible;
+			double w0 = edges[0][0] * centroid_x + edges[0][1] * centroid_y + edges[0][2];
+			double w1 = edges[1][0] * centroid_x + edges[1][1] * centroid_y + edges[1][2];
+			struct vertex point = vertex_interpolate(vertices, w0, w1, 1.0 - w0 - w1);
+
+			packed_color color = point.color;
+			if (fragment_shader) {
+				COUNT_STAT(context->stats, shader_invocations);
+				shader_input.interpolated_v = point;
+				shader_input.stats = context->stats;
+				color = fragment_shader(shader_input);
+			}
+
+			uint32_t *samples = &msaa->color[(context->width * y + x) * msaa->samples];
+			for (int s = 0; s < msaa->samples; s++) {
+				if (mask & (1u << s)) {
+					samples[s] = color;
+				}
+			}
+		}
+	}
+}
+
 /**
  Fills a goraud triangle (each vertex has a color which interpolates).
  This function sorts the points/colors and splits the triangle if needed,
  and then delegates drawing to flat_triangle.
  */
-void triangle(struct vertex vertices[3],
-			  struct fragment_shader_input shader_input,
-			  rgb_color (*fragment_shader)(struct fragment_shader_input),
-			  struct graphics_context *context)
+static void fill_triangle(struct vertex vertices[3],
+						  struct fragment_shader_input shader_input,
+						  fragment_shader *fragment_shader,
+						  struct graphics_context *context)
 {
 	// Ignore triangle if it won't be visible
 	if (!triangle_intersects_bounds(vertices, context)) {
@@ -266,7 +692,145 @@ void triangle(struct vertex vertices[3],
 		struct vertex new_point = vertex_lerp(other_vertices[0], other_vertices[1], t);
 		
 		// Call this function for each of the splitted triangles
-		triangle((struct vertex[]){new_point, split_point, other_vertices[0]}, shader_input, fragment_shader, context);
-        triangle((struct vertex[]){new_point, split_point, other_vertices[1]}, shader_input, fragment_shader, context);
-    }
+		fill_triangle((struct vertex[]){new_point, split_point, other_vertices[0]}, shader_input, fragment_shader, context);
+		fill_triangle((struct vertex[]){new_point, split_point, other_vertices[1]}, shader_input, fragment_shader, context);
+	}
+}
+
+void triangle(struct vertex vertices[3],
+			  struct fragment_shader_input shader_input,
+			  fragment_shader *fragment_shader,
+			  struct graphics_context *context)
+{
+	if (!triangle_intersects_bounds(vertices, context)) {
+		COUNT_STAT(context->stats, faces_outside_bounds);
+		return;
+	}
+
+	if (context->msaa) {
+		msaa_triangle(vertices, shader_input, fragment_shader, context);
+	} else {
+		fill_triangle(vertices, shader_input, fragment_shader, context);
+	}
+}
+
+// ********** Depth-only rasterization **********
+
+// These mirror fill_triangle(), flat_triangle() and msaa_triangle() step by
+// step on the coordinates alone, so that they cover exactly the same pixels
+// and samples with exactly the same Z-values. That's what lets a color pass
+// after a depth-only pass use DEPTH_TEST_EQUAL.
+
+static int compare_coordinates(const void *a, const void *b) {
+	const vec3 *p1 = (const vec3 *)a;
+	const vec3 *p2 = (const vec3 *)b;
+	double y1 = round(p1->y);
+	double y2 = round(p2->y);
+	if (y1 < y2) return -1;
+	if (y1 > y2) return 1;
+	double x1 = round(p1->x);
+	double x2 = round(p2->x);
+	if (x1 < x2) return -1;
+	if (x1 > x2) return 1;
+	return 0;
+}
+
+static void depth_point(vec3 p, struct depth_buffer *buffer) {
+	int x = (int)round(p.x);
+	int y = (int)round(p.y);
+	if (x < 0 || x >= buffer->width || y < 0 || y >= buffer->height) {
+		return;
+	}
+	depth_buffer_test_and_set(buffer, x, y, p.z);
+}
+
+// Points of a span are computed by the depth_span kernel this many at a time
+#define DEPTH_SPAN_CHUNK 64
+
+static void depth_span(vec3 left, vec3 right, int width, const struct cpu_kernels *kernels, struct depth_buffer *buffer) {
+	int xs[DEPTH_SPAN_CHUNK];
+	int ys[DEPTH_SPAN_CHUNK];
+	double depths[DEPTH_SPAN_CHUNK];
+	for (int first = 0; first <= width; first += DEPTH_SPAN_CHUNK) {
+		int count = width + 1 - first < DEPTH_SPAN_CHUNK ? width + 1 - first : DEPTH_SPAN_CHUNK;
+		kernels->depth_span(xs, ys, depths, left, right, width, first, count, buffer->far, buffer->scale);
+		for (int i = 0; i < count; i++) {
+			if (xs[i] >= 0 && xs[i] < buffer->width && ys[i] >= 0 && ys[i] < buffer->height) {
+				depth_buffer_test_and_set_normalized(buffer, xs[i], ys[i], depths[i]);
+			}
+		}
+	}
+}
+
+static void depth_flat_triangle(vec3 anchor, vec3 left_leg, vec3 right_leg, struct depth_buffer *buffer) {
+	const struct cpu_kernels *kernels = cpu_kernels_active();
+	int height = abs((int)round(anchor.y) - (int)round(left_leg.y));
+	depth_point(anchor, buffer);
+
+	for (int y = 1; y <= height; y++) {
+		double t = (double)y / (double)height;
+		vec3 left_point = lerp(anchor, left_leg, t);
+		vec3 right_point = lerp(anchor, right_leg, t);
+		int width = round(right_point.x) - round(left_point.x);
+		if (width > 0) {
+			depth_span(left_point, right_point, width, kernels, buffer);
+		}
+	}
+}
+
+static void depth_fill_triangle(vec3 coordinates[3], struct depth_buffer *buffer) {
+	if (!coordinates_intersect_bounds(coordinates[0], coordinates[1], coordinates[2], buffer->width, buffer->height)) {
+		return;
+	}
+
+	qsort(coordinates, 3, sizeof(vec3), &compare_coordinates);
+	if (round(coordinates[0].y) == round(coordinates[1].y)) {
+		depth_flat_triangle(coordinates[2], coordinates[0], coordinates[1], buffer);
+	} else if (round(coordinates[1].y) == round(coordinates[2].y)) {
+		depth_flat_triangle(coordinates[0], coordinates[1], coordinates[2], buffer);
+	} else {
+		vec3 split_point = coordinates[1];
+		vec3 other_coordinates[] = {coordinates[0], coordinates[2]};
+		double t = (split_point.y - other_coordinates[0].y) / (other_coordinates[1].y - other_coordinates[0].y);
+		vec3 new_point = lerp(other_coordinates[0], other_coordinates[1], t);
+		depth_fill_triangle((vec3[]){new_point, split_point, other_coordinates[0]}, buffer);
+		depth_fill_triangle((vec3[]){new_point, split_point, other_coordinates[1]}, buffer);
+	}
+}
+
+static void msaa_depth_triangle(vec3 coordinates[3], struct graphics_context *context) {
+	struct msaa_buffer *msaa = context->msaa;
+	const double (*positions)[2] = msaa_sample_positions(msaa);
+	struct msaa_setup setup;
+	if (!setup_msaa_triangle(coordinates[0], coordinates[1], coordinates[2], context, &setup)) {
+		return;
+	}
+
+	for (int y = setup.min_y; y <= setup.max_y; y++) {
+		for (int x = setup.min_x; x <= setup.max_x; x++) {
+			for (int s = 0; s < msaa->samples; s++) {
+				double z;
+				if (msaa_sample_depth(&setup, x + positions[s][0], y + positions[s][1], &z)) {
+					depth_buffer_test_and_set(msaa->depth, x * msaa->samples + s, y, z);
+				}
+			}
+		}
+	}
+}
+
+void depth_triangle(vec3 coordinates[3], struct depth_buffer *buffer) {
+	vec3 sorted[3] = {coordinates[0], coordinates[1], coordinates[2]};
+	depth_fill_triangle(sorted, buffer);
+}
+
+void triangle_depth_only(vec3 coordinates[3], struct graphics_context *context) {
+	if (!coordinates_intersect_bounds(coordinates[0], coordinates[1], coordinates[2], context->width, context->height)) {
+		return;
+	}
+
+	if (context->msaa) {
+		msaa_depth_triangle(coordinates, context);
+	} else if (context->depth_buffer) {
+		depth_triangle(coordinates, context->depth_buffer);
+	}
 }
@@ -4,27 +4,119 @@
 #include "geometry.h"
 #include "color.h"
 #include "shaders.h"
+#include "depth_buffer.h"
+#include "msaa.h"
+#include "frame_arena.h"
 #include <stdlib.h>
-#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+union SDL_Event; // The viewer's window (window.h) is the only part that uses SDL
 
 struct graphics_context {
 	int width;
 	int height;
+	int max_height; // Rows the buffers were allocated for, see context_set_height()
 	uint32_t *pixel_buffer;
-	float *depth_buffer;
-	void (*window_event_callback)(struct graphics_context *context, SDL_Event event);
+	struct depth_buffer *depth_buffer;
+	struct msaa_buffer *msaa;
+	enum depth_test depth_test;
+	struct pipeline_stats *stats;
+	uint32_t *heatmap_buffer;
+	int checkerboard; // Parity of the pixels that are shaded, -1 to shade all of them
+
+	// Memory for data that only lives until the end of a frame, reset by clear()
+	struct frame_arena *arena;
+
+	void (*window_event_callback)(struct graphics_context *context, union SDL_Event event);
 	void *_internal;
 };
 
 struct graphics_context *create_context(int width, int height);
-void context_activate_window(struct graphics_context *context);
-void context_refresh_window(struct graphics_context *context);
 void context_save_BMP(struct graphics_context *context, char file_name[]);
 void destroy_context(struct graphics_context *context);
 
+/**
+ Replaces the depth buffer with one of a different format. Contexts are
+ created with a DEPTH_FORMAT_FLOAT32 depth buffer.
+ */
+void context_set_depth_format(struct graphics_context *context, enum depth_format format);
+
+/**
+ Enables multisample anti-aliasing with 4 or 8 samples per pixel (0 disables
+ it). Triangles are then rasterized with a per-pixel coverage mask and depth
+ tested per sample, but the fragment shader still runs once per pixel.
+ The samples are averaged into pixel_buffer by context_resolve_msaa(), which
+ context_refresh_window() and context_save_BMP() call automatically.
+ */
+void context_set_msaa(struct graphics_context *context, int samples);
+void context_resolve_msaa(struct graphics_context *context);
+
+/**
+ Draws into the top rows of the buffers only, up to the height the context
+ was created with, without reallocating them. Rows below height keep
+ whatever they held.
+ */
+void context_set_height(struct graphics_context *context, int height);
+
+/**
+ Sets the depth test for everything drawn after it. To draw with no
+ overdraw, draw the depth of the scene first (triangle_depth_only, or
+ render_object_depth), then draw it again in color with DEPTH_TEST_EQUAL.
+ */
+void context_set_depth_test(struct graphics_context *context, enum depth_test test);
+
+/**
+ Checkerboard rendering: only pixels where (x + y) % 2 == parity run the
+ fragment shader. The others are still depth tested and write depth, but
+ keep their color, to be filled in afterwards (see checkerboard.h). A parity
+ of -1 shades every pixel, which is the default. Not used with MSAA.
+ */
+void context_set_checkerboard(struct graphics_context *context, int parity);
+
+/**
+ Pipeline statistics. Counters are only collected while enabled, and are
+ accumulated until reset.
+ */
+void context_enable_stats(struct graphics_context *context, bool enabled);
+void context_reset_stats(struct graphics_context *context);
+struct pipeline_stats context_get_stats(struct graphics_context *context);
+
+/**
+ Overdraw heatmap debug mode. While enabled, every fragment that lands on a
+ pixel increments a per-pixel counter, which context_save_heatmap() writes as
+ a color coded image (black = never touched, then blue -> green -> yellow ->
+ red up to the most overdrawn pixel). Counters are reset by clear().
+ */
+void context_enable_heatmap(struct graphics_context *context, bool enabled);
+void context_save_heatmap(struct graphics_context *context, char file_name[]);
+
+/**
+ Draws a line between two points, clipped to the context, on top of
+ everything that has been drawn. The depth buffer is neither tested nor
+ written, and lines aren't counted in the pipeline stats.
+ */
 void draw_line(vec2 p1, vec2 p2, struct graphics_context *context, rgb_color color);
+
+/**
+ Same as draw_line, for points after vertex shading. If depth_tested, each
+ pixel is tested against the depth buffer (without writing it), with Z pulled
+ slightly towards the camera so that the edges of triangles that have been
+ drawn stay visible.
+ */
+void draw_line_3d(vec3 p1, vec3 p2, packed_color color, bool depth_tested, struct graphics_context *context);
+
+/**
+ Starts a new frame: clears the color and depth buffers, and frees everything
+ allocated from the context's frame arena
+ */
 void clear(struct graphics_context *context, rgb_color color);
 
+/**
+ Calculates a rectangular bounding box for a triangle, and
+ returns true if the triangle is visible within context bounds.
+ */
+bool triangle_intersects_bounds(struct vertex vertices[3], struct graphics_context *context);
+
 /**
  Draws a 2D triangle. Uses the Z-value of the coordinates for Z-buffering,
  so the Z-value has no visual meaning, and is only used if the graphics
@@ -35,4 +127,18 @@ void triangle(struct vertex vertices[3],
 			  fragment_shader *fragment_shader,
 			  struct graphics_context *context);
 
+/**
+ Depth-only version of triangle(): writes the Z-values of a triangle (after
+ vertex shading) to the context's depth buffer, with nothing interpolated or
+ shaded and no color written. It covers exactly the pixels and samples that
+ triangle() would, with exactly the same Z-values. Always uses the default
+ depth test, and isn't counted in the pipeline stats.
+ */
+void triangle_depth_only(vec3 coordinates[3], struct graphics_context *context);
+
+/**
+ Same as triangle_depth_only, into any depth buffer (e.g. a shadow map)
+ */
+void depth_triangle(vec3 coordinates[3], struct depth_buffer *buffer);
+
 #endif
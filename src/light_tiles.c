@@ -0,0 +1,108 @@
+#include "light_tiles.h"
+#include "shaders.h"
+#include <stdlib.h>
+#include <math.h>
+
+struct light_tiles *create_light_tiles(int screen_width, int screen_height) {
+	struct light_tiles *tiles = calloc(1, sizeof(struct light_tiles));
+	tiles->screen_width = screen_width;
+	tiles->screen_height = screen_height;
+	tiles->width = (screen_width + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+	tiles->height = (screen_height + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+	tiles->offsets = calloc(tiles->width * tiles->height + 2, sizeof(int));
+	tiles->cursors = malloc(sizeof(int) * (tiles->width * tiles->height + 1));
+	return tiles;
+}
+
+void destroy_light_tiles(struct light_tiles *tiles) {
+	free(tiles->offsets);
+	free(tiles->indices);
+	free(tiles->cursors);
+	free(tiles->rects);
+	free(tiles);
+}
+
+/**
+ Finds the range of tiles (first x, first y, last x, last y) that a light can
+ reach, which is empty if it can't reach the screen at all. rect[4] is set if
+ it can reach past the edges of the screen.
+ */
+static void light_tile_rect(struct light_tiles *tiles, struct local_light *light, struct scene scene, int rect[5]) {
+	rect[0] = rect[1] = 1;
+	rect[2] = rect[3] = 0;
+	rect[4] = 1;
+
+	vec3 extent = {light->radius, light->radius, light->radius};
+	double screen_rect[4];
+	if (!project_view_box(vec3_subtract(light->position, extent), vec3_add(light->position, extent), scene, screen_rect)) {
+		return;
+	}
+	rect[4] = screen_rect[0] < 0.0 || screen_rect[1] < 0.0 || screen_rect[2] >= tiles->screen_width || screen_rect[3] >= tiles->screen_height;
+	if (screen_rect[2] < 0.0 || screen_rect[3] < 0.0 || screen_rect[0] >= tiles->screen_width || screen_rect[1] >= tiles->screen_height) {
+		return;
+	}
+	rect[0] = (int)fmax(screen_rect[0], 0.0) >> LIGHT_TILE_SHIFT;
+	rect[1] = (int)fmax(screen_rect[1], 0.0) >> LIGHT_TILE_SHIFT;
+	rect[2] = (int)fmin(screen_rect[2], tiles->screen_width - 1) >> LIGHT_TILE_SHIFT;
+	rect[3] = (int)fmin(screen_rect[3], tiles->screen_height - 1) >> LIGHT_TILE_SHIFT;
+}
+
+void light_tiles_build(struct light_tiles *tiles, struct scene scene) {
+	int tile_count = tiles->width * tiles->height;
+	if (tiles->rect_capacity < scene.local_light_count) {
+		tiles->rect_capacity = scene.local_light_count;
+		tiles->rects = realloc(tiles->rects, sizeof(int) * 5 * tiles->rect_capacity);
+	}
+
+	// Count the lights of each tile (and outside), then turn the counts into offsets
+	for (int t = 0; t <= tile_count + 1; t++) {
+		tiles->offsets[t] = 0;
+	}
+	for (int i = 0; i < scene.local_light_count; i++) {
+		int *rect = &tiles->rects[i * 5];
+		light_tile_rect(tiles, &scene.local_lights[i], scene, rect);
+		for (int y = rect[1]; y <= rect[3]; y++) {
+			for (int x = rect[0]; x <= rect[2]; x++) {
+				tiles->offsets[y * tiles->width + x + 1]++;
+			}
+		}
+		tiles->offsets[tile_count + 1] += rect[4];
+	}
+	for (int t = 0; t <= tile_count; t++) {
+		tiles->offsets[t + 1] += tiles->offsets[t];
+		tiles->cursors[t] = tiles->offsets[t];
+	}
+
+	int total = tiles->offsets[tile_count + 1];
+	if (tiles->index_capacity < total) {
+		tiles->index_capacity = total * 2;
+		tiles->indices = realloc(tiles->indices, sizeof(int) * tiles->index_capacity);
+	}
+
+	// Lights are added in order, so each tile lists them in scene order
+	for (int i = 0; i < scene.local_light_count; i++) {
+		int *rect = &tiles->rects[i * 5];
+		for (int y = rect[1]; y <= rect[3]; y++) {
+			for (int x = rect[0]; x <= rect[2]; x++) {
+				tiles->indices[tiles->cursors[y * tiles->width + x]++] = i;
+			}
+		}
+		if (rect[4]) {
+			tiles->indices[tiles->cursors[tile_count]++] = i;
+		}
+	}
+}
+
+double light_tiles_average(struct light_tiles *tiles) {
+	int tile_count = tiles->width * tiles->height;
+	return tile_count > 0 ? tiles->offsets[tile_count] / (double)tile_count : 0.0;
+}
+
+int light_tiles_max(struct light_tiles *tiles) {
+	int max = 0;
+	for (int t = 0; t < tiles->width * tiles->height; t++) {
+		int count = tiles->offsets[t + 1] - tiles->offsets[t];
+		max = count > max ? count : max;
+	}
+	return max;
+}
@@ -0,0 +1,68 @@
+#ifndef LIGHT_TILES_H
+#define LIGHT_TILES_H
+
+#include "scene.h"
+
+/**
+ Each tile covers LIGHT_TILE_SIZE x LIGHT_TILE_SIZE screen pixels
+ */
+#define LIGHT_TILE_SHIFT 5
+#define LIGHT_TILE_SIZE (1 << LIGHT_TILE_SHIFT)
+
+/**
+ The local lights of a scene binned into screen tiles by the screen
+ rectangle their sphere of influence projects to. Every position that a light
+ can reach is drawn inside that rectangle, so a shader only has to evaluate
+ the lights listed for the tile it is drawn in.
+
+ Positions outside the screen use one more list, of the lights that reach
+ past the edges of the screen.
+
+ The lists are stored back to back in one array, so building them every frame
+ doesn't allocate once the arrays have grown to fit.
+ */
+struct light_tiles {
+	int width;	// In tiles
+	int height;
+	int screen_width;
+	int screen_height;
+
+	int *offsets; // Start of each tile's list in indices, then the outside list and its end
+	int *indices; // Indices in scene.local_lights
+	int index_capacity;
+
+	// Scratch space for building
+	int *cursors;
+	int *rects;
+	int rect_capacity;
+};
+
+struct light_tiles *create_light_tiles(int screen_width, int screen_height);
+void destroy_light_tiles(struct light_tiles *tiles);
+
+/**
+ Bins the local lights of a scene. Has to be called again whenever the lights
+ or the view change.
+ */
+void light_tiles_build(struct light_tiles *tiles, struct scene scene);
+
+/**
+ Returns the lights that can reach a position at screen position (x, y), and
+ their count in count
+ */
+static inline const int *light_tiles_lookup(struct light_tiles *tiles, double x, double y, int *count) {
+	int tile = tiles->width * tiles->height;
+	if (x >= 0.0 && y >= 0.0 && x < tiles->screen_width && y < tiles->screen_height) {
+		tile = ((int)y >> LIGHT_TILE_SHIFT) * tiles->width + ((int)x >> LIGHT_TILE_SHIFT);
+	}
+	*count = tiles->offsets[tile + 1] - tiles->offsets[tile];
+	return tiles->indices + tiles->offsets[tile];
+}
+
+/**
+ Average and largest number of lights per tile on the screen, for statistics
+ */
+double light_tiles_average(struct light_tiles *tiles);
+int light_tiles_max(struct light_tiles *tiles);
+
+#endif
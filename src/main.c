@@ -1,7 +1,12 @@
 #include "graphics_context.h"
+#include "window.h"
 #include "geometry.h"
 #include "textures.h"
 #include "shaders.h"
+#include "object.h"
+#include "scene_graph.h"
+#include "asset_manager.h"
+#include "checkerboard.h"
 #include "scene.h"
 #include "color.h"
 #include "obj.h"
@@ -13,23 +18,29 @@
 
 typedef char * string;
 
-struct object {
-	struct model model;
-	struct texture texture;
-	struct texture normal_map;
-	transform_3d transform;
-};
-
 struct object object;
+struct mesh *mesh; // Shares the model with object, for picking and wireframes. NULL until the model is loaded
 struct scene scene;
+bool wireframe = false; // Toggled with W
+struct checkerboard *checkerboard; // Toggled with C, NULL while every pixel is shaded
+
+struct asset_manager *assets;
+struct asset *model_asset;
+struct asset *texture_asset;
+struct asset *normal_map_asset;
+Uint32 asset_event; // Pushed when an asset is ready, to redraw with it
 
 void prepare_object(string file, string texture, string normal_map);
+void on_asset_ready(struct asset *asset, void *user_data);
 void on_window_event(struct graphics_context *context, SDL_Event event);
 void render(struct graphics_context *context);
 
 int main() {
     struct graphics_context *context = create_context(800, 800);
 	context->window_event_callback = &on_window_event;
+	asset_event = SDL_RegisterEvents(1);
+	assets = create_asset_manager(0);
+	asset_manager_set_ready_callback(assets, &on_asset_ready, NULL);
 	prepare_object("model/head.obj", "model/head_vcols.bmp", "model/head_normals.bmp");
 
 	// Center camera on 0.0 and a bit back
@@ -45,25 +56,28 @@ int main() {
 
 	context_activate_window(context);
 
-	unload_model(object.model);
-	unload_texture(object.texture);
-	unload_texture(object.normal_map);
+	if (mesh) {
+		destroy_mesh(mesh);
+	}
+	if (checkerboard) {
+		destroy_checkerboard(checkerboard);
+	}
+	asset_release(assets, model_asset);
+	asset_release(assets, texture_asset);
+	asset_release(assets, normal_map_asset);
+	destroy_asset_manager(assets);
 	destroy_context(context);
 	return 0;
 }
 
+/**
+ Starts loading the model and its textures in the background. Until they are
+ ready, render() draws with placeholders.
+ */
 void prepare_object(string file, string texture, string normal_map) {
-	FILE *fp = fopen(file, "r");
-    if (!fp) {
-		fputs("Failed to open model file", stderr);
-		abort();
-    }
-
-	object.model = load_model(fp);
-	fclose(fp);
-
-	object.texture = load_texture(texture);
-	object.normal_map = load_texture(normal_map);
+	model_asset = asset_manager_load_model(assets, file);
+	texture_asset = asset_manager_load_texture(assets, texture);
+	normal_map_asset = asset_manager_load_texture(assets, normal_map);
 
 	object.transform = transform_3d_identity;
 	object.transform = transform_3d_scale(object.transform, 400.0, -400.0, -400.0); // Flip Y and Z axis to fit coordinate space
@@ -71,69 +85,41 @@ void prepare_object(string file, string texture, string normal_map) {
 	object.transform = transform_3d_translate(object.transform, 0, 300, 0);
 }
 
-void render_object(struct object object,
-				   struct scene scene,
-				   vertex_shader *vertex_shader,
-				   fragment_shader *fragment_shader,
-				   struct graphics_context *context,
-				   rgb_color *wireframe_color)
-{
-    for (int i = 0; i < object.model.num_faces; i++) {
-		struct face f = object.model.faces[i];
-
-		// Calculate the face normal which is used for back-face culling and flat shading
-		vec3 v = vec3_subtract(*f.vertices[1], *f.vertices[0]);
-		vec3 u = vec3_subtract(*f.vertices[2], *f.vertices[0]);
-		vec3 face_normal = vec3_unit(cross_product(v, u));
-		
-		// Create vertex objects that are used by shaders/drawing code
-		struct vertex vertices[3];
-		for (int v = 0; v < 3; v++) {
-			struct vertex vertex = {.coordinate = *f.vertices[v],
-									.texture_coordinate = *f.textures[v],
-									.normal = *f.normals[v]};
-
-			struct vertex_shader_input shader_input = {.vertex = vertex,
-													   .face_normal = face_normal,
-													   .model = object.transform,
-													   .scene = scene};
-			vertices[v] = vertex_shader(shader_input);
-		}
-
-		// Get the new face normal and drop triangles that are "back facing",
-		// aka back-face culling
-		v = vec3_subtract(vertices[1].coordinate, vertices[0].coordinate);
-		u = vec3_subtract(vertices[2].coordinate, vertices[0].coordinate);
-		vec3 new_face_normal = vec3_scale(vec3_unit(cross_product(u, v)), 1.0);
-		vec3 camera_direction = {0.0, 0.0, 1.0}; // Camera is always pointing "forward" after all transformations
-		double angle = dot_product_3d(new_face_normal, camera_direction);
-		if (angle < 0.0) {
-			continue; // Back-face culling
-        }
-
-		struct fragment_shader_input input;
-		input.texture = &object.texture;
-		input.normal_map = &object.normal_map;
-		input.scene = scene;
-		
-		triangle(vertices, input, fragment_shader, context);
-
-		// Wireframes
-		if (wireframe_color) {
-			vec2 p1 = {.x = vertices[0].coordinate.x, .y = vertices[0].coordinate.y};
-			vec2 p2 = {.x = vertices[1].coordinate.x, .y = vertices[1].coordinate.y};
-			vec2 p3 = {.x = vertices[2].coordinate.x, .y = vertices[2].coordinate.y};
-			draw_line(p1, p2, context, *wireframe_color);
-			draw_line(p2, p3, context, *wireframe_color);
-			draw_line(p1, p3, context, *wireframe_color);
-		}
-    }
+void on_asset_ready(struct asset *asset, void *user_data) {
+	(void)user_data;
+	if (asset_get_state(assets, asset) == ASSET_FAILED) {
+		fprintf(stderr, "Failed to load %s\n", asset_path(asset));
+	}
+	if (asset_event != (Uint32)-1) {
+		SDL_Event event = {.type = asset_event};
+		SDL_PushEvent(&event);
+	}
 }
 
 void render(struct graphics_context *context) {
+	object.model = asset_model(assets, model_asset);
+	object.texture = asset_texture(assets, texture_asset);
+	object.normal_map = asset_texture(assets, normal_map_asset);
+	if (!mesh && asset_get_state(assets, model_asset) == ASSET_READY) {
+		mesh = create_mesh(object.model, object.texture, object.normal_map);
+		mesh_build_bvh(mesh, 0);
+		mesh_build_edge_list(mesh);
+	}
+
 	rgb_color clear_color = {0, 0, 0};
+	transform_3d model_view = transform_3d_multiply(object.transform, scene.view);
+	if (checkerboard) {
+		checkerboard_begin_frame(checkerboard, context);
+	}
 	clear(context, clear_color);
-	render_object(object, scene, &goraud_shader, &apply_texture_shader, context, NULL);
+	render_object(object, scene, &goraud_shader, &apply_texture_shader, context);
+	if (checkerboard) {
+		checkerboard_end_frame(checkerboard, context, model_view, scene);
+	}
+	if (wireframe && mesh) {
+		rgb_color wireframe_color = {0, 255, 0};
+		render_wireframe(mesh->edges, mesh->model, model_view, scene, wireframe_color, true, context);
+	}
 	context_refresh_window(context);
 }
 
@@ -148,10 +134,16 @@ void on_window_event(struct graphics_context *context, SDL_Event event) {
 		}
 		break;
 	case SDL_MOUSEBUTTONDOWN:
-		if (event.button.button == 1)
+		if (event.button.button == 1) {
 			mouse1_down = true;
-		else if (event.button.button == 3)
+			struct pick_result pick;
+			transform_3d model_view = transform_3d_multiply(object.transform, scene.view);
+			if (mesh && mesh_pick(mesh, model_view, scene, event.button.x, event.button.y, &pick)) {
+				printf("Picked face %d at z = %.1f\n", pick.face, pick.z);
+			}
+		} else if (event.button.button == 3) {
 			mouse3_down = true;
+		}
 		break;
 	case SDL_MOUSEBUTTONUP:
 		if (event.button.button == 1)
@@ -169,6 +161,20 @@ void on_window_event(struct graphics_context *context, SDL_Event event) {
 			render(context);
 		}
 		break;
+	case SDL_KEYDOWN:
+		if (event.key.keysym.sym == SDLK_w) {
+			wireframe = !wireframe;
+			render(context);
+		} else if (event.key.keysym.sym == SDLK_c) {
+			if (checkerboard) {
+				destroy_checkerboard(checkerboard);
+				checkerboard = NULL;
+			} else {
+				checkerboard = create_checkerboard(context->width, context->height);
+			}
+			render(context);
+		}
+		break;
 	case SDL_MOUSEWHEEL: {
 		double delta = 1.0 - (event.wheel.y * 0.01);
 		object.transform = transform_3d_scale(object.transform, delta, delta, delta);
@@ -176,6 +182,9 @@ void on_window_event(struct graphics_context *context, SDL_Event event) {
 		break;
 	}
 	default:
+		if (event.type == asset_event) {
+			render(context);
+		}
 		break;
 	}
 }
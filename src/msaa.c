@@ -0,0 +1,40 @@
+#include "msaa.h"
+#include <stdlib.h>
+
+const double msaa_sample_positions_4x[4][2] = {
+	{-2 / 16.0, -6 / 16.0}, {6 / 16.0, -2 / 16.0}, {-6 / 16.0, 2 / 16.0}, {2 / 16.0, 6 / 16.0}
+};
+
+const double msaa_sample_positions_8x[8][2] = {
+	{1 / 16.0, -3 / 16.0}, {-1 / 16.0, 3 / 16.0}, {5 / 16.0, 1 / 16.0}, {-3 / 16.0, -5 / 16.0},
+	{-5 / 16.0, 5 / 16.0}, {-7 / 16.0, -1 / 16.0}, {3 / 16.0, 7 / 16.0}, {7 / 16.0, -7 / 16.0}
+};
+
+struct msaa_buffer *create_msaa_buffer(int width, int height, int samples, enum depth_format format) {
+	struct msaa_buffer *buffer = malloc(sizeof(struct msaa_buffer));
+	buffer->width = width;
+	buffer->height = height;
+	buffer->samples = samples;
+	buffer->color = malloc(sizeof(uint32_t) * width * height * samples);
+	buffer->depth = create_depth_buffer(width * samples, height, format);
+	return buffer;
+}
+
+void destroy_msaa_buffer(struct msaa_buffer *buffer) {
+	destroy_depth_buffer(buffer->depth);
+	free(buffer->color);
+	free(buffer);
+}
+
+const double (*msaa_sample_positions(struct msaa_buffer *buffer))[2] {
+	return buffer->samples == 8 ? msaa_sample_positions_8x : msaa_sample_positions_4x;
+}
+
+void msaa_clear(struct msaa_buffer *buffer, uint32_t rgba) {
+	depth_buffer_clear(buffer->depth);
+	packed_fill(buffer->color, rgba, buffer->width * buffer->height * buffer->samples);
+}
+
+void msaa_resolve(struct msaa_buffer *buffer, uint32_t *pixel_buffer) {
+	packed_average_samples(pixel_buffer, buffer->color, buffer->samples, buffer->width * buffer->height);
+}
@@ -0,0 +1,42 @@
+#ifndef MSAA_H
+#define MSAA_H
+
+#include "depth_buffer.h"
+#include "color.h"
+#include <inttypes.h>
+
+#define MSAA_MAX_SAMPLES 8
+
+/**
+ Multisample color and depth storage. Every pixel has `samples` color and
+ depth samples, which are stored next to each other. The depth samples live
+ in a regular depth buffer that is `samples` times wider than the image, so
+ sample s of pixel (x, y) is at (x * samples + s, y).
+ */
+struct msaa_buffer {
+	int width;
+	int height;
+	int samples;
+	uint32_t *color;
+	struct depth_buffer *depth;
+};
+
+/**
+ Sample offsets from the pixel center, in pixels (the standard 4x and 8x
+ rotated grid patterns).
+ */
+extern const double msaa_sample_positions_4x[4][2];
+extern const double msaa_sample_positions_8x[8][2];
+
+struct msaa_buffer *create_msaa_buffer(int width, int height, int samples, enum depth_format format);
+void destroy_msaa_buffer(struct msaa_buffer *buffer);
+const double (*msaa_sample_positions(struct msaa_buffer *buffer))[2];
+
+void msaa_clear(struct msaa_buffer *buffer, uint32_t rgba);
+
+/**
+ Averages the samples of every pixel into a width x height RGBA buffer.
+ */
+void msaa_resolve(struct msaa_buffer *buffer, uint32_t *pixel_buffer);
+
+#endif
@@ -0,0 +1,378 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include "multiprocess.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// Smallest part of the work a worker gets, in rows or faces
+#define MIN_BOUNDS_SIZE 1
+
+/**
+ What a worker renders in a frame: the object at transform, and rows or
+ faces start to end
+ */
+struct worker_command {
+	bool quit;
+	transform_3d transform;
+	rgb_color clear_color;
+	int start;
+	int end;
+};
+
+struct worker_reply {
+	double ms;
+};
+
+struct worker {
+	pid_t pid;
+	int socket;
+};
+
+struct multiprocess_renderer {
+	enum multiprocess_mode mode;
+	int width;
+	int height;
+	int worker_count;
+	struct worker workers[MULTIPROCESS_MAX_WORKERS];
+	bool balancing;
+	bool has_times;
+	bool failed; // A worker stopped answering, so no more frames can be rendered
+	struct multiprocess_stats stats;
+
+	// Shared with the workers. Sort-first has one frame, which every worker
+	// writes its rows of. Sort-last has a frame and depth for each worker.
+	uint32_t *colors;
+	float *depths;
+	size_t shared_size;
+
+	// Only used by the workers, which have their own copy after the fork
+	struct object object;
+	struct scene scene;
+	vertex_shader *vertex_shader;
+	fragment_shader *fragment_shader;
+};
+
+/**
+ Sends without raising SIGPIPE when the other end is gone, which would kill
+ the process instead of failing the send
+ */
+static bool write_all(int fd, const void *data, size_t size) {
+	const char *p = data;
+	while (size > 0) {
+		ssize_t written = send(fd, p, size, MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+	char *p = data;
+	while (size > 0) {
+		ssize_t received = read(fd, p, size);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		p += received;
+		size -= received;
+	}
+	return true;
+}
+
+// ********** Workers **********
+
+/**
+ Renders rows start to end of the frame, into those rows of the shared frame.
+ The view is moved up by start rows, which moves the eye along with it, so
+ the band looks exactly like that part of the whole frame. The context is
+ allocated once at full height, as balancing changes the bands every frame.
+ */
+static void render_band(struct multiprocess_renderer *renderer, struct graphics_context **context, struct worker_command command) {
+	int rows = command.end - command.start;
+	if (!*context) {
+		*context = create_context(renderer->width, renderer->height);
+	}
+	context_set_height(*context, rows);
+
+	struct scene scene = renderer->scene;
+	scene.view = transform_3d_translate(scene.view, 0.0, -command.start, 0.0);
+	struct object object = renderer->object;
+	object.transform = command.transform;
+	clear(*context, command.clear_color);
+	render_object(object, scene, renderer->vertex_shader, renderer->fragment_shader, *context);
+	memcpy(&renderer->colors[renderer->width * command.start], (*context)->pixel_buffer, sizeof(uint32_t) * renderer->width * rows);
+}
+
+/**
+ Renders faces start to end into the worker's own frame and depth
+ */
+static void render_faces(struct multiprocess_renderer *renderer, struct graphics_context **context, int index, struct worker_command command) {
+	if (!*context) {
+		*context = create_context(renderer->width, renderer->height);
+	}
+
+	struct object object = renderer->object;
+	object.transform = command.transform;
+	object.model.faces += command.start;
+	object.model.num_faces = command.end - command.start;
+	clear(*context, command.clear_color);
+	render_object(object, renderer->scene, renderer->vertex_shader, renderer->fragment_shader, *context);
+
+	size_t pixels = (size_t)renderer->width * renderer->height;
+	memcpy(&renderer->colors[pixels * index], (*context)->pixel_buffer, sizeof(uint32_t) * pixels);
+	for (int y = 0; y < renderer->height; y++) {
+		depth_buffer_get_row((*context)->depth_buffer, y, &renderer->depths[pixels * index + renderer->width * y]);
+	}
+}
+
+static void run_worker(struct multiprocess_renderer *renderer, int index, int fd) {
+	struct graphics_context *context = NULL;
+	struct worker_command command;
+	while (read_all(fd, &command, sizeof(command)) && !command.quit) {
+		double start = timing_now_ms();
+		if (renderer->mode == MULTIPROCESS_SORT_FIRST) {
+			render_band(renderer, &context, command);
+		} else {
+			render_faces(renderer, &context, index, command);
+		}
+		struct worker_reply reply = {.ms = timing_now_ms() - start};
+		if (!write_all(fd, &reply, sizeof(reply))) {
+			break;
+		}
+	}
+	if (context) {
+		destroy_context(context);
+	}
+}
+
+// ********** Renderer **********
+
+static void split_evenly(int *bounds, int count, int total) {
+	for (int i = 0; i <= count; i++) {
+		bounds[i] = (int)((long)total * i / count);
+	}
+}
+
+/**
+ Moves the bounds between workers so that, if each worker's time was spread
+ evenly over its part, every worker would have taken the same time. Bounds
+ move halfway there each frame, so that they settle instead of swinging
+ back and forth.
+ */
+static void balance_bounds(int *bounds, int count, const double *times) {
+	double total_time = 0.0;
+	for (int i = 0; i < count; i++) {
+		total_time += times[i];
+	}
+	if (total_time <= 0.0) {
+		return;
+	}
+
+	int total = bounds[count];
+	int balanced[MULTIPROCESS_MAX_WORKERS + 1];
+	balanced[0] = 0;
+	balanced[count] = total;
+	int part = 0;
+	double time_before = 0.0;
+	for (int k = 1; k < count; k++) {
+		double target = total_time * k / count;
+		while (part < count - 1 && time_before + times[part] < target) {
+			time_before += times[part];
+			part++;
+		}
+		double fraction = times[part] > 0.0 ? (target - time_before) / times[part] : 0.5;
+		fraction = fmin(fmax(fraction, 0.0), 1.0);
+		double position = bounds[part] + fraction * (bounds[part + 1] - bounds[part]);
+		balanced[k] = (int)round((bounds[k] + position) / 2.0);
+	}
+
+	for (int k = 1; k < count; k++) {
+		int low = balanced[k - 1] + MIN_BOUNDS_SIZE;
+		int high = total - (count - k) * MIN_BOUNDS_SIZE;
+		balanced[k] = balanced[k] < low ? low : (balanced[k] > high ? high : balanced[k]);
+	}
+	memcpy(bounds, balanced, sizeof(int) * (count + 1));
+}
+
+static void stop_workers(struct multiprocess_renderer *renderer, int count) {
+	struct worker_command command = {.quit = true};
+	for (int i = 0; i < count; i++) {
+		write_all(renderer->workers[i].socket, &command, sizeof(command));
+		close(renderer->workers[i].socket);
+	}
+	for (int i = 0; i < count; i++) {
+		waitpid(renderer->workers[i].pid, NULL, 0);
+	}
+}
+
+struct multiprocess_renderer *create_multiprocess_renderer(int workers,
+														   enum multiprocess_mode mode,
+														   int width,
+														   int height,
+														   struct object object,
+														   struct scene scene,
+														   vertex_shader *vertex_shader,
+														   fragment_shader *fragment_shader)
+{
+	int total = mode == MULTIPROCESS_SORT_FIRST ? height : object.model.num_faces;
+	if (workers < 1 || workers > MULTIPROCESS_MAX_WORKERS || total < workers * MIN_BOUNDS_SIZE) {
+		return NULL;
+	}
+
+	struct multiprocess_renderer *renderer = calloc(1, sizeof(struct multiprocess_renderer));
+	renderer->mode = mode;
+	renderer->width = width;
+	renderer->height = height;
+	renderer->worker_count = workers;
+	renderer->balancing = true;
+	renderer->object = object;
+	renderer->scene = scene;
+	renderer->scene.light_tiles = NULL;
+	renderer->vertex_shader = vertex_shader;
+	renderer->fragment_shader = fragment_shader;
+	renderer->stats.workers = workers;
+	split_evenly(renderer->stats.bounds, workers, total);
+
+	size_t pixels = (size_t)width * height;
+	size_t frames = mode == MULTIPROCESS_SORT_FIRST ? 1 : workers;
+	size_t color_size = sizeof(uint32_t) * pixels * frames;
+	renderer->shared_size = color_size + (mode == MULTIPROCESS_SORT_LAST ? sizeof(float) * pixels * frames : 0);
+	void *shared = mmap(NULL, renderer->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		free(renderer);
+		return NULL;
+	}
+	renderer->colors = shared;
+	renderer->depths = mode == MULTIPROCESS_SORT_LAST ? (float *)((char *)shared + color_size) : NULL;
+
+	for (int i = 0; i < workers; i++) {
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+			stop_workers(renderer, i);
+			munmap(shared, renderer->shared_size);
+			free(renderer);
+			return NULL;
+		}
+		fflush(NULL); // Or buffered output would be written by both processes
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Only the worker's own socket stays open, so that it sees the
+			// renderer going away as the end of its socket
+			close(sockets[0]);
+			for (int j = 0; j < i; j++) {
+				close(renderer->workers[j].socket);
+			}
+			run_worker(renderer, i, sockets[1]);
+			_exit(0);
+		}
+		close(sockets[1]);
+		if (pid < 0) {
+			close(sockets[0]);
+			stop_workers(renderer, i);
+			munmap(shared, renderer->shared_size);
+			free(renderer);
+			return NULL;
+		}
+		renderer->workers[i] = (struct worker){.pid = pid, .socket = sockets[0]};
+	}
+	return renderer;
+}
+
+void destroy_multiprocess_renderer(struct multiprocess_renderer *renderer) {
+	stop_workers(renderer, renderer->worker_count);
+	munmap(renderer->colors, renderer->shared_size);
+	free(renderer);
+}
+
+void multiprocess_set_balancing(struct multiprocess_renderer *renderer, bool enabled) {
+	renderer->balancing = enabled;
+	if (!enabled) {
+		int count = renderer->worker_count;
+		split_evenly(renderer->stats.bounds, count, renderer->stats.bounds[count]);
+	}
+}
+
+struct multiprocess_stats multiprocess_get_stats(struct multiprocess_renderer *renderer) {
+	return renderer->stats;
+}
+
+/**
+ Takes every pixel from the worker with the closest depth. On equal depths
+ the later worker wins, as the later face would in a single context.
+ */
+static void composite_depth(struct multiprocess_renderer *renderer, uint32_t *pixel_buffer) {
+	size_t pixels = (size_t)renderer->width * renderer->height;
+	for (size_t p = 0; p < pixels; p++) {
+		float z = renderer->depths[p];
+		uint32_t color = renderer->colors[p];
+		for (int w = 1; w < renderer->worker_count; w++) {
+			float other = renderer->depths[pixels * w + p];
+			if (other <= z) {
+				z = other;
+				color = renderer->colors[pixels * w + p];
+			}
+		}
+		pixel_buffer[p] = color;
+	}
+}
+
+bool multiprocess_render(struct multiprocess_renderer *renderer,
+						 transform_3d transform,
+						 rgb_color clear_color,
+						 struct graphics_context *context)
+{
+	if (renderer->failed) {
+		return false;
+	}
+	int count = renderer->worker_count;
+	int *bounds = renderer->stats.bounds;
+	if (renderer->balancing && renderer->has_times) {
+		balance_bounds(bounds, count, renderer->stats.worker_ms);
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct worker_command command = {.transform = transform, .clear_color = clear_color, .start = bounds[i], .end = bounds[i + 1]};
+		if (!write_all(renderer->workers[i].socket, &command, sizeof(command))) {
+			renderer->failed = true;
+		}
+	}
+	// Every worker that got its command is waited for, so none is still
+	// writing into the shared frame when this returns
+	for (int i = 0; i < count; i++) {
+		struct worker_reply reply = {0};
+		if (!read_all(renderer->workers[i].socket, &reply, sizeof(reply))) {
+			renderer->failed = true;
+		}
+		renderer->stats.worker_ms[i] = reply.ms;
+	}
+	if (renderer->failed) {
+		return false;
+	}
+	renderer->has_times = true;
+
+	double start = timing_now_ms();
+	if (renderer->mode == MULTIPROCESS_SORT_FIRST) {
+		memcpy(context->pixel_buffer, renderer->colors, sizeof(uint32_t) * renderer->width * renderer->height);
+	} else {
+		composite_depth(renderer, context->pixel_buffer);
+	}
+	renderer->stats.composite_ms = timing_now_ms() - start;
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef MULTIPROCESS_H
+#define MULTIPROCESS_H
+
+#include "graphics_context.h"
+#include "object.h"
+#include "shaders.h"
+#include "scene.h"
+#include <stdbool.h>
+
+/**
+ Renders an object with several worker processes.
+
+ Sort-first splits the frame into bands of rows. Every worker renders the
+ whole object into its band, and the bands are put together into the frame.
+ Sort-last splits the object's faces. Every worker renders its faces into a
+ whole frame with depth, and each pixel is taken from the worker with the
+ closest depth.
+
+ The workers are forked when the renderer is created, so they share the
+ object, scene and shaders as they were then (light tiles are not used).
+ Each frame only sends them the object's transform and their part of the
+ work, over a socket. They write their pixels into shared memory.
+
+ With balancing, each frame's split comes from the time every worker took
+ for the previous frame, so that they would have taken equally long.
+
+ Sort-first moves the vertices of each band, so a few pixels along the band
+ edges can round differently than in a single context. Sort-last gives the
+ same image.
+ */
+#define MULTIPROCESS_MAX_WORKERS 16
+
+enum multiprocess_mode {
+	MULTIPROCESS_SORT_FIRST,
+	MULTIPROCESS_SORT_LAST
+};
+
+struct multiprocess_stats {
+	int workers;
+	double worker_ms[MULTIPROCESS_MAX_WORKERS]; // Time each worker spent on the last frame
+	int bounds[MULTIPROCESS_MAX_WORKERS + 1];   // Rows (sort-first) or faces (sort-last) of each worker in the last frame
+	double composite_ms; // Time spent putting the last frame together
+};
+
+struct multiprocess_renderer;
+
+/**
+ Starts the workers, for frames of width x height. Returns NULL if the
+ processes or the shared memory can't be created.
+ */
+struct multiprocess_renderer *create_multiprocess_renderer(int workers,
+														   enum multiprocess_mode mode,
+														   int width,
+														   int height,
+														   struct object object,
+														   struct scene scene,
+														   vertex_shader *vertex_shader,
+														   fragment_shader *fragment_shader);
+
+/**
+ Stops the workers and waits for them to exit
+ */
+void destroy_multiprocess_renderer(struct multiprocess_renderer *renderer);
+
+/**
+ Balancing is on by default. Without it, every worker gets an equal split.
+ */
+void multiprocess_set_balancing(struct multiprocess_renderer *renderer, bool enabled);
+
+/**
+ Renders a frame with the object at transform into the pixel_buffer of a
+ context of the renderer's size. Returns false, and leaves the pixel_buffer
+ as it was, if a worker has died. The renderer can't render after that and
+ should be destroyed.
+ */
+bool multiprocess_render(struct multiprocess_renderer *renderer,
+						 transform_3d transform,
+						 rgb_color clear_color,
+						 struct graphics_context *context);
+
+struct multiprocess_stats multiprocess_get_stats(struct multiprocess_renderer *renderer);
+
+#endif
@@ -0,0 +1,125 @@
+#include "object.h"
+
+/**
+ The face normal, which is used for flat shading
+ */
+static vec3 face_normal(struct face f) {
+	vec3 v = vec3_subtract(*f.vertices[1], *f.vertices[0]);
+	vec3 u = vec3_subtract(*f.vertices[2], *f.vertices[0]);
+	return vec3_unit(cross_product(v, u));
+}
+
+void shade_face(struct object *object,
+				struct scene scene,
+				vertex_shader *vertex_shader,
+				int face_index,
+				struct vertex vertices[3])
+{
+	struct face f = object->model.faces[face_index];
+	transform_3d model_view = transform_3d_multiply(object->transform, scene.view);
+	shade_face_corners(f, face_normal(f), object->transform, model_view, scene, vertex_shader, NULL, vertices);
+}
+
+void shade_face_corners(struct face f,
+						vec3 face_normal,
+						transform_3d model,
+						transform_3d model_view,
+						struct scene scene,
+						vertex_shader *vertex_shader,
+						const vec3 view_positions[3],
+						struct vertex vertices[3])
+{
+	// Create vertex objects that are used by shaders/drawing code
+	for (int i = 0; i < 3; i++) {
+		struct vertex vertex = {.coordinate = *f.vertices[i],
+								.texture_coordinate = *f.textures[i],
+								.normal = *f.normals[i]};
+
+		struct vertex_shader_input shader_input = {.vertex = vertex,
+												   .face_normal = face_normal,
+												   .model = model,
+												   .model_view = model_view,
+												   .view_position = view_positions ? &view_positions[i] : NULL,
+												   .scene = scene};
+		vertices[i] = vertex_shader(shader_input);
+	}
+}
+
+bool face_is_front_facing(struct vertex vertices[3]) {
+	vec3 coordinates[3] = {vertices[0].coordinate, vertices[1].coordinate, vertices[2].coordinate};
+	return coordinates_are_front_facing(coordinates);
+}
+
+bool coordinates_are_front_facing(vec3 coordinates[3]) {
+	// Get the new face normal and drop triangles that are "back facing",
+	// aka back-face culling
+	vec3 v = vec3_subtract(coordinates[1], coordinates[0]);
+	vec3 u = vec3_subtract(coordinates[2], coordinates[0]);
+	vec3 face_normal = vec3_unit(cross_product(u, v));
+	vec3 camera_direction = {0.0, 0.0, 1.0}; // Camera is always pointing "forward" after all transformations
+	double angle = dot_product_3d(face_normal, camera_direction);
+	return !(angle < 0.0);
+}
+
+void render_object(struct object object,
+				   struct scene scene,
+				   vertex_shader *vertex_shader,
+				   fragment_shader *fragment_shader,
+				   struct graphics_context *context)
+{
+	struct fragment_shader_input input;
+	input.texture = &object.texture;
+	input.normal_map = &object.normal_map;
+	input.scene = scene;
+	input.stats = context->stats;
+
+	// Every vertex is transformed once, in a batch, instead of by the vertex
+	// shader once for each face using it
+	struct model model = object.model;
+	transform_3d model_view = transform_3d_multiply(object.transform, scene.view);
+	vec3 *view_positions = frame_arena_alloc(context->arena, sizeof(vec3) * model.num_vertices);
+	transform_positions(model.vertices, view_positions, model.num_vertices, model_view);
+
+	for (int i = 0; i < model.num_faces; i++) {
+		struct face f = model.faces[i];
+		vec3 corners[3];
+		for (int c = 0; c < 3; c++) {
+			corners[c] = view_positions[f.vertices[c] - model.vertices];
+		}
+		struct vertex vertices[3];
+		shade_face_corners(f, face_normal(f), object.transform, model_view, scene, vertex_shader, corners, vertices);
+		COUNT_STAT(context->stats, faces_submitted);
+
+		if (!face_is_front_facing(vertices)) {
+			COUNT_STAT(context->stats, faces_back_face_culled);
+			continue; // Back-face culling
+		}
+
+		triangle(vertices, input, fragment_shader, context);
+	}
+}
+
+void project_face(struct face f, transform_3d model_view, struct scene scene, vec3 coordinates[3]) {
+	for (int i = 0; i < 3; i++) {
+		coordinates[i] = project_position(*f.vertices[i], model_view, scene);
+	}
+}
+
+void render_object_depth(struct object object, struct scene scene, struct graphics_context *context) {
+	// Every vertex is projected once, instead of once for each face using it
+	struct model model = object.model;
+	transform_3d model_view = transform_3d_multiply(object.transform, scene.view);
+	vec3 *projected = frame_arena_alloc(context->arena, sizeof(vec3) * model.num_vertices);
+	project_positions(model.vertices, projected, model.num_vertices, model_view, scene);
+
+	for (int i = 0; i < model.num_faces; i++) {
+		struct face f = model.faces[i];
+		vec3 coordinates[3];
+		for (int c = 0; c < 3; c++) {
+			coordinates[c] = projected[f.vertices[c] - model.vertices];
+		}
+		if (coordinates_are_front_facing(coordinates)) {
+			triangle_depth_only(coordinates, context);
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "graphics_context.h"
+#include "textures.h"
+#include "shaders.h"
+#include "scene.h"
+#include "obj.h"
+#include <stdbool.h>
+
+struct object {
+	struct model model;
+	struct texture texture;
+	struct texture normal_map;
+	transform_3d transform;
+};
+
+/**
+ Runs the vertex shader for the three corners of a face. This is the
+ vertex stage of render_object, exposed so it can be measured on its own.
+ */
+void shade_face(struct object *object,
+				struct scene scene,
+				vertex_shader *vertex_shader,
+				int face_index,
+				struct vertex vertices[3]);
+
+/**
+ Same as shade_face, for callers that already have the face normal and the
+ model-view transform (e.g. instances of a mesh with precomputed normals).
+ view_positions are the corners transformed by model_view, or NULL to let
+ the vertex shader transform them.
+ */
+void shade_face_corners(struct face f,
+						vec3 face_normal,
+						transform_3d model,
+						transform_3d model_view,
+						struct scene scene,
+						vertex_shader *vertex_shader,
+						const vec3 view_positions[3],
+						struct vertex vertices[3]);
+
+/**
+ Returns true if a face (after vertex shading) is facing the camera.
+ */
+bool face_is_front_facing(struct vertex vertices[3]);
+bool coordinates_are_front_facing(vec3 coordinates[3]);
+
+/**
+ Projects the corners of a face to the screen without shading them, giving
+ the same coordinates as goraud_shader and flat_shader.
+ */
+void project_face(struct face f, transform_3d model_view, struct scene scene, vec3 coordinates[3]);
+
+/**
+ Draws every front face of an object. For a wireframe overlay, draw the
+ model's edge list with render_wireframe() (wireframe.h) afterwards, which
+ draws each edge once instead of the three edges of every face.
+ */
+void render_object(struct object object,
+				   struct scene scene,
+				   vertex_shader *vertex_shader,
+				   fragment_shader *fragment_shader,
+				   struct graphics_context *context);
+
+/**
+ Depth-only version of render_object: draws the depth of every front face,
+ and nothing else. Rendering the same object with render_object afterwards,
+ with DEPTH_TEST_EQUAL, shades each visible pixel once (z-prepass). Only
+ valid for the built-in vertex shaders, which don't move vertices around.
+ */
+void render_object_depth(struct object object, struct scene scene, struct graphics_context *context);
+
+#endif
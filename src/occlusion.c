@@ -0,0 +1,255 @@
+#include "occlusion.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Keeps rounding to float from moving an occluder in front of what it covers
+#define DEPTH_BIAS 0.01f
+
+/**
+ An edge function e(u, v) = a * u + b * v + c, positive inside the triangle.
+ reach is how far e can change from a pixel center to its farthest sample.
+ */
+struct edge {
+	double a;
+	double b;
+	double c;
+	double reach;
+};
+
+static struct edge make_edge(double px, double py, double qx, double qy, double sign) {
+	struct edge e;
+	e.a = -(qy - py) * sign;
+	e.b = (qx - px) * sign;
+	e.c = ((qy - py) * px - (qx - px) * py) * sign;
+	e.reach = 0.375 * (fabs(e.a) + fabs(e.b));
+	return e;
+}
+
+struct occlusion_buffer *create_occlusion_buffer(int screen_width, int screen_height) {
+	struct occlusion_buffer *buffer = malloc(sizeof(struct occlusion_buffer));
+	buffer->screen_width = screen_width;
+	buffer->screen_height = screen_height;
+	buffer->width = (screen_width + OCCLUSION_SCALE - 1) >> OCCLUSION_SHIFT;
+	buffer->height = (screen_height + OCCLUSION_SCALE - 1) >> OCCLUSION_SHIFT;
+	buffer->stride = (buffer->width + 3) & ~3;
+	int size = buffer->stride * buffer->height;
+	buffer->depth = malloc(sizeof(float) * size);
+	buffer->partial = malloc(sizeof(float) * size);
+	buffer->coverage = malloc(sizeof(uint16_t) * size);
+	occlusion_buffer_clear(buffer);
+	return buffer;
+}
+
+void destroy_occlusion_buffer(struct occlusion_buffer *buffer) {
+	free(buffer->depth);
+	free(buffer->partial);
+	free(buffer->coverage);
+	free(buffer);
+}
+
+void occlusion_buffer_clear(struct occlusion_buffer *buffer) {
+	int size = buffer->stride * buffer->height;
+	for (int i = 0; i < size; i++) {
+		buffer->depth[i] = INFINITY;
+		buffer->partial[i] = -INFINITY;
+		buffer->coverage[i] = 0;
+	}
+
+	// Samples outside the screen can't show anything, so they start out covered
+	int columns = buffer->screen_width - ((buffer->width - 1) << OCCLUSION_SHIFT);
+	int rows = buffer->screen_height - ((buffer->height - 1) << OCCLUSION_SHIFT);
+	uint16_t column_mask = 0;
+	uint16_t row_mask = 0;
+	for (int s = 0; s < OCCLUSION_SCALE; s++) {
+		for (int k = 0; k < OCCLUSION_SCALE; k++) {
+			if (k >= columns) column_mask |= 1 << (s * OCCLUSION_SCALE + k);
+			if (s >= rows) row_mask |= 1 << (s * OCCLUSION_SCALE + k);
+		}
+	}
+	for (int y = 0; y < buffer->height; y++) {
+		buffer->coverage[y * buffer->stride + buffer->width - 1] |= column_mask;
+	}
+	for (int x = 0; x < buffer->width; x++) {
+		buffer->coverage[(buffer->height - 1) * buffer->stride + x] |= row_mask;
+	}
+}
+
+/**
+ Adds the samples of a pixel that are inside a triangle to its coverage. The
+ pixel gets a depth once all of its samples are covered.
+ */
+static void cover_partial(struct occlusion_buffer *buffer, int index, double u, double v, const struct edge edges[3], float z) {
+	if (buffer->depth[index] != INFINITY) {
+		return; // Already fully covered by nearer occluders
+	}
+
+	uint16_t mask = 0;
+	for (int s = 0; s < OCCLUSION_SCALE; s++) {
+		double sv = v + (s - 1.5) / OCCLUSION_SCALE;
+		for (int k = 0; k < OCCLUSION_SCALE; k++) {
+			double su = u + (k - 1.5) / OCCLUSION_SCALE;
+			bool inside = true;
+			for (int e = 0; e < 3; e++) {
+				inside = inside && edges[e].a * su + edges[e].b * sv + edges[e].c >= 0.0;
+			}
+			mask |= inside ? 1 << (s * OCCLUSION_SCALE + k) : 0;
+		}
+	}
+	if (!mask) {
+		return;
+	}
+
+	buffer->coverage[index] |= mask;
+	buffer->partial[index] = fmaxf(buffer->partial[index], z);
+	if (buffer->coverage[index] == OCCLUSION_FULL_MASK) {
+		buffer->depth[index] = buffer->partial[index];
+	}
+}
+
+void occlusion_buffer_draw_triangle(struct occlusion_buffer *buffer, vec3 a, vec3 b, vec3 c) {
+	// To occlusion pixel coordinates, where pixel x covers [x, x + 1)
+	double ax = (a.x + 0.5) / OCCLUSION_SCALE, ay = (a.y + 0.5) / OCCLUSION_SCALE;
+	double bx = (b.x + 0.5) / OCCLUSION_SCALE, by = (b.y + 0.5) / OCCLUSION_SCALE;
+	double cx = (c.x + 0.5) / OCCLUSION_SCALE, cy = (c.y + 0.5) / OCCLUSION_SCALE;
+	double area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+	if (!(fabs(area) > 1e-12)) {
+		return; // Degenerate, or not finite
+	}
+
+	double sign = area > 0.0 ? 1.0 : -1.0;
+	struct edge edges[3] = {make_edge(ax, ay, bx, by, sign), make_edge(bx, by, cx, cy, sign), make_edge(cx, cy, ax, ay, sign)};
+
+	// Z is linear in screen space. A pixel gets the farthest Z-value of its
+	// samples, which is never farther than the farthest vertex.
+	double zu = ((b.z - a.z) * (cy - ay) - (c.z - a.z) * (by - ay)) / area;
+	double zv = ((c.z - a.z) * (bx - ax) - (b.z - a.z) * (cx - ax)) / area;
+	double z0 = a.z - zu * ax - zv * ay;
+	double z_reach = 0.375 * (fabs(zu) + fabs(zv));
+	float z_max = (float)fmax(fmax(a.z, b.z), c.z) + DEPTH_BIAS;
+
+	int x0 = (int)fmax(floor(fmin(fmin(ax, bx), cx)), 0);
+	int y0 = (int)fmax(floor(fmin(fmin(ay, by), cy)), 0);
+	int x1 = (int)fmin(floor(fmax(fmax(ax, bx), cx)), buffer->width - 1);
+	int y1 = (int)fmin(floor(fmax(fmax(ay, by), cy)), buffer->height - 1);
+	if (x0 > x1 || y0 > y1) {
+		return;
+	}
+
+#if defined(__SSE2__)
+	const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 step[3], reach[3];
+	for (int e = 0; e < 3; e++) {
+		step[e] = _mm_set1_ps((float)edges[e].a);
+		reach[e] = _mm_set1_ps((float)edges[e].reach);
+	}
+	const __m128 z_step = _mm_set1_ps((float)zu);
+	const __m128 z_offset = _mm_set1_ps((float)z_reach + DEPTH_BIAS);
+	const __m128 z_limit = _mm_set1_ps(z_max);
+	const __m128 zero = _mm_setzero_ps();
+#endif
+
+	for (int y = y0; y <= y1; y++) {
+		double v = y + 0.5;
+		float *depth = buffer->depth + y * buffer->stride;
+		int x = x0;
+
+#if defined(__SSE2__)
+		// Four pixels at a time: pixels completely inside the triangle are
+		// written here, and the few along its edges are finished one by one
+		for (x = x0 & ~3; x <= x1; x += 4) {
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			__m128 outside = _mm_setzero_ps();
+			for (int e = 0; e < 3; e++) {
+				__m128 start = _mm_set1_ps((float)(edges[e].a * x + edges[e].b * v + edges[e].c));
+				__m128 value = _mm_add_ps(start, _mm_mul_ps(step[e], lanes));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(value, reach[e]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(value, _mm_sub_ps(zero, reach[e])));
+			}
+			int inside_mask = _mm_movemask_ps(inside);
+			int partial_mask = ~(inside_mask | _mm_movemask_ps(outside)) & 0xf;
+			if (!inside_mask && !partial_mask) {
+				continue;
+			}
+
+			__m128 z = _mm_add_ps(_mm_set1_ps((float)(zu * x + zv * v + z0)), _mm_mul_ps(z_step, lanes));
+			z = _mm_min_ps(_mm_add_ps(z, z_offset), z_limit);
+			if (inside_mask) {
+				__m128 stored = _mm_loadu_ps(depth + x);
+				__m128 nearest = _mm_min_ps(stored, z);
+				_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+			if (partial_mask) {
+				float values[4];
+				_mm_storeu_ps(values, z);
+				for (int lane = 0; lane < 4; lane++) {
+					if (partial_mask & (1 << lane)) {
+						cover_partial(buffer, y * buffer->stride + x + lane, x + lane + 0.5, v, edges, values[lane]);
+					}
+				}
+			}
+		}
+#else
+		for (; x <= x1; x++) {
+			double u = x + 0.5;
+			bool inside = true;
+			bool outside = false;
+			for (int e = 0; e < 3; e++) {
+				float value = (float)(edges[e].a * u + edges[e].b * v + edges[e].c);
+				inside = inside && value >= (float)edges[e].reach;
+				outside = outside || value < -(float)edges[e].reach;
+			}
+			if (outside) {
+				continue;
+			}
+
+			float z = fminf((float)(zu * u + zv * v + z0) + (float)z_reach + DEPTH_BIAS, z_max);
+			if (inside) {
+				depth[x] = fminf(depth[x], z);
+			} else {
+				cover_partial(buffer, y * buffer->stride + x, u, v, edges, z);
+			}
+		}
+#endif
+	}
+}
+
+bool occlusion_buffer_test(struct occlusion_buffer *buffer, double rect[4], double z) {
+	// Every screen pixel the rectangle can touch, rounded outwards by a pixel
+	// since the rasterizer rounds vertex positions
+	double left = fmax(floor(rect[0]) - 1.0, 0.0);
+	double top = fmax(floor(rect[1]) - 1.0, 0.0);
+	double right = fmin(ceil(rect[2]) + 1.0, buffer->screen_width - 1.0);
+	double bottom = fmin(ceil(rect[3]) + 1.0, buffer->screen_height - 1.0);
+	if (left > right || top > bottom) {
+		return false;
+	}
+	int x0 = (int)left >> OCCLUSION_SHIFT;
+	int y0 = (int)top >> OCCLUSION_SHIFT;
+	int x1 = (int)right >> OCCLUSION_SHIFT;
+	int y1 = (int)bottom >> OCCLUSION_SHIFT;
+
+	// Visible as soon as one pixel isn't covered by something nearer
+	float nearest = (float)z;
+	for (int y = y0; y <= y1; y++) {
+		float *depth = buffer->depth + y * buffer->stride;
+		int x = x0;
+#if defined(__SSE2__)
+		__m128 limit = _mm_set1_ps(nearest);
+		for (; x + 3 <= x1; x += 4) {
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(depth + x), limit))) {
+				return true;
+			}
+		}
+#endif
+		for (; x <= x1; x++) {
+			if (depth[x] >= nearest) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
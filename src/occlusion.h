@@ -0,0 +1,55 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "geometry.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/**
+ Each occlusion pixel covers OCCLUSION_SCALE x OCCLUSION_SCALE screen pixels
+ */
+#define OCCLUSION_SHIFT 2
+#define OCCLUSION_SCALE (1 << OCCLUSION_SHIFT)
+#define OCCLUSION_FULL_MASK 0xffff
+
+/**
+ A small depth-only buffer for occlusion culling. Occluders are rasterized
+ into it, and bounding boxes are tested against it before anything inside
+ them is drawn.
+
+ A pixel only gets a depth once every screen pixel center in it is covered
+ by occluders, and then stores the farthest Z-value of those occluders. An
+ object whose nearest Z-value is behind that depth in every pixel it touches
+ is hidden at every screen pixel too, so culling never removes anything that
+ would have been visible. Until a pixel is fully covered, the coverage of
+ its screen pixels is collected in a bit mask.
+ */
+struct occlusion_buffer {
+	int width;
+	int height;
+	int stride; // Row length in pixels, padded for the SIMD loops
+	int screen_width;
+	int screen_height;
+
+	float *depth;		// INFINITY until the pixel is fully covered
+	float *partial;		// Farthest Z-value of the occluders that partly cover a pixel
+	uint16_t *coverage; // One bit per screen pixel, row by row
+};
+
+struct occlusion_buffer *create_occlusion_buffer(int screen_width, int screen_height);
+void destroy_occlusion_buffer(struct occlusion_buffer *buffer);
+void occlusion_buffer_clear(struct occlusion_buffer *buffer);
+
+/**
+ Rasterizes an occluder triangle, in screen coordinates after perspective.
+ Both windings are drawn, so back faces must be dropped by the caller.
+ */
+void occlusion_buffer_draw_triangle(struct occlusion_buffer *buffer, vec3 a, vec3 b, vec3 c);
+
+/**
+ Returns true if anything in the screen rectangle (min x, min y, max x, max y)
+ at Z-value z or farther can be visible.
+ */
+bool occlusion_buffer_test(struct occlusion_buffer *buffer, double rect[4], double z);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+/**
+ Counters for the work done by the pipeline. Counting is enabled per graphics
+ context with context_enable_stats(). When disabled the stats pointer is NULL,
+ and each counter costs a single predictable branch.
+ */
+struct pipeline_stats {
+	long instances_submitted;
+	long instances_culled;
+	long instances_occluded;
+	long faces_submitted;
+	long faces_back_face_culled;
+	long faces_outside_bounds;
+	long fragments_generated;
+	long fragments_depth_rejected;
+	long shader_invocations;
+	long texture_samples;
+};
+
+#define COUNT_STAT(STATS, FIELD) do { if (STATS) (STATS)->FIELD++; } while (0)
+
+#endif
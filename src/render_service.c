@@ -0,0 +1,413 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "render_service.h"
+#include "asset_manager.h"
+#include "graphics_context.h"
+#include "object.h"
+#include "shaders.h"
+#include "scene.h"
+#include "bmp.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define RENDER_JOB_MAX_SIZE 8192
+#define CHECKERBOARD_TEXTURE_SIZE 256
+#define CHECKERBOARD_TEXTURE_SQUARES 8
+
+/**
+ A model or texture that stays loaded for the lifetime of the service.
+ Models also keep their bounds, to frame them without going over every
+ vertex again.
+ */
+struct cached_file {
+	char *path;
+	bool is_model;
+	struct asset *asset;
+	bool has_bounds;
+	vec3 center;
+	double extent;
+};
+
+struct cached_context {
+	struct graphics_context *context;
+	long last_used;
+};
+
+struct render_service {
+	struct asset_manager *assets;
+	struct cached_file *files;
+	int file_count;
+	int file_capacity;
+	struct cached_context *contexts;
+	int context_count;
+	int max_contexts;
+	long clock;
+	struct texture checkerboard;
+	struct render_service_stats stats;
+};
+
+// The lights the viewer starts with
+static struct directional_light service_lights[] = {
+	{.intensity = {200, 200, 200}, .direction = {0.0, 0.0, 1.0}},
+	{.intensity = {100, 140, 100}, .direction = {0.0, 1.0, 0.0}}
+};
+
+struct render_service *create_render_service(int loader_threads, int max_contexts) {
+	struct render_service *service = calloc(1, sizeof(struct render_service));
+	service->assets = create_asset_manager(loader_threads);
+	service->max_contexts = max_contexts > 0 ? max_contexts : 1;
+	service->contexts = malloc(sizeof(struct cached_context) * service->max_contexts);
+	service->checkerboard = create_checkerboard_texture(CHECKERBOARD_TEXTURE_SIZE, CHECKERBOARD_TEXTURE_SQUARES);
+	return service;
+}
+
+void destroy_render_service(struct render_service *service) {
+	for (int i = 0; i < service->file_count; i++) {
+		asset_release(service->assets, service->files[i].asset);
+		free(service->files[i].path);
+	}
+	destroy_asset_manager(service->assets);
+	for (int i = 0; i < service->context_count; i++) {
+		destroy_context(service->contexts[i].context);
+	}
+	unload_texture(service->checkerboard);
+	free(service->contexts);
+	free(service->files);
+	free(service);
+}
+
+struct render_service_stats render_service_get_stats(struct render_service *service) {
+	struct render_service_stats stats = service->stats;
+	stats.files_loaded = asset_manager_load_count(service->assets);
+	return stats;
+}
+
+// ********** Jobs **********
+
+struct render_job render_job_default(void) {
+	struct render_job job = {.width = 512, .height = 512, .yaw = 0.3, .pitch = 0.0, .zoom = 1.0,
+							 .perspective = 0.0005, .shader = RENDER_SHADER_TEXTURE};
+	strcpy(job.model, "model/head.obj");
+	return job;
+}
+
+static bool parse_int(const char *value, int *result) {
+	char *end;
+	long number = strtol(value, &end, 10);
+	if (end == value || *end || number <= 0 || number > RENDER_JOB_MAX_SIZE) {
+		return false;
+	}
+	*result = (int)number;
+	return true;
+}
+
+static bool parse_double(const char *value, double *result) {
+	char *end;
+	double number = strtod(value, &end);
+	if (end == value || *end || !isfinite(number)) {
+		return false;
+	}
+	*result = number;
+	return true;
+}
+
+static bool parse_path(const char *value, char *result) {
+	if (strlen(value) >= RENDER_JOB_PATH_SIZE) {
+		return false;
+	}
+	strcpy(result, value);
+	return true;
+}
+
+static bool parse_pair(const char *key, const char *value, struct render_job *job) {
+	if (strcmp(key, "model") == 0) {
+		return parse_path(value, job->model);
+	} else if (strcmp(key, "texture") == 0) {
+		return parse_path(value, job->texture);
+	} else if (strcmp(key, "width") == 0) {
+		return parse_int(value, &job->width);
+	} else if (strcmp(key, "height") == 0) {
+		return parse_int(value, &job->height);
+	} else if (strcmp(key, "yaw") == 0) {
+		return parse_double(value, &job->yaw);
+	} else if (strcmp(key, "pitch") == 0) {
+		return parse_double(value, &job->pitch);
+	} else if (strcmp(key, "zoom") == 0) {
+		return parse_double(value, &job->zoom) && job->zoom > 0.0;
+	} else if (strcmp(key, "perspective") == 0) {
+		return parse_double(value, &job->perspective) && job->perspective >= 0.0;
+	} else if (strcmp(key, "shader") == 0) {
+		if (strcmp(value, "texture") == 0) {
+			job->shader = RENDER_SHADER_TEXTURE;
+		} else if (strcmp(value, "lit") == 0) {
+			job->shader = RENDER_SHADER_LIT;
+		} else {
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+bool render_job_parse(const char *text, struct render_job *job, char *error, size_t error_size) {
+	char token[RENDER_JOB_PATH_SIZE + 32];
+	const char *p = text;
+	while (true) {
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+		}
+		if (!*p) {
+			return true;
+		}
+		size_t length = strcspn(p, " \t\r\n");
+		if (length >= sizeof(token)) {
+			snprintf(error, error_size, "Too long: %.32s...", p);
+			return false;
+		}
+		memcpy(token, p, length);
+		token[length] = '\0';
+		p += length;
+
+		char *equals = strchr(token, '=');
+		if (!equals) {
+			snprintf(error, error_size, "Expected key=value: %s", token);
+			return false;
+		}
+		*equals = '\0';
+		if (!parse_pair(token, equals + 1, job)) {
+			snprintf(error, error_size, "Invalid %s: %s", token, equals + 1);
+			return false;
+		}
+	}
+}
+
+static int compare_double(double a, double b) {
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/**
+ Orders jobs by what they can share: resolution first, then files. Jobs
+ that are the same compare equal.
+ */
+static int compare_jobs(const struct render_job *a, const struct render_job *b) {
+	if (a->width != b->width) {
+		return a->width - b->width;
+	}
+	if (a->height != b->height) {
+		return a->height - b->height;
+	}
+	int cmp = strcmp(a->model, b->model);
+	if (cmp == 0) {
+		cmp = strcmp(a->texture, b->texture);
+	}
+	if (cmp == 0) {
+		cmp = (int)a->shader - (int)b->shader;
+	}
+	if (cmp == 0) {
+		cmp = compare_double(a->yaw, b->yaw);
+	}
+	if (cmp == 0) {
+		cmp = compare_double(a->pitch, b->pitch);
+	}
+	if (cmp == 0) {
+		cmp = compare_double(a->zoom, b->zoom);
+	}
+	if (cmp == 0) {
+		cmp = compare_double(a->perspective, b->perspective);
+	}
+	return cmp;
+}
+
+struct job_ref {
+	const struct render_job *job;
+	int index;
+};
+
+static int compare_job_refs(const void *a, const void *b) {
+	const struct job_ref *ra = a;
+	const struct job_ref *rb = b;
+	int cmp = compare_jobs(ra->job, rb->job);
+	return cmp != 0 ? cmp : ra->index - rb->index;
+}
+
+// ********** Rendering **********
+
+static struct cached_file *get_file(struct render_service *service, const char *path, bool is_model) {
+	for (int i = 0; i < service->file_count; i++) {
+		struct cached_file *file = &service->files[i];
+		if (file->is_model == is_model && strcmp(file->path, path) == 0) {
+			return file;
+		}
+	}
+	if (service->file_count == service->file_capacity) {
+		service->file_capacity = service->file_capacity ? service->file_capacity * 2 : 16;
+		service->files = realloc(service->files, sizeof(struct cached_file) * service->file_capacity);
+	}
+	struct cached_file *file = &service->files[service->file_count++];
+	*file = (struct cached_file){.path = strdup(path), .is_model = is_model};
+	file->asset = is_model ? asset_manager_load_model(service->assets, path) : asset_manager_load_texture(service->assets, path);
+	return file;
+}
+
+static struct graphics_context *get_context(struct render_service *service, int width, int height) {
+	struct cached_context *slot = NULL;
+	for (int i = 0; i < service->context_count; i++) {
+		struct cached_context *cached = &service->contexts[i];
+		if (cached->context->width == width && cached->context->height == height) {
+			cached->last_used = ++service->clock;
+			return cached->context;
+		}
+		if (!slot || cached->last_used < slot->last_used) {
+			slot = cached;
+		}
+	}
+
+	if (service->context_count < service->max_contexts) {
+		slot = &service->contexts[service->context_count++];
+	} else {
+		destroy_context(slot->context);
+	}
+	slot->context = create_context(width, height);
+	slot->last_used = ++service->clock;
+	service->stats.contexts_created++;
+	return slot->context;
+}
+
+static void find_bounds(struct cached_file *file, struct model model) {
+	vec3 min = model.vertices[0];
+	vec3 max = model.vertices[0];
+	for (int i = 1; i < model.num_vertices; i++) {
+		vec3 v = model.vertices[i];
+		min = (vec3){fmin(min.x, v.x), fmin(min.y, v.y), fmin(min.z, v.z)};
+		max = (vec3){fmax(max.x, v.x), fmax(max.y, v.y), fmax(max.z, v.z)};
+	}
+	file->center = vec3_scale(vec3_add(min, max), 0.5);
+	file->extent = fmax(fmax(max.x - min.x, max.y - min.y), max.z - min.z);
+	file->has_bounds = true;
+}
+
+/**
+ Scales the model so that it fills most of the image at a zoom of 1.0,
+ turns it, and centers it on the origin
+ */
+static transform_3d frame_model(struct cached_file *file, const struct render_job *job) {
+	double extent = file->extent > 0.0 ? file->extent : 1.0;
+	double scale = 0.8 * fmin(job->width, job->height) / extent * job->zoom;
+
+	transform_3d t = transform_3d_identity;
+	t = transform_3d_scale(t, scale, -scale, -scale); // Flip Y and Z axis to fit coordinate space
+	t = transform_3d_multiply(t, transform_3d_make_rotation_y(job->yaw));
+	t = transform_3d_rotate_x_around_origin(t, job->pitch);
+	vec3 offset = transform_3d_apply(file->center, t);
+	return transform_3d_translate(t, -offset.x, -offset.y, -offset.z);
+}
+
+static void fail(struct render_result *result, const char *message, const char *path) {
+	result->ok = false;
+	snprintf(result->error, sizeof(result->error), "%s%s", message, path);
+}
+
+static void render_job(struct render_service *service, const struct render_job *job, struct render_result *result) {
+	if (job->width <= 0 || job->height <= 0 || job->width > RENDER_JOB_MAX_SIZE || job->height > RENDER_JOB_MAX_SIZE) {
+		fail(result, "Invalid resolution", "");
+		return;
+	}
+	if (!job->model[0]) {
+		fail(result, "No model", "");
+		return;
+	}
+
+	struct cached_file *model_file = get_file(service, job->model, true);
+	if (asset_get_state(service->assets, model_file->asset) != ASSET_READY) {
+		fail(result, "Can't load model ", job->model);
+		return;
+	}
+	struct object object = {.model = asset_model(service->assets, model_file->asset), .texture = service->checkerboard};
+	if (object.model.num_vertices == 0) {
+		fail(result, "Empty model ", job->model);
+		return;
+	}
+	if (job->texture[0]) {
+		struct cached_file *texture_file = get_file(service, job->texture, false);
+		if (asset_get_state(service->assets, texture_file->asset) != ASSET_READY) {
+			fail(result, "Can't load texture ", job->texture);
+			return;
+		}
+		object.texture = asset_texture(service->assets, texture_file->asset);
+	}
+	object.normal_map = object.texture;
+	if (!model_file->has_bounds) {
+		find_bounds(model_file, object.model);
+	}
+	object.transform = frame_model(model_file, job);
+
+	double start = timing_now_ms();
+	struct graphics_context *context = get_context(service, job->width, job->height);
+	struct scene scene = {
+		.view = transform_3d_make_translation(job->width / 2.0, job->height / 2.0, 100.0),
+		.perspective = job->perspective,
+		.ambient_light = {0, 0, 0},
+		.directional_lights = service_lights,
+		.directional_light_count = sizeof(service_lights) / sizeof(service_lights[0])
+	};
+	fragment_shader *shader = job->shader == RENDER_SHADER_LIT ? &shadowed_texture_shader : &apply_texture_shader;
+
+	clear(context, (rgb_color){0, 0, 0});
+	render_object(object, scene, &goraud_shader, shader, context);
+	result->image = bmp_encode(context->pixel_buffer, context->width, context->height, &result->image_size);
+	result->render_ms = timing_now_ms() - start;
+	result->ok = true;
+	service->stats.rendered++;
+}
+
+void render_service_render(struct render_service *service,
+						   const struct render_job *jobs,
+						   int count,
+						   struct render_result *results)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	// Start loading every file of the batch before waiting for any of them
+	struct job_ref *order = malloc(sizeof(struct job_ref) * count);
+	for (int i = 0; i < count; i++) {
+		order[i] = (struct job_ref){.job = &jobs[i], .index = i};
+		results[i] = (struct render_result){0};
+		if (jobs[i].model[0]) {
+			get_file(service, jobs[i].model, true);
+		}
+		if (jobs[i].texture[0]) {
+			get_file(service, jobs[i].texture, false);
+		}
+	}
+	asset_manager_wait(service->assets);
+	qsort(order, count, sizeof(struct job_ref), &compare_job_refs);
+
+	for (int i = 0; i < count; i++) {
+		struct render_result *result = &results[order[i].index];
+		if (i > 0 && compare_jobs(order[i - 1].job, order[i].job) == 0) {
+			// Same as the previous job, so the same image
+			*result = results[order[i - 1].index];
+			if (result->image) {
+				result->image = malloc(result->image_size);
+				memcpy(result->image, results[order[i - 1].index].image, result->image_size);
+			}
+			continue;
+		}
+		render_job(service, order[i].job, result);
+	}
+	free(order);
+
+	service->stats.jobs += count;
+	service->stats.batches++;
+}
+
+void render_result_free(struct render_result *result) {
+	free(result->image);
+	result->image = NULL;
+	result->image_size = 0;
+}
@@ -0,0 +1,94 @@
+#ifndef RENDER_SERVICE_H
+#define RENDER_SERVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ Renders images without a window, for jobs that describe a model, a camera
+ and a resolution. Every model and texture a job has used stays loaded, and
+ a context is kept for each recent resolution, so that later jobs with them
+ only pay for rendering.
+
+ Jobs are rendered in batches. A batch starts loading all of its files at
+ once, then renders its jobs sorted so that jobs with the same resolution,
+ model and texture follow each other and share a context and the framing
+ of the model. Jobs that are exactly the same are rendered once.
+
+ Not thread safe: the render daemon (daemon.c) renders from one thread.
+ */
+struct render_service;
+
+enum render_shader {
+	RENDER_SHADER_TEXTURE, // Textured, lit per vertex
+	RENDER_SHADER_LIT      // Textured, lit per fragment
+};
+
+#define RENDER_JOB_PATH_SIZE 256
+
+struct render_job {
+	char model[RENDER_JOB_PATH_SIZE];
+	char texture[RENDER_JOB_PATH_SIZE]; // Empty for a checkerboard texture
+	int width;
+	int height;
+	double yaw;   // Rotation around the model's Y axis, in radians
+	double pitch; // Rotation around the screen's X axis, in radians
+	double zoom;  // 1.0 fits the model to the image
+	double perspective;
+	enum render_shader shader;
+};
+
+struct render_result {
+	bool ok;
+	char error[RENDER_JOB_PATH_SIZE + 64]; // Why the job failed, if it didn't succeed
+	uint8_t *image;    // A BMP file, allocated with malloc
+	size_t image_size;
+	double render_ms;  // Time spent rendering and encoding the image
+};
+
+struct render_service_stats {
+	long jobs;
+	long batches;
+	long rendered;          // Jobs actually rendered, less than jobs when batches had duplicates
+	long contexts_created;  // Contexts are reused for jobs with the resolution of a recent job
+	int files_loaded;       // Models and textures loaded, once each
+};
+
+/**
+ loader_threads is passed to create_asset_manager. Up to max_contexts
+ contexts are kept, the least recently used one is replaced after that.
+ */
+struct render_service *create_render_service(int loader_threads, int max_contexts);
+void destroy_render_service(struct render_service *service);
+
+/**
+ A 512x512 job with the camera the viewer starts with, for the head model
+ */
+struct render_job render_job_default(void);
+
+/**
+ Parses space separated key=value pairs into a job, leaving the fields that
+ aren't mentioned as they are:
+
+	model=model/head.obj texture=model/head_vcols.bmp width=640 height=480
+	yaw=0.3 pitch=0.3 zoom=1.0 perspective=0.0005 shader=texture|lit
+
+ Returns false, and describes the problem in error, for unknown keys and
+ invalid values.
+ */
+bool render_job_parse(const char *text, struct render_job *job, char *error, size_t error_size);
+
+/**
+ Renders a batch of jobs. results[i] is the result of jobs[i], and its image
+ is freed with render_result_free.
+ */
+void render_service_render(struct render_service *service,
+						   const struct render_job *jobs,
+						   int count,
+						   struct render_result *results);
+void render_result_free(struct render_result *result);
+
+struct render_service_stats render_service_get_stats(struct render_service *service);
+
+#endif
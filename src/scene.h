@@ -4,9 +4,32 @@
 #include "color.h"
 #include "geometry.h"
 
+struct shadow_map;
+struct light_tiles;
+
 struct directional_light {
 	vec3 direction;
 	rgb_color intensity;
+	struct shadow_map *shadow_map; // Optional, only used by shadowed_texture_shader
+};
+
+enum local_light_type {
+	LOCAL_LIGHT_POINT,
+	LOCAL_LIGHT_SPOT
+};
+
+/**
+ A point or spot light at a position in view space (after the model-view
+ transform, before perspective). Its light fades out towards radius, and
+ doesn't reach any further.
+ */
+struct local_light {
+	enum local_light_type type;
+	vec3 position;
+	rgb_color intensity;
+	double radius;
+	vec3 direction; // Spot lights only, where the cone points
+	double cone_cosine; // Spot lights only, cosine of half the cone angle
 };
 
 struct scene {
@@ -15,6 +38,12 @@ struct scene {
 	rgb_color ambient_light;
 	struct directional_light *directional_lights;
 	int directional_light_count;
+	struct local_light *local_lights;
+	int local_light_count;
+
+	// Optional. With light tiles for this frame (light_tiles_build), shaders
+	// only evaluate the local lights that can reach their part of the screen.
+	struct light_tiles *light_tiles;
 };
 
 #endif
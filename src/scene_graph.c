@@ -0,0 +1,621 @@
+#include "scene_graph.h"
+#include "object.h"
+#include "shadow_map.h"
+#include <math.h>
+
+struct draw_item {
+	int instance;
+	double depth;
+	transform_3d model_view;
+};
+
+struct mesh *create_mesh(struct model model, struct texture texture, struct texture normal_map) {
+	struct mesh *mesh = malloc(sizeof(struct mesh));
+	mesh->model = model;
+	mesh->texture = texture;
+	mesh->normal_map = normal_map;
+
+	mesh->face_normals = malloc(sizeof(vec3) * model.num_faces);
+	for (int i = 0; i < model.num_faces; i++) {
+		struct face f = model.faces[i];
+		vec3 v = vec3_subtract(*f.vertices[1], *f.vertices[0]);
+		vec3 u = vec3_subtract(*f.vertices[2], *f.vertices[0]);
+		mesh->face_normals[i] = vec3_unit(cross_product(v, u));
+	}
+
+	// Bounding sphere around the center of the bounding box. Not the smallest
+	// sphere, but cheap and good enough for culling.
+	vec3 min = model.num_vertices > 0 ? model.vertices[0] : (vec3){0, 0, 0};
+	vec3 max = min;
+	for (int i = 1; i < model.num_vertices; i++) {
+		vec3 p = model.vertices[i];
+		min = (vec3){fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z)};
+		max = (vec3){fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z)};
+	}
+	mesh->bounds_center = vec3_scale(vec3_add(min, max), 0.5);
+	mesh->bounds_radius = 0.0;
+	for (int i = 0; i < model.num_vertices; i++) {
+		vec3 d = vec3_subtract(model.vertices[i], mesh->bounds_center);
+		mesh->bounds_radius = fmax(mesh->bounds_radius, sqrt(dot_product_3d(d, d)));
+	}
+	mesh->bvh = NULL;
+	mesh->edges = NULL;
+	return mesh;
+}
+
+void destroy_mesh(struct mesh *mesh) {
+	if (mesh->bvh) {
+		destroy_bvh(mesh->bvh);
+	}
+	if (mesh->edges) {
+		destroy_edge_list(mesh->edges);
+	}
+	free(mesh->face_normals);
+	free(mesh);
+}
+
+void mesh_build_bvh(struct mesh *mesh, int threads) {
+	int count = mesh->model.num_faces;
+	vec3 *mins = malloc(sizeof(vec3) * (count > 0 ? count : 1));
+	vec3 *maxes = malloc(sizeof(vec3) * (count > 0 ? count : 1));
+	for (int i = 0; i < count; i++) {
+		struct face f = mesh->model.faces[i];
+		mins[i] = maxes[i] = *f.vertices[0];
+		for (int c = 1; c < 3; c++) {
+			vec3 p = *f.vertices[c];
+			mins[i] = (vec3){fmin(mins[i].x, p.x), fmin(mins[i].y, p.y), fmin(mins[i].z, p.z)};
+			maxes[i] = (vec3){fmax(maxes[i].x, p.x), fmax(maxes[i].y, p.y), fmax(maxes[i].z, p.z)};
+		}
+	}
+
+	if (mesh->bvh) {
+		destroy_bvh(mesh->bvh);
+	}
+	mesh->bvh = build_bvh(mins, maxes, count, threads);
+	free(mins);
+	free(maxes);
+}
+
+void mesh_build_edge_list(struct mesh *mesh) {
+	if (mesh->edges) {
+		destroy_edge_list(mesh->edges);
+	}
+	mesh->edges = create_edge_list(mesh->model);
+}
+
+struct scene_graph *create_scene_graph(void) {
+	struct scene_graph *graph = calloc(1, sizeof(struct scene_graph));
+	graph->frustum_culling = true;
+	graph->sort_front_to_back = true;
+	graph->occlusion_culling = true;
+	return graph;
+}
+
+void destroy_scene_graph(struct scene_graph *graph) {
+	if (graph->bvh) {
+		destroy_bvh(graph->bvh);
+	}
+	if (graph->occlusion) {
+		destroy_occlusion_buffer(graph->occlusion);
+	}
+	free(graph->instances);
+	free(graph);
+}
+
+int scene_graph_add_instance(struct scene_graph *graph, struct mesh *mesh, transform_3d transform) {
+	if (graph->instance_count == graph->capacity) {
+		graph->capacity = graph->capacity > 0 ? graph->capacity * 2 : 64;
+		graph->instances = realloc(graph->instances, sizeof(struct instance) * graph->capacity);
+	}
+	graph->instances[graph->instance_count] = (struct instance){.mesh = mesh, .transform = transform, .occluder = false};
+	return graph->instance_count++;
+}
+
+/**
+ Largest scale factor of the linear part of a transform, for transforming radii
+ */
+static double transform_max_scale(transform_3d t) {
+	double x = t.sx * t.sx + t.ay * t.ay + t.az * t.az;
+	double y = t.ax * t.ax + t.sy * t.sy + t.bz * t.bz;
+	double z = t.bx * t.bx + t.by * t.by + t.sz * t.sz;
+	return sqrt(fmax(fmax(x, y), z));
+}
+
+/**
+ Calculates the axis-aligned bounds of a transformed box
+ */
+static void transform_box(vec3 min, vec3 max, transform_3d transform, vec3 *view_min, vec3 *view_max) {
+	*view_min = (vec3){INFINITY, INFINITY, INFINITY};
+	*view_max = (vec3){-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = {(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z};
+		vec3 p = transform_3d_apply(corner, transform);
+		*view_min = (vec3){fmin(view_min->x, p.x), fmin(view_min->y, p.y), fmin(view_min->z, p.z)};
+		*view_max = (vec3){fmax(view_max->x, p.x), fmax(view_max->y, p.y), fmax(view_max->z, p.z)};
+	}
+}
+
+/**
+ Projects a box through a transform (see project_view_box)
+ */
+static bool project_box(vec3 min, vec3 max, transform_3d transform, struct scene scene, double rect[4]) {
+	vec3 view_min, view_max;
+	transform_box(min, max, transform, &view_min, &view_max);
+	return project_view_box(view_min, view_max, scene, rect);
+}
+
+/**
+ Returns true if a box in view space is hidden behind the occluders
+ */
+static bool view_box_is_occluded(struct occlusion_buffer *occlusion, vec3 min, vec3 max, struct scene scene) {
+	double rect[4];
+	if (!project_view_box(min, max, scene, rect)) {
+		return true;
+	}
+	return !occlusion_buffer_test(occlusion, rect, min.z);
+}
+
+static bool rect_is_visible(double rect[4], struct graphics_context *context) {
+	return !(rect[2] < 0 || rect[3] < 0 || rect[0] > context->width || rect[1] > context->height);
+}
+
+bool mesh_is_visible(struct mesh *mesh, transform_3d model_view, struct scene scene, struct graphics_context *context) {
+	vec3 center = transform_3d_apply(mesh->bounds_center, model_view);
+	double radius = mesh->bounds_radius * transform_max_scale(model_view);
+	vec3 extent = {radius, radius, radius};
+	double rect[4];
+	return project_view_box(vec3_subtract(center, extent), vec3_add(center, extent), scene, rect) && rect_is_visible(rect, context);
+}
+
+bool box_is_visible(vec3 min, vec3 max, transform_3d transform, struct scene scene, struct graphics_context *context) {
+	double rect[4];
+	return project_box(min, max, transform, scene, rect) && rect_is_visible(rect, context);
+}
+
+static int compare_draw_items(const void *a, const void *b) {
+	const struct draw_item *d1 = (const struct draw_item *)a;
+	const struct draw_item *d2 = (const struct draw_item *)b;
+	if (d1->depth < d2->depth) return -1;
+	if (d1->depth > d2->depth) return 1;
+	return d1->instance - d2->instance;
+}
+
+static void render_face(struct mesh *mesh,
+						int face_index,
+						transform_3d transform,
+						transform_3d model_view,
+						struct scene scene,
+						vertex_shader *vertex_shader,
+						fragment_shader *fragment_shader,
+						struct fragment_shader_input input,
+						bool cull_back_faces,
+						bool depth_only,
+						struct graphics_context *context)
+{
+	if (depth_only) {
+		// Depth only, with the same culling as the color pass
+		vec3 coordinates[3];
+		project_face(mesh->model.faces[face_index], model_view, scene, coordinates);
+		if (!cull_back_faces || coordinates_are_front_facing(coordinates)) {
+			triangle_depth_only(coordinates, context);
+		}
+		return;
+	}
+
+	struct vertex vertices[3];
+	shade_face_corners(mesh->model.faces[face_index], mesh->face_normals[face_index], transform, model_view,
+					   scene, vertex_shader, NULL, vertices);
+	COUNT_STAT(context->stats, faces_submitted);
+
+	if (cull_back_faces && !face_is_front_facing(vertices)) {
+		COUNT_STAT(context->stats, faces_back_face_culled);
+		return;
+	}
+	triangle(vertices, input, fragment_shader, context);
+}
+
+/**
+ Draws a mesh, skipping the BVH nodes that are outside the view or, with an
+ occlusion buffer, hidden behind the occluders. With depth_only, only the
+ depth of the faces is drawn, for a Z-prepass. A NULL fragment shader draws
+ the interpolated vertex colors, as everywhere else.
+ */
+static void render_mesh_nodes(struct mesh *mesh,
+							  transform_3d transform,
+							  transform_3d model_view,
+							  struct scene scene,
+							  vertex_shader *vertex_shader,
+							  fragment_shader *fragment_shader,
+							  struct fragment_shader_input input,
+							  bool cull_back_faces,
+							  bool depth_only,
+							  struct occlusion_buffer *occlusion,
+							  struct graphics_context *context)
+{
+	if (!mesh->bvh) {
+		for (int i = 0; i < mesh->model.num_faces; i++) {
+			render_face(mesh, i, transform, model_view, scene, vertex_shader, fragment_shader, input, cull_back_faces,
+						depth_only, context);
+		}
+		return;
+	}
+
+	struct bvh *bvh = mesh->bvh;
+	int stack[BVH_MAX_DEPTH];
+	int stack_size = bvh->node_count > 0 ? 1 : 0;
+	stack[0] = 0;
+	while (stack_size > 0) {
+		struct bvh_node *node = &bvh->nodes[stack[--stack_size]];
+		vec3 view_min, view_max;
+		double rect[4];
+		transform_box(bvh_node_min(node), bvh_node_max(node), model_view, &view_min, &view_max);
+		if (!project_view_box(view_min, view_max, scene, rect) || !rect_is_visible(rect, context)) {
+			continue;
+		}
+		if (occlusion && !occlusion_buffer_test(occlusion, rect, view_min.z)) {
+			continue;
+		}
+		if (bvh_node_is_leaf(node)) {
+			for (int i = node->offset; i < node->offset + node->count; i++) {
+				render_face(mesh, bvh->primitives[i], transform, model_view, scene, vertex_shader, fragment_shader,
+							input, cull_back_faces, depth_only, context);
+			}
+		} else {
+			stack[stack_size++] = node->offset;
+			stack[stack_size++] = (int)(node - bvh->nodes) + 1;
+		}
+	}
+}
+
+void render_mesh(struct mesh *mesh,
+				 transform_3d transform,
+				 transform_3d model_view,
+				 struct scene scene,
+				 vertex_shader *vertex_shader,
+				 fragment_shader *fragment_shader,
+				 struct fragment_shader_input input,
+				 bool cull_back_faces,
+				 struct graphics_context *context)
+{
+	render_mesh_nodes(mesh, transform, model_view, scene, vertex_shader, fragment_shader, input, cull_back_faces, false, NULL,
+					  context);
+}
+
+/**
+ Rasterizes the front faces of an occluder into the occlusion buffer. Faces
+ that reach behind the eye are left out, since they can't be projected.
+ */
+static void draw_occluder(struct occlusion_buffer *occlusion, struct mesh *mesh, transform_3d model_view, struct scene scene) {
+	for (int i = 0; i < mesh->model.num_faces; i++) {
+		struct face f = mesh->model.faces[i];
+		struct vertex vertices[3];
+		bool projectable = true;
+		for (int c = 0; c < 3; c++) {
+			vec3 p = transform_3d_apply(*f.vertices[c], model_view);
+			projectable = projectable && 1.0 - p.z * scene.perspective > 0.0;
+			vertices[c].coordinate = apply_perspective(p, scene.view, scene.perspective);
+		}
+		if (projectable && face_is_front_facing(vertices)) {
+			occlusion_buffer_draw_triangle(occlusion, vertices[0].coordinate, vertices[1].coordinate, vertices[2].coordinate);
+		}
+	}
+}
+
+/**
+ Draws the occluders in the draw list into the occlusion buffer. Returns
+ NULL if there are none.
+ */
+static struct occlusion_buffer *draw_occluders(struct scene_graph *graph, struct scene scene, struct graphics_context *context, int count) {
+	bool has_occluders = false;
+	for (int i = 0; i < count && !has_occluders; i++) {
+		has_occluders = graph->instances[graph->draw_list[i].instance].occluder;
+	}
+	if (!has_occluders) {
+		return NULL;
+	}
+
+	if (graph->occlusion && (graph->occlusion->screen_width != context->width || graph->occlusion->screen_height != context->height)) {
+		destroy_occlusion_buffer(graph->occlusion);
+		graph->occlusion = NULL;
+	}
+	if (!graph->occlusion) {
+		graph->occlusion = create_occlusion_buffer(context->width, context->height);
+	}
+	occlusion_buffer_clear(graph->occlusion);
+
+	for (int i = 0; i < count; i++) {
+		struct instance *instance = &graph->instances[graph->draw_list[i].instance];
+		if (instance->occluder) {
+			draw_occluder(graph->occlusion, instance->mesh, graph->draw_list[i].model_view, scene);
+		}
+	}
+	return graph->occlusion;
+}
+
+/**
+ Removes every instance from the draw list that is hidden behind the
+ occluders, and returns the new count
+ */
+static int cull_occluded(struct scene_graph *graph, struct occlusion_buffer *occlusion, struct scene scene, int count) {
+	int kept = 0;
+	for (int i = 0; i < count; i++) {
+		struct draw_item *item = &graph->draw_list[i];
+		struct mesh *mesh = graph->instances[item->instance].mesh;
+		if (!graph->instances[item->instance].occluder) {
+			vec3 center = transform_3d_apply(mesh->bounds_center, item->model_view);
+			double radius = mesh->bounds_radius * transform_max_scale(item->model_view);
+			vec3 extent = {radius, radius, radius};
+			if (view_box_is_occluded(occlusion, vec3_subtract(center, extent), vec3_add(center, extent), scene)) {
+				continue;
+			}
+		}
+		graph->draw_list[kept++] = *item;
+	}
+	return kept;
+}
+
+static void add_draw_item(struct scene_graph *graph, int index, struct scene scene, struct graphics_context *context, int *count) {
+	struct instance *instance = &graph->instances[index];
+	transform_3d model_view = transform_3d_multiply(instance->transform, scene.view);
+	if (graph->frustum_culling && !mesh_is_visible(instance->mesh, model_view, scene, context)) {
+		return;
+	}
+
+	// Lower Z-values are closer to the camera
+	double depth = transform_3d_apply(instance->mesh->bounds_center, model_view).z;
+	graph->draw_list[(*count)++] = (struct draw_item){.instance = index, .depth = depth, .model_view = model_view};
+}
+
+static void render_draw_list(struct scene_graph *graph,
+							 int count,
+							 struct scene scene,
+							 vertex_shader *vertex_shader,
+							 fragment_shader *fragment_shader,
+							 bool depth_only,
+							 struct occlusion_buffer *occlusion,
+							 struct graphics_context *context)
+{
+	for (int i = 0; i < count; i++) {
+		struct instance *instance = &graph->instances[graph->draw_list[i].instance];
+		struct fragment_shader_input input;
+		input.texture = &instance->mesh->texture;
+		input.normal_map = &instance->mesh->normal_map;
+		input.scene = scene;
+		input.stats = context->stats;
+		render_mesh_nodes(instance->mesh, instance->transform, graph->draw_list[i].model_view, scene, vertex_shader,
+						  fragment_shader, input, true, depth_only, instance->occluder ? NULL : occlusion, context);
+	}
+}
+
+void render_scene_graph(struct scene_graph *graph,
+						struct scene scene,
+						vertex_shader *vertex_shader,
+						fragment_shader *fragment_shader,
+						struct graphics_context *context)
+{
+	graph->draw_list = frame_arena_alloc(context->arena, sizeof(struct draw_item) * graph->instance_count);
+
+	int count = 0;
+	if (graph->frustum_culling && graph->bvh) {
+		// Whole groups of instances are rejected by the BVH, the rest are tested one by one
+		struct bvh *bvh = graph->bvh;
+		int stack[BVH_MAX_DEPTH];
+		int stack_size = bvh->node_count > 0 ? 1 : 0;
+		stack[0] = 0;
+		while (stack_size > 0) {
+			struct bvh_node *node = &bvh->nodes[stack[--stack_size]];
+			if (!box_is_visible(bvh_node_min(node), bvh_node_max(node), scene.view, scene, context)) {
+				continue;
+			}
+			if (bvh_node_is_leaf(node)) {
+				for (int i = node->offset; i < node->offset + node->count; i++) {
+					add_draw_item(graph, bvh->primitives[i], scene, context, &count);
+				}
+			} else {
+				stack[stack_size++] = node->offset;
+				stack[stack_size++] = (int)(node - bvh->nodes) + 1;
+			}
+		}
+	} else {
+		for (int i = 0; i < graph->instance_count; i++) {
+			add_draw_item(graph, i, scene, context, &count);
+		}
+	}
+	if (context->stats) {
+		context->stats->instances_submitted += graph->instance_count;
+		context->stats->instances_culled += graph->instance_count - count;
+	}
+
+	if (graph->sort_front_to_back) {
+		qsort(graph->draw_list, count, sizeof(struct draw_item), &compare_draw_items);
+	}
+
+	// Meshes that survive the occlusion test still have their BVH nodes tested,
+	// but occluders are never hidden by themselves, so they skip the tests
+	struct occlusion_buffer *occlusion = graph->occlusion_culling ? draw_occluders(graph, scene, context, count) : NULL;
+	if (occlusion) {
+		int visible = cull_occluded(graph, occlusion, scene, count);
+		if (context->stats) {
+			context->stats->instances_occluded += count - visible;
+		}
+		count = visible;
+	}
+
+	// With a Z-prepass, the depth of everything is drawn first, and then only
+	// the fragments that ended up in front are shaded
+	enum depth_test depth_test = context->depth_test;
+	if (graph->z_prepass) {
+		render_draw_list(graph, count, scene, NULL, NULL, true, occlusion, context);
+		context_set_depth_test(context, DEPTH_TEST_EQUAL);
+	}
+	render_draw_list(graph, count, scene, vertex_shader, fragment_shader, false, occlusion, context);
+	context_set_depth_test(context, depth_test);
+}
+
+void scene_graph_render_shadow_maps(struct scene_graph *graph, struct scene scene) {
+	// View space bounds of every instance's bounding sphere
+	vec3 min = {INFINITY, INFINITY, INFINITY};
+	vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < graph->instance_count; i++) {
+		struct instance *instance = &graph->instances[i];
+		transform_3d model_view = transform_3d_multiply(instance->transform, scene.view);
+		vec3 center = transform_3d_apply(instance->mesh->bounds_center, model_view);
+		double radius = instance->mesh->bounds_radius * transform_max_scale(model_view);
+		min = (vec3){fmin(min.x, center.x - radius), fmin(min.y, center.y - radius), fmin(min.z, center.z - radius)};
+		max = (vec3){fmax(max.x, center.x + radius), fmax(max.y, center.y + radius), fmax(max.z, center.z + radius)};
+	}
+	if (graph->instance_count == 0) {
+		min = max = (vec3){0, 0, 0};
+	}
+
+	for (int l = 0; l < scene.directional_light_count; l++) {
+		struct directional_light *light = &scene.directional_lights[l];
+		if (!light->shadow_map) {
+			continue;
+		}
+		shadow_map_begin(light->shadow_map, light->direction, min, max);
+		for (int i = 0; i < graph->instance_count; i++) {
+			struct instance *instance = &graph->instances[i];
+			shadow_map_draw_model(light->shadow_map, &instance->mesh->model, transform_3d_multiply(instance->transform, scene.view));
+		}
+	}
+}
+
+void scene_graph_build_bvh(struct scene_graph *graph, int threads) {
+	int count = graph->instance_count;
+	vec3 *mins = malloc(sizeof(vec3) * (count > 0 ? count : 1));
+	vec3 *maxes = malloc(sizeof(vec3) * (count > 0 ? count : 1));
+	for (int i = 0; i < count; i++) {
+		struct instance *instance = &graph->instances[i];
+		vec3 center = transform_3d_apply(instance->mesh->bounds_center, instance->transform);
+		double radius = instance->mesh->bounds_radius * transform_max_scale(instance->transform);
+		vec3 extent = {radius, radius, radius};
+		mins[i] = vec3_subtract(center, extent);
+		maxes[i] = vec3_add(center, extent);
+	}
+
+	if (graph->bvh) {
+		destroy_bvh(graph->bvh);
+	}
+	graph->bvh = build_bvh(mins, maxes, count, threads);
+	free(mins);
+	free(maxes);
+}
+
+// ********** Picking **********
+
+/**
+ Tests the point (x, y) against one face, exactly as the face would be
+ rasterized, and keeps it in result if it is the closest hit so far
+ */
+static void pick_face(struct mesh *mesh, int face_index, transform_3d model_view, struct scene scene,
+					  double x, double y, int instance, struct pick_result *result)
+{
+	struct face f = mesh->model.faces[face_index];
+	struct vertex vertices[3];
+	for (int i = 0; i < 3; i++) {
+		vec3 p = transform_3d_apply(*f.vertices[i], model_view);
+		vertices[i].coordinate = apply_perspective(p, scene.view, scene.perspective);
+	}
+	if (!face_is_front_facing(vertices)) {
+		return; // Back faces are never drawn
+	}
+
+	vec3 a = vertices[0].coordinate;
+	vec3 b = vertices[1].coordinate;
+	vec3 c = vertices[2].coordinate;
+	double area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0) {
+		return;
+	}
+	double w0 = ((b.x - x) * (c.y - y) - (b.y - y) * (c.x - x)) / area;
+	double w1 = ((c.x - x) * (a.y - y) - (c.y - y) * (a.x - x)) / area;
+	double w2 = 1.0 - w0 - w1;
+	if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0) {
+		return;
+	}
+
+	double z = w0 * a.z + w1 * b.z + w2 * c.z;
+	if (z < result->z) {
+		*result = (struct pick_result){.instance = instance, .face = face_index, .z = z};
+	}
+}
+
+static void pick_mesh_faces(struct mesh *mesh, transform_3d model_view, struct scene scene,
+							double x, double y, int instance, struct pick_result *result)
+{
+	if (!mesh->bvh) {
+		for (int i = 0; i < mesh->model.num_faces; i++) {
+			pick_face(mesh, i, model_view, scene, x, y, instance, result);
+		}
+		return;
+	}
+
+	// The projection is not a true perspective projection, so the points that
+	// land on a pixel do not form a straight ray. Instead of intersecting boxes
+	// with a ray, nodes are projected and tested against the pixel.
+	struct bvh *bvh = mesh->bvh;
+	int stack[BVH_MAX_DEPTH];
+	int stack_size = bvh->node_count > 0 ? 1 : 0;
+	stack[0] = 0;
+	while (stack_size > 0) {
+		struct bvh_node *node = &bvh->nodes[stack[--stack_size]];
+		double rect[4];
+		if (!project_box(bvh_node_min(node), bvh_node_max(node), model_view, scene, rect) ||
+			x < rect[0] || y < rect[1] || x > rect[2] || y > rect[3]) {
+			continue;
+		}
+		if (bvh_node_is_leaf(node)) {
+			for (int i = node->offset; i < node->offset + node->count; i++) {
+				pick_face(mesh, bvh->primitives[i], model_view, scene, x, y, instance, result);
+			}
+		} else {
+			stack[stack_size++] = node->offset;
+			stack[stack_size++] = (int)(node - bvh->nodes) + 1;
+		}
+	}
+}
+
+bool mesh_pick(struct mesh *mesh, transform_3d model_view, struct scene scene, double x, double y, struct pick_result *result) {
+	*result = (struct pick_result){.instance = -1, .face = -1, .z = INFINITY};
+	pick_mesh_faces(mesh, model_view, scene, x, y, -1, result);
+	return result->face >= 0;
+}
+
+static void pick_instance(struct scene_graph *graph, int index, struct scene scene, double x, double y, struct pick_result *result) {
+	struct instance *instance = &graph->instances[index];
+	transform_3d model_view = transform_3d_multiply(instance->transform, scene.view);
+	pick_mesh_faces(instance->mesh, model_view, scene, x, y, index, result);
+}
+
+bool scene_graph_pick(struct scene_graph *graph, struct scene scene, double x, double y, struct pick_result *result) {
+	*result = (struct pick_result){.instance = -1, .face = -1, .z = INFINITY};
+	if (!graph->bvh) {
+		for (int i = 0; i < graph->instance_count; i++) {
+			pick_instance(graph, i, scene, x, y, result);
+		}
+		return result->face >= 0;
+	}
+
+	struct bvh *bvh = graph->bvh;
+	int stack[BVH_MAX_DEPTH];
+	int stack_size = bvh->node_count > 0 ? 1 : 0;
+	stack[0] = 0;
+	while (stack_size > 0) {
+		struct bvh_node *node = &bvh->nodes[stack[--stack_size]];
+		double rect[4];
+		if (!project_box(bvh_node_min(node), bvh_node_max(node), scene.view, scene, rect) ||
+			x < rect[0] || y < rect[1] || x > rect[2] || y > rect[3]) {
+			continue;
+		}
+		if (bvh_node_is_leaf(node)) {
+			for (int i = node->offset; i < node->offset + node->count; i++) {
+				pick_instance(graph, bvh->primitives[i], scene, x, y, result);
+			}
+		} else {
+			stack[stack_size++] = node->offset;
+			stack[stack_size++] = (int)(node - bvh->nodes) + 1;
+		}
+	}
+	return result->face >= 0;
+}
@@ -0,0 +1,164 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include "graphics_context.h"
+#include "textures.h"
+#include "shaders.h"
+#include "scene.h"
+#include "obj.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "wireframe.h"
+#include <stdbool.h>
+
+/**
+ Data shared by every instance of a model: the model and its textures, plus
+ per-face normals and a bounding sphere that are computed once when the mesh
+ is created. The mesh does not own the model or the textures, so several
+ meshes can also share them.
+
+ Large meshes can also get a BVH over their faces (mesh_build_bvh), which is
+ then used to skip parts of the mesh that are outside the view, and to pick
+ faces without testing all of them. An edge list (mesh_build_edge_list) is
+ needed to draw the mesh as a wireframe.
+ */
+struct mesh {
+	struct model model;
+	struct texture texture;
+	struct texture normal_map;
+	vec3 *face_normals;
+	vec3 bounds_center;
+	double bounds_radius;
+	struct bvh *bvh; // NULL unless built
+	struct edge_list *edges; // NULL unless built
+};
+
+/**
+ Occluders are drawn into the scene graph's occlusion buffer before the other
+ instances are tested against it. Good occluders are large, simple and close,
+ like walls and terrain.
+ */
+struct instance {
+	struct mesh *mesh;
+	transform_3d transform;
+	bool occluder;
+};
+
+/**
+ A flat list of instances that is rendered as one scene. Instances outside
+ the view are rejected by their bounding sphere before any vertex work, and
+ the rest are drawn front to back so that early depth testing rejects as many
+ fragments as possible.
+
+ With a BVH over the instances (scene_graph_build_bvh), groups of instances
+ are culled and picked together. The BVH is not updated automatically, so it
+ has to be rebuilt after instances are added or moved.
+
+ With occlusion culling, the occluders in view are rasterized into a small
+ depth buffer, and other instances (and the BVH nodes of their meshes) are
+ only drawn if their bounding boxes aren't hidden behind the occluders.
+
+ With a Z-prepass, the visible instances are drawn twice: first only their
+ depth, and then their colors with an equal depth test, so that each pixel is
+ shaded (close to) once no matter the draw order. It pays off when fragment
+ shading is expensive compared to rasterization.
+ */
+struct scene_graph {
+	struct instance *instances;
+	int instance_count;
+	int capacity;
+
+	bool frustum_culling;
+	bool sort_front_to_back;
+	bool occlusion_culling;
+	bool z_prepass;
+	struct bvh *bvh; // NULL unless built
+	struct occlusion_buffer *occlusion; // Created when first needed
+
+	// Visible instances of the frame being rendered, from the context's frame arena
+	struct draw_item *draw_list;
+};
+
+/**
+ Result of picking: the closest front-facing face under a point. Z is the
+ Z-value of the point on the face, as it would be depth tested.
+ */
+struct pick_result {
+	int instance; // Index in graph->instances, -1 for mesh_pick()
+	int face;
+	double z;
+};
+
+struct mesh *create_mesh(struct model model, struct texture texture, struct texture normal_map);
+void destroy_mesh(struct mesh *mesh);
+
+/**
+ Builds (or rebuilds) a BVH over the faces of a mesh, in model space. See
+ build_bvh() for threads.
+ */
+void mesh_build_bvh(struct mesh *mesh, int threads);
+void mesh_build_edge_list(struct mesh *mesh);
+
+/**
+ Creates an empty scene graph, with frustum culling, sorting and occlusion
+ culling enabled, and no Z-prepass. Occlusion culling does nothing until an
+ instance is marked as an occluder.
+ */
+struct scene_graph *create_scene_graph(void);
+void destroy_scene_graph(struct scene_graph *graph);
+
+/**
+ Adds an instance of a mesh, and returns its index in graph->instances
+ */
+int scene_graph_add_instance(struct scene_graph *graph, struct mesh *mesh, transform_3d transform);
+
+/**
+ Builds (or rebuilds) a BVH over the bounding spheres of all instances
+ */
+void scene_graph_build_bvh(struct scene_graph *graph, int threads);
+
+/**
+ Returns true if the bounding sphere of a mesh, with a model-view transform,
+ can be visible on screen after perspective.
+ */
+bool mesh_is_visible(struct mesh *mesh, transform_3d model_view, struct scene scene, struct graphics_context *context);
+
+/**
+ Returns true if a box, after a transform to view space, can be visible on screen
+ */
+bool box_is_visible(vec3 min, vec3 max, transform_3d transform, struct scene scene, struct graphics_context *context);
+
+/**
+ Draws every face of a mesh. The fragment shader input and the model-view
+ transform are set up by the caller, once for any number of faces.
+ */
+void render_mesh(struct mesh *mesh,
+				 transform_3d transform,
+				 transform_3d model_view,
+				 struct scene scene,
+				 vertex_shader *vertex_shader,
+				 fragment_shader *fragment_shader,
+				 struct fragment_shader_input input,
+				 bool cull_back_faces,
+				 struct graphics_context *context);
+
+/**
+ Finds the face under the screen position (x, y), for example the mouse
+ position. Returns false if there is none.
+ */
+bool mesh_pick(struct mesh *mesh, transform_3d model_view, struct scene scene, double x, double y, struct pick_result *result);
+bool scene_graph_pick(struct scene_graph *graph, struct scene scene, double x, double y, struct pick_result *result);
+
+/**
+ Renders the shadow map of every directional light in the scene that has
+ one, fitted around all instances
+ */
+void scene_graph_render_shadow_maps(struct scene_graph *graph, struct scene scene);
+
+void render_scene_graph(struct scene_graph *graph,
+						struct scene scene,
+						vertex_shader *vertex_shader,
+						fragment_shader *fragment_shader,
+						struct graphics_context *context);
+
+#endif
@@ -1,5 +1,12 @@
 #include "shaders.h"
 #include "textures.h"
+#include "shadow_map.h"
+#include "light_tiles.h"
+#include "cpu_kernels.h"
+#include <math.h>
+
+// How quickly spot lights fade out at the edge of their cone, in cosine
+#define SPOT_SOFTNESS 0.05
 
 vec3 transform_normal(vec3 normal, transform_3d transform) {
 	// Remove translations from the matrix so we only apply scale + rotation to
@@ -29,20 +36,123 @@ vec3 apply_perspective(vec3 position, transform_3d view, double amount) {
     return result;
 }
 
+bool project_view_box(vec3 min, vec3 max, struct scene scene, double rect[4]) {
+	// apply_perspective() moves a point towards the view point by a factor of
+	// z * perspective, so points at z >= 1 / perspective end up behind the eye
+	double near_scale = 1.0 - min.z * scene.perspective;
+	double far_scale = 1.0 - max.z * scene.perspective;
+	if (near_scale <= 0.0) {
+		return false;
+	}
+	if (far_scale <= 0.0) {
+		rect[0] = rect[1] = -INFINITY;
+		rect[2] = rect[3] = INFINITY;
+		return true;
+	}
+
+	// The projected position is bilinear in (x, z) and (y, z), so the corners of
+	// the box give the extent of its projection
+	vec3 view_point = transform_3d_apply((vec3){0, 0, 0}, scene.view);
+	double scales[2] = {near_scale, far_scale};
+	rect[0] = rect[1] = INFINITY;
+	rect[2] = rect[3] = -INFINITY;
+	for (int i = 0; i < 2; i++) {
+		double x[2] = {view_point.x + (min.x - view_point.x) * scales[i], view_point.x + (max.x - view_point.x) * scales[i]};
+		double y[2] = {view_point.y + (min.y - view_point.y) * scales[i], view_point.y + (max.y - view_point.y) * scales[i]};
+		rect[0] = fmin(rect[0], fmin(x[0], x[1]));
+		rect[1] = fmin(rect[1], fmin(y[0], y[1]));
+		rect[2] = fmax(rect[2], fmax(x[0], x[1]));
+		rect[3] = fmax(rect[3], fmax(y[0], y[1]));
+	}
+	return true;
+}
+
+vec3 remove_perspective(vec3 position, transform_3d view, double amount) {
+	vec3 view_point = transform_3d_apply((vec3){0, 0, 0}, view);
+	double scale = 1.0 - position.z * amount;
+	vec3 result = position;
+	result.x = view_point.x + (position.x - view_point.x) / scale;
+	result.y = view_point.y + (position.y - view_point.y) / scale;
+	return result;
+}
+
+vec3 project_position(vec3 position, transform_3d model_view, struct scene scene) {
+	return apply_perspective(transform_3d_apply(position, model_view), scene.view, scene.perspective);
+}
+
+void transform_positions(const vec3 *positions, vec3 *result, int count, transform_3d model_view) {
+	cpu_kernels_active()->transform_points(result, positions, count, model_view);
+}
+
+void project_positions(const vec3 *positions, vec3 *result, int count, transform_3d model_view, struct scene scene) {
+	transform_positions(positions, result, count, model_view);
+	for (int i = 0; i < count; i++) {
+		result[i] = apply_perspective(result[i], scene.view, scene.perspective);
+	}
+}
+
+/**
+ How much of a local light reaches a position with a (shader) normal, from
+ 0.0 to 1.0
+ */
+static double local_light_factor(struct local_light *light, vec3 position, vec3 normal) {
+	vec3 offset = vec3_subtract(position, light->position);
+	double distance_squared = dot_product_3d(offset, offset);
+	if (!(distance_squared < light->radius * light->radius) || distance_squared == 0.0) {
+		return 0.0;
+	}
+
+	double distance = sqrt(distance_squared);
+	vec3 direction = vec3_scale(offset, 1.0 / distance);
+	double factor = dot_product_3d(normal, direction);
+	if (factor <= 0.0) {
+		return 0.0;
+	}
+	if (light->type == LOCAL_LIGHT_SPOT) {
+		// Outside the cone this goes negative, which must not light anything
+		double cone = dot_product_3d(direction, vec3_unit(light->direction));
+		factor *= fmax(fmin((cone - light->cone_cosine) / SPOT_SOFTNESS, 1.0), 0.0);
+	}
+	if (factor <= 0.0) {
+		return 0.0;
+	}
+	double falloff = 1.0 - distance / light->radius;
+	return factor * falloff * falloff;
+}
+
+/**
+ Adds the local lights that reach a vertex to its color. With light tiles,
+ only the lights of the tile at the screen coordinate of the vertex are
+ evaluated, instead of every light in the scene.
+ */
+static packed_color add_local_lights(packed_color color, vec3 position, vec3 normal, vec3 coordinate, struct scene *scene) {
+	int count = scene->local_light_count;
+	const int *indices = scene->light_tiles ? light_tiles_lookup(scene->light_tiles, coordinate.x, coordinate.y, &count) : NULL;
+	for (int i = 0; i < count; i++) {
+		struct local_light *light = &scene->local_lights[indices ? indices[i] : i];
+		double factor = local_light_factor(light, position, normal);
+		if (factor > 0.0) {
+			packed_color light_color = packed_scale(rgba_from_color(light->intensity), color_factor(factor));
+			color = packed_add_saturate(color, light_color);
+		}
+	}
+	return color;
+}
+
 struct vertex goraud_shader(struct vertex_shader_input input) {
 	struct vertex v = input.vertex;
 
 	// Apply all transforms. Rotation, scaling, translation etc
-	transform_3d transform = transform_3d_multiply(input.model, input.scene.view);
-	v.coordinate = transform_3d_apply(v.coordinate, transform);
+	transform_3d transform = input.model_view;
+	vec3 position = input.view_position ? *input.view_position : transform_3d_apply(v.coordinate, transform);
 	v.normal = transform_normal(v.normal, transform);
 
 	// Apply perspective (move x and y further to/away from the middle
 	// depending on the Z value, to give the illusion of depth)
-	v.coordinate = apply_perspective(v.coordinate, input.scene.view, input.scene.perspective);
+	v.coordinate = apply_perspective(position, input.scene.view, input.scene.perspective);
 
 	// Start by setting the color to the ambient light
-	v.color = input.scene.ambient_light;
+	v.color = rgba_from_color(input.scene.ambient_light);
 		
 	// Calculate light intensity by checking the angle of the vertex normal
 	// to the angle of the light direction. If vertex is directly facing the
@@ -52,10 +162,11 @@ struct vertex goraud_shader(struct vertex_shader_input input) {
 		struct directional_light *light = &input.scene.directional_lights[i];
 		double dot_product = dot_product_3d(v.normal, vec3_unit(light->direction));
 		if (dot_product > 0.0) {
-			rgb_color light_color = scale_color(light->intensity, dot_product);
-			v.color = add_color(v.color, light_color);
+			packed_color light_color = packed_scale(rgba_from_color(light->intensity), color_factor(dot_product));
+			v.color = packed_add_saturate(v.color, light_color);
 		}
 	}
+	v.color = add_local_lights(v.color, position, v.normal, v.coordinate, &input.scene);
 	return v;
 }
 
@@ -64,26 +175,51 @@ struct vertex goraud_shader(struct vertex_shader_input input) {
  */
 struct vertex flat_shader(struct vertex_shader_input input) {
 	struct vertex v = input.vertex;
-	transform_3d transform = transform_3d_multiply(input.model, input.scene.view);
-	v.coordinate = transform_3d_apply(v.coordinate, transform);
+	transform_3d transform = input.model_view;
+	vec3 position = input.view_position ? *input.view_position : transform_3d_apply(v.coordinate, transform);
 	v.normal = transform_normal(v.normal, transform);
 	vec3 face_normal = transform_normal(input.face_normal, transform);
 
-	v.coordinate = apply_perspective(v.coordinate, input.scene.view, input.scene.perspective);
-	v.color = input.scene.ambient_light;
+	v.coordinate = apply_perspective(position, input.scene.view, input.scene.perspective);
+	v.color = rgba_from_color(input.scene.ambient_light);
 	for (int i = 0; i < input.scene.directional_light_count; i++) {
 		struct directional_light *light = &input.scene.directional_lights[i];
 		double dot_product = dot_product_3d(face_normal, vec3_unit(light->direction));
 		if (dot_product > 0.0) {
-			rgb_color light_color = scale_color(light->intensity, dot_product);
-			v.color = add_color(v.color, light_color);
+			packed_color light_color = packed_scale(rgba_from_color(light->intensity), color_factor(dot_product));
+			v.color = packed_add_saturate(v.color, light_color);
 		}
 	}
+	v.color = add_local_lights(v.color, position, face_normal, v.coordinate, &input.scene);
 	return v;
 }
 
-rgb_color apply_texture_shader(struct fragment_shader_input input) {
-	rgb_color texture_color = texture_sample(*input.texture, input.interpolated_v.texture_coordinate);
-	rgb_color light_intensity = input.interpolated_v.color;
-	return multiply_colors(light_intensity, texture_color);
+packed_color apply_texture_shader(struct fragment_shader_input input) {
+	COUNT_STAT(input.stats, texture_samples);
+	packed_color texture_color = texture_sample(*input.texture, input.interpolated_v.texture_coordinate);
+	packed_color light_intensity = input.interpolated_v.color;
+	return packed_modulate(light_intensity, texture_color);
+}
+
+packed_color shadowed_texture_shader(struct fragment_shader_input input) {
+	COUNT_STAT(input.stats, texture_samples);
+	packed_color texture_color = texture_sample(*input.texture, input.interpolated_v.texture_coordinate);
+
+	// Light per fragment instead of per vertex, since shadows can start and end
+	// anywhere on a face
+	vec3 position = remove_perspective(input.interpolated_v.coordinate, input.scene.view, input.scene.perspective);
+	vec3 normal = vec3_unit(input.interpolated_v.normal);
+	packed_color light_intensity = rgba_from_color(input.scene.ambient_light);
+	for (int i = 0; i < input.scene.directional_light_count; i++) {
+		struct directional_light *light = &input.scene.directional_lights[i];
+		double intensity = dot_product_3d(normal, vec3_unit(light->direction));
+		if (intensity > 0.0 && light->shadow_map) {
+			intensity *= shadow_map_visibility(light->shadow_map, position, intensity);
+		}
+		if (intensity > 0.0) {
+			packed_color light_color = packed_scale(rgba_from_color(light->intensity), color_factor(intensity));
+			light_intensity = packed_add_saturate(light_intensity, light_color);
+		}
+	}
+	return packed_modulate(light_intensity, texture_color);
 }
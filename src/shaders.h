@@ -2,10 +2,12 @@
 #define SHADERS_H
 
 #include "scene.h"
+#include "pipeline_stats.h"
+#include <stdbool.h>
 
 struct vertex {
 	vec3 coordinate;
-	rgb_color color;
+	packed_color color;
 	vec3 normal;
 	vec2 texture_coordinate;
 };
@@ -14,6 +16,8 @@ struct vertex_shader_input {
 	struct vertex vertex;
 	vec3 face_normal;
 	transform_3d model;
+	transform_3d model_view; // model * scene.view, computed once by the caller
+	const vec3 *view_position; // vertex.coordinate transformed by model_view, if the caller has it, or NULL
 	struct scene scene;
 };
 
@@ -22,10 +26,47 @@ struct fragment_shader_input {
 	struct texture *texture;
 	struct texture *normal_map;
 	struct scene scene;
+	struct pipeline_stats *stats;
 };
 
 typedef struct vertex vertex_shader(struct vertex_shader_input input);
-typedef rgb_color fragment_shader(struct fragment_shader_input input);
+typedef packed_color fragment_shader(struct fragment_shader_input input);
+
+/**
+ Applies perspective to simulate vector positions in 3D-space, relative to a view position
+ */
+vec3 apply_perspective(vec3 position, transform_3d view, double amount);
+
+/**
+ Calculates the screen rectangle (min x, min y, max x, max y) covered by a box
+ in view space (after the model-view transform, before perspective). Returns
+ false if the box is entirely behind the eye. A box that reaches behind the
+ eye covers the whole plane.
+ */
+bool project_view_box(vec3 min, vec3 max, struct scene scene, double rect[4]);
+
+/**
+ Reverses apply_perspective, e.g. to get the view space position of a fragment
+ */
+vec3 remove_perspective(vec3 position, transform_3d view, double amount);
+
+/**
+ Transforms a model space position to the screen, the way the built-in vertex
+ shaders do. Depth-only passes use it to get the exact same coordinates.
+ */
+vec3 project_position(vec3 position, transform_3d model_view, struct scene scene);
+
+/**
+ transform_3d_apply for count positions at once, with the kernels in
+ cpu_kernels.h. Gives the same coordinates.
+ */
+void transform_positions(const vec3 *positions, vec3 *result, int count, transform_3d model_view);
+
+/**
+ project_position for count positions at once, transformed by the kernels
+ in cpu_kernels.h. Gives the same coordinates.
+ */
+void project_positions(const vec3 *positions, vec3 *result, int count, transform_3d model_view, struct scene scene);
 
 // Vertex shaders
 vertex_shader goraud_shader;
@@ -34,4 +75,11 @@ vertex_shader flat_shader;
 // Fragment shaders
 fragment_shader apply_texture_shader;
 
+/**
+ Textured, with lighting calculated per fragment from the interpolated vertex
+ normal, and shadows from the shadow maps of the lights. Use with
+ goraud_shader, which passes the normals on.
+ */
+fragment_shader shadowed_texture_shader;
+
 #endif
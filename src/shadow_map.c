@@ -0,0 +1,92 @@
+#include "shadow_map.h"
+#include "graphics_context.h"
+#include <stdlib.h>
+#include <math.h>
+
+// Pixels left empty around the fitted box, so filtering never reads past it
+#define MARGIN 2
+#define PCF_RADIUS 1
+#define MAX_SLOPE 8.0
+
+struct shadow_map *create_shadow_map(int size) {
+	struct shadow_map *map = malloc(sizeof(struct shadow_map));
+	map->size = size;
+	map->depth = create_depth_buffer(size, size, DEPTH_FORMAT_FLOAT32);
+	map->light_transform = transform_3d_identity;
+	map->bias = 0.0;
+	map->texel_size = 1.0;
+	return map;
+}
+
+void destroy_shadow_map(struct shadow_map *map) {
+	destroy_depth_buffer(map->depth);
+	free(map);
+}
+
+void shadow_map_begin(struct shadow_map *map, vec3 direction, vec3 min, vec3 max) {
+	// An orthonormal basis with Z along the light
+	vec3 z_axis = vec3_unit(direction);
+	vec3 up = fabs(z_axis.y) < 0.9 ? (vec3){0, 1, 0} : (vec3){1, 0, 0};
+	vec3 x_axis = vec3_unit(cross_product(up, z_axis));
+	vec3 y_axis = cross_product(z_axis, x_axis);
+
+	vec3 low = {INFINITY, INFINITY, INFINITY};
+	vec3 high = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = {(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z};
+		vec3 p = {dot_product_3d(corner, x_axis), dot_product_3d(corner, y_axis), dot_product_3d(corner, z_axis)};
+		low = (vec3){fmin(low.x, p.x), fmin(low.y, p.y), fmin(low.z, p.z)};
+		high = (vec3){fmax(high.x, p.x), fmax(high.y, p.y), fmax(high.z, p.z)};
+	}
+
+	// Same scale on both axes, so texels are square
+	double extent = fmax(high.x - low.x, high.y - low.y);
+	double scale = extent > 0.0 ? (map->size - 1 - 2 * MARGIN) / extent : 1.0;
+	transform_3d t = transform_3d_identity;
+	t.sx = x_axis.x * scale; t.ax = x_axis.y * scale; t.bx = x_axis.z * scale; t.tx = MARGIN - low.x * scale;
+	t.ay = y_axis.x * scale; t.sy = y_axis.y * scale; t.by = y_axis.z * scale; t.ty = MARGIN - low.y * scale;
+	t.az = z_axis.x;         t.bz = z_axis.y;         t.sz = z_axis.z;         t.tz = 0.0;
+	map->light_transform = t;
+
+	// Fragment positions are reconstructed from coordinates that were
+	// interpolated after perspective, which puts them slightly off their faces
+	map->texel_size = 1.0 / scale;
+	map->bias = 4.0 * map->texel_size;
+	depth_buffer_set_range(map->depth, low.z - map->bias, high.z + map->bias);
+	depth_buffer_clear(map->depth);
+}
+
+void shadow_map_draw_model(struct shadow_map *map, struct model *model, transform_3d model_view) {
+	transform_3d transform = transform_3d_multiply(model_view, map->light_transform);
+	for (int i = 0; i < model->num_faces; i++) {
+		struct face f = model->faces[i];
+		vec3 coordinates[3];
+		for (int c = 0; c < 3; c++) {
+			coordinates[c] = transform_3d_apply(*f.vertices[c], transform);
+		}
+		depth_triangle(coordinates, map->depth);
+	}
+}
+
+double shadow_map_visibility(struct shadow_map *map, vec3 position, double cosine) {
+	vec3 p = transform_3d_apply(position, map->light_transform);
+	int x = (int)round(p.x);
+	int y = (int)round(p.y);
+
+	// A surface at a grazing angle to the light changes depth quickly from one
+	// texel to the next, so it needs more bias as far out as the filter reaches
+	double slope = fmin(sqrt(fmax(1.0 - cosine * cosine, 0.0)) / fmax(cosine, 1e-3), MAX_SLOPE);
+	double z = p.z - map->bias - slope * (PCF_RADIUS + 1) * map->texel_size;
+
+	int lit = 0;
+	for (int dy = -PCF_RADIUS; dy <= PCF_RADIUS; dy++) {
+		for (int dx = -PCF_RADIUS; dx <= PCF_RADIUS; dx++) {
+			int tx = x + dx;
+			int ty = y + dy;
+			if (tx < 0 || ty < 0 || tx >= map->size || ty >= map->size || z <= depth_buffer_get(map->depth, tx, ty)) {
+				lit++;
+			}
+		}
+	}
+	return lit / (double)((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
+}
@@ -0,0 +1,56 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include "geometry.h"
+#include "depth_buffer.h"
+#include "obj.h"
+
+/**
+ A shadow map for a directional light: the depth of the scene as seen from
+ the light, rendered with the depth-only rasterizer. The light looks along
+ its direction with an orthographic projection, fitted around a box in view
+ space (after the view transform, before perspective) that should contain
+ everything that casts or receives shadows.
+
+ Attach a map to a light (directional_light.shadow_map) and render with
+ shadowed_texture_shader to get shadows.
+ */
+struct shadow_map {
+	int size;
+	struct depth_buffer *depth;
+
+	// View space to shadow map space: X and Y in pixels of the map, and Z
+	// along the light direction (lower Z-values are closer to the light)
+	transform_3d light_transform;
+
+	// Depth offset against shadow acne, in view space units. Set by
+	// shadow_map_begin(), to a few shadow map pixels.
+	double bias;
+	double texel_size; // Size of a shadow map pixel in view space units
+};
+
+struct shadow_map *create_shadow_map(int size);
+void destroy_shadow_map(struct shadow_map *map);
+
+/**
+ Fits the map around a box in view space, looking along direction, and
+ clears it
+ */
+void shadow_map_begin(struct shadow_map *map, vec3 direction, vec3 min, vec3 max);
+
+/**
+ Draws the depth of every face of a model (with a model-view transform) into
+ the map. Back faces cast shadows too, so open meshes work.
+ */
+void shadow_map_draw_model(struct shadow_map *map, struct model *model, transform_3d model_view);
+
+/**
+ Returns how much of the light reaches a position in view space, from 0.0 (in
+ shadow) to 1.0 (lit), filtered over 3x3 shadow map pixels (percentage
+ closer filtering). Positions outside the map are lit. Cosine is the dot
+ product of the surface normal and the light direction, and scales the bias
+ with the slope of the surface.
+ */
+double shadow_map_visibility(struct shadow_map *map, vec3 position, double cosine);
+
+#endif
@@ -0,0 +1,486 @@
+#include "streamed_mesh.h"
+#include "compact_mesh.h"
+#include "object.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+
+#define STREAMED_MESH_MAGIC "C3DOMSH1"
+
+// Chunks within this fraction of the screen size outside of it are prefetched
+#define PREFETCH_MARGIN 0.25
+
+// ********** File format **********
+
+struct file_header {
+	char magic[8];
+	uint32_t chunk_count;
+	uint32_t reserved;
+};
+
+/**
+ Followed in the file (at offset) by the vertices and then the indices
+ */
+struct chunk_header {
+	vec3 min;
+	vec3 max;
+	vec3 position_offset;
+	vec3 position_scale;
+	uint32_t num_vertices;
+	uint32_t num_faces;
+	uint64_t offset;
+};
+
+struct face_key {
+	uint32_t code;
+	int face;
+};
+
+/**
+ Spreads the low 10 bits of a value out to every third bit
+ */
+static uint32_t spread_bits(uint32_t v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+static uint32_t morton_code(vec3 p, vec3 min, vec3 max) {
+	double t[3] = {(p.x - min.x) / (max.x - min.x), (p.y - min.y) / (max.y - min.y), (p.z - min.z) / (max.z - min.z)};
+	uint32_t q[3];
+	for (int i = 0; i < 3; i++) {
+		q[i] = isfinite(t[i]) ? (uint32_t)fmin(fmax(t[i] * 1023.0, 0.0), 1023.0) : 0;
+	}
+	return spread_bits(q[0]) | spread_bits(q[1]) << 1 | spread_bits(q[2]) << 2;
+}
+
+static int compare_face_keys(const void *a, const void *b) {
+	const struct face_key *ka = a;
+	const struct face_key *kb = b;
+	if (ka->code != kb->code) {
+		return ka->code < kb->code ? -1 : 1;
+	}
+	return ka->face - kb->face;
+}
+
+bool write_streamed_mesh(struct model model, FILE *fp, int faces_per_chunk) {
+	vec3 min = {INFINITY, INFINITY, INFINITY};
+	vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < model.num_vertices; i++) {
+		vec3 p = model.vertices[i];
+		min = (vec3){fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z)};
+		max = (vec3){fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z)};
+	}
+
+	struct face_key *keys = malloc(sizeof(struct face_key) * (model.num_faces > 0 ? model.num_faces : 1));
+	for (int i = 0; i < model.num_faces; i++) {
+		struct face f = model.faces[i];
+		vec3 center = vec3_scale(vec3_add(vec3_add(*f.vertices[0], *f.vertices[1]), *f.vertices[2]), 1.0 / 3.0);
+		keys[i] = (struct face_key){morton_code(center, min, max), i};
+	}
+	qsort(keys, model.num_faces, sizeof(struct face_key), &compare_face_keys);
+
+	struct file_header header = {.magic = STREAMED_MESH_MAGIC};
+	header.chunk_count = (model.num_faces + faces_per_chunk - 1) / faces_per_chunk;
+	struct chunk_header *table = calloc(header.chunk_count > 0 ? header.chunk_count : 1, sizeof(struct chunk_header));
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			  fwrite(table, sizeof(struct chunk_header), header.chunk_count, fp) == header.chunk_count;
+
+	// Each chunk is a model with all of the vertices and some of the faces
+	struct model chunk_model = model;
+	chunk_model.faces = malloc(sizeof(struct face) * faces_per_chunk);
+	for (uint32_t c = 0; c < header.chunk_count && ok; c++) {
+		int first = c * faces_per_chunk;
+		chunk_model.num_faces = model.num_faces - first < faces_per_chunk ? model.num_faces - first : faces_per_chunk;
+
+		struct chunk_header *chunk = &table[c];
+		chunk->min = (vec3){INFINITY, INFINITY, INFINITY};
+		chunk->max = (vec3){-INFINITY, -INFINITY, -INFINITY};
+		for (int i = 0; i < chunk_model.num_faces; i++) {
+			struct face f = model.faces[keys[first + i].face];
+			chunk_model.faces[i] = f;
+			for (int v = 0; v < 3; v++) {
+				vec3 p = *f.vertices[v];
+				chunk->min = (vec3){fmin(chunk->min.x, p.x), fmin(chunk->min.y, p.y), fmin(chunk->min.z, p.z)};
+				chunk->max = (vec3){fmax(chunk->max.x, p.x), fmax(chunk->max.y, p.y), fmax(chunk->max.z, p.z)};
+			}
+		}
+
+		struct compact_mesh *compact = create_compact_mesh_in_bounds(chunk_model, min, max);
+		chunk->position_offset = compact->position_offset;
+		chunk->position_scale = compact->position_scale;
+		chunk->num_vertices = compact->num_vertices;
+		chunk->num_faces = compact->num_faces;
+		chunk->offset = (uint64_t)ftell(fp);
+		ok = fwrite(compact->vertices, sizeof(struct compact_vertex), compact->num_vertices, fp) == (size_t)compact->num_vertices &&
+			 fwrite(compact->indices, sizeof(uint32_t), 3 * compact->num_faces, fp) == (size_t)(3 * compact->num_faces);
+		destroy_compact_mesh(compact);
+	}
+
+	// Now that the offsets are known, fill in the table
+	ok = ok && fseek(fp, sizeof(header), SEEK_SET) == 0 &&
+		 fwrite(table, sizeof(struct chunk_header), header.chunk_count, fp) == header.chunk_count && fflush(fp) == 0;
+
+	free(chunk_model.faces);
+	free(table);
+	free(keys);
+	return ok;
+}
+
+// ********** Residency **********
+
+enum chunk_state {
+	CHUNK_EVICTED,
+	CHUNK_QUEUED, // Waiting for or being loaded, its memory already counts as used
+	CHUNK_RESIDENT,
+	CHUNK_FAILED
+};
+
+struct chunk {
+	struct chunk_header header;
+	size_t memory;
+	enum chunk_state state;
+	struct compact_mesh *mesh;
+	long last_used; // Frame that last drew (or prefetched) the chunk
+};
+
+struct visible_chunk {
+	int chunk;
+	double depth;
+};
+
+struct streamed_mesh {
+	FILE *file;
+	int chunk_count;
+	struct chunk *chunks;
+
+	// Chunks to load, in order. The loader takes them from queue_next on.
+	int *queue;
+	int queue_count;
+	int queue_next;
+	int loading; // Chunk being read by the loader, -1 if none
+
+	size_t memory_budget;
+	size_t resident_bytes;
+	long frame;
+	struct streamed_mesh_stats stats;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t requested;
+	pthread_cond_t loaded;
+	bool quit;
+
+	// Scratch for render_streamed_mesh
+	struct visible_chunk *visible;
+	struct compact_mesh **draw_list;
+};
+
+static struct compact_mesh *read_chunk(FILE *fp, struct chunk_header *header) {
+	if (fseek(fp, (long)header->offset, SEEK_SET) != 0) {
+		return NULL;
+	}
+	struct compact_mesh *mesh = malloc(sizeof(struct compact_mesh));
+	mesh->num_vertices = header->num_vertices;
+	mesh->num_faces = header->num_faces;
+	mesh->position_offset = header->position_offset;
+	mesh->position_scale = header->position_scale;
+	mesh->vertices = malloc(sizeof(struct compact_vertex) * (header->num_vertices > 0 ? header->num_vertices : 1));
+	mesh->indices = malloc(sizeof(uint32_t) * 3 * (header->num_faces > 0 ? header->num_faces : 1));
+	if (fread(mesh->vertices, sizeof(struct compact_vertex), header->num_vertices, fp) != header->num_vertices ||
+		fread(mesh->indices, sizeof(uint32_t), 3 * header->num_faces, fp) != 3 * header->num_faces) {
+		destroy_compact_mesh(mesh);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < 3 * header->num_faces; i++) {
+		if (mesh->indices[i] >= header->num_vertices) {
+			destroy_compact_mesh(mesh);
+			return NULL;
+		}
+	}
+	return mesh;
+}
+
+static void *loader_thread(void *argument) {
+	struct streamed_mesh *mesh = argument;
+	pthread_mutex_lock(&mesh->mutex);
+	while (true) {
+		while (mesh->queue_next == mesh->queue_count && !mesh->quit) {
+			pthread_cond_wait(&mesh->requested, &mesh->mutex);
+		}
+		if (mesh->quit) {
+			break;
+		}
+
+		int index = mesh->queue[mesh->queue_next++];
+		struct chunk_header header = mesh->chunks[index].header;
+		mesh->loading = index;
+		pthread_mutex_unlock(&mesh->mutex);
+		struct compact_mesh *data = read_chunk(mesh->file, &header);
+		pthread_mutex_lock(&mesh->mutex);
+
+		struct chunk *chunk = &mesh->chunks[index];
+		mesh->loading = -1;
+		if (data) {
+			chunk->state = CHUNK_RESIDENT;
+			chunk->mesh = data;
+			chunk->last_used = mesh->frame;
+			mesh->stats.loads++;
+		} else {
+			chunk->state = CHUNK_FAILED;
+			mesh->resident_bytes -= chunk->memory;
+		}
+		pthread_cond_broadcast(&mesh->loaded);
+	}
+	pthread_mutex_unlock(&mesh->mutex);
+	return NULL;
+}
+
+struct streamed_mesh *open_streamed_mesh(FILE *fp, size_t memory_budget) {
+	struct file_header header;
+	if (fseek(fp, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, fp) != 1 ||
+		memcmp(header.magic, STREAMED_MESH_MAGIC, sizeof(header.magic)) != 0) {
+		return NULL;
+	}
+
+	struct streamed_mesh *mesh = calloc(1, sizeof(struct streamed_mesh));
+	mesh->file = fp;
+	mesh->chunk_count = header.chunk_count;
+	mesh->chunks = calloc(header.chunk_count > 0 ? header.chunk_count : 1, sizeof(struct chunk));
+	for (int i = 0; i < mesh->chunk_count; i++) {
+		struct chunk *chunk = &mesh->chunks[i];
+		if (fread(&chunk->header, sizeof(struct chunk_header), 1, fp) != 1) {
+			free(mesh->chunks);
+			free(mesh);
+			return NULL;
+		}
+		chunk->memory = sizeof(struct compact_mesh) + sizeof(struct compact_vertex) * chunk->header.num_vertices +
+						sizeof(uint32_t) * 3 * chunk->header.num_faces;
+	}
+
+	int capacity = mesh->chunk_count > 0 ? mesh->chunk_count : 1;
+	mesh->queue = malloc(sizeof(int) * capacity);
+	mesh->visible = malloc(sizeof(struct visible_chunk) * capacity);
+	mesh->draw_list = malloc(sizeof(struct compact_mesh *) * capacity);
+	mesh->loading = -1;
+	mesh->memory_budget = memory_budget;
+	mesh->stats.chunks = mesh->chunk_count;
+	mesh->stats.memory_budget = memory_budget;
+
+	pthread_mutex_init(&mesh->mutex, NULL);
+	pthread_cond_init(&mesh->requested, NULL);
+	pthread_cond_init(&mesh->loaded, NULL);
+	pthread_create(&mesh->thread, NULL, &loader_thread, mesh);
+	return mesh;
+}
+
+void close_streamed_mesh(struct streamed_mesh *mesh) {
+	pthread_mutex_lock(&mesh->mutex);
+	mesh->quit = true;
+	pthread_cond_signal(&mesh->requested);
+	pthread_mutex_unlock(&mesh->mutex);
+	pthread_join(mesh->thread, NULL);
+
+	for (int i = 0; i < mesh->chunk_count; i++) {
+		if (mesh->chunks[i].state == CHUNK_RESIDENT) {
+			destroy_compact_mesh(mesh->chunks[i].mesh);
+		}
+	}
+	pthread_cond_destroy(&mesh->loaded);
+	pthread_cond_destroy(&mesh->requested);
+	pthread_mutex_destroy(&mesh->mutex);
+	free(mesh->draw_list);
+	free(mesh->visible);
+	free(mesh->queue);
+	free(mesh->chunks);
+	free(mesh);
+}
+
+/**
+ Queues a chunk for loading, evicting the least recently used chunks that
+ weren't used this frame until it fits in the budget. Returns false, and
+ evicts nothing, if it wouldn't fit even with all of them evicted. Must be
+ called with the mutex held.
+ */
+static bool request_chunk(struct streamed_mesh *mesh, int index) {
+	struct chunk *chunk = &mesh->chunks[index];
+	size_t evictable = 0;
+	for (int i = 0; i < mesh->chunk_count; i++) {
+		struct chunk *c = &mesh->chunks[i];
+		if (c->state == CHUNK_RESIDENT && c->last_used < mesh->frame) {
+			evictable += c->memory;
+		}
+	}
+	if (mesh->resident_bytes - evictable + chunk->memory > mesh->memory_budget) {
+		return false;
+	}
+
+	while (mesh->resident_bytes + chunk->memory > mesh->memory_budget) {
+		int victim = -1;
+		for (int i = 0; i < mesh->chunk_count; i++) {
+			struct chunk *c = &mesh->chunks[i];
+			if (c->state == CHUNK_RESIDENT && c->last_used < mesh->frame &&
+				(victim < 0 || c->last_used < mesh->chunks[victim].last_used)) {
+				victim = i;
+			}
+		}
+		if (victim < 0) {
+			return false;
+		}
+		struct chunk *evicted = &mesh->chunks[victim];
+		destroy_compact_mesh(evicted->mesh);
+		evicted->mesh = NULL;
+		evicted->state = CHUNK_EVICTED;
+		mesh->resident_bytes -= evicted->memory;
+		mesh->stats.evictions++;
+	}
+
+	chunk->state = CHUNK_QUEUED;
+	mesh->resident_bytes += chunk->memory;
+	if (mesh->resident_bytes > mesh->stats.peak_resident_bytes) {
+		mesh->stats.peak_resident_bytes = mesh->resident_bytes;
+	}
+	mesh->queue[mesh->queue_count++] = index;
+	return true;
+}
+
+// ********** Rendering **********
+
+static int compare_visible_chunks(const void *a, const void *b) {
+	double da = ((const struct visible_chunk *)a)->depth;
+	double db = ((const struct visible_chunk *)b)->depth;
+	return (da > db) - (da < db);
+}
+
+/**
+ Projects the bounds of a chunk to the screen. Returns false if the chunk is
+ behind the camera.
+ */
+static bool project_chunk(struct chunk_header *header, transform_3d model_view, struct scene scene, double rect[4], double *depth) {
+	vec3 view_min = {INFINITY, INFINITY, INFINITY};
+	vec3 view_max = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = {(i & 1) ? header->max.x : header->min.x, (i & 2) ? header->max.y : header->min.y,
+					   (i & 4) ? header->max.z : header->min.z};
+		vec3 p = transform_3d_apply(corner, model_view);
+		view_min = (vec3){fmin(view_min.x, p.x), fmin(view_min.y, p.y), fmin(view_min.z, p.z)};
+		view_max = (vec3){fmax(view_max.x, p.x), fmax(view_max.y, p.y), fmax(view_max.z, p.z)};
+	}
+	*depth = view_min.z;
+	return project_view_box(view_min, view_max, scene, rect);
+}
+
+int render_streamed_mesh(struct streamed_mesh *mesh,
+						 transform_3d transform,
+						 struct texture *texture,
+						 struct texture *normal_map,
+						 struct scene scene,
+						 vertex_shader *vertex_shader,
+						 fragment_shader *fragment_shader,
+						 struct graphics_context *context)
+{
+	// Visible chunks go to the front of the list and chunks in the prefetch
+	// margin to the back, each sorted nearest first
+	transform_3d model_view = transform_3d_multiply(transform, scene.view);
+	double margin_x = context->width * PREFETCH_MARGIN;
+	double margin_y = context->height * PREFETCH_MARGIN;
+	int visible_count = 0;
+	int prefetch_count = 0;
+	for (int i = 0; i < mesh->chunk_count; i++) {
+		double rect[4];
+		double depth;
+		if (!project_chunk(&mesh->chunks[i].header, model_view, scene, rect, &depth) || rect[2] < -margin_x ||
+			rect[3] < -margin_y || rect[0] > context->width + margin_x || rect[1] > context->height + margin_y) {
+			continue;
+		}
+		if (rect[2] < 0 || rect[3] < 0 || rect[0] > context->width || rect[1] > context->height) {
+			mesh->visible[mesh->chunk_count - ++prefetch_count] = (struct visible_chunk){i, depth};
+		} else {
+			mesh->visible[visible_count++] = (struct visible_chunk){i, depth};
+		}
+	}
+	struct visible_chunk *prefetch = &mesh->visible[mesh->chunk_count - prefetch_count];
+	qsort(mesh->visible, visible_count, sizeof(struct visible_chunk), &compare_visible_chunks);
+	qsort(prefetch, prefetch_count, sizeof(struct visible_chunk), &compare_visible_chunks);
+
+	pthread_mutex_lock(&mesh->mutex);
+	mesh->frame++;
+
+	// Requests that the loader hasn't started on are replaced by this frame's
+	for (int i = mesh->queue_next; i < mesh->queue_count; i++) {
+		struct chunk *chunk = &mesh->chunks[mesh->queue[i]];
+		chunk->state = CHUNK_EVICTED;
+		mesh->resident_bytes -= chunk->memory;
+	}
+	mesh->queue_count = mesh->queue_next = 0;
+
+	// Visible chunks are marked as used first, so requests can't evict them
+	int draw_count = 0;
+	for (int i = 0; i < visible_count; i++) {
+		struct chunk *chunk = &mesh->chunks[mesh->visible[i].chunk];
+		if (chunk->state == CHUNK_RESIDENT) {
+			chunk->last_used = mesh->frame;
+			mesh->draw_list[draw_count++] = chunk->mesh;
+		}
+	}
+	bool full = false;
+	for (int i = 0; i < visible_count && !full; i++) {
+		if (mesh->chunks[mesh->visible[i].chunk].state == CHUNK_EVICTED) {
+			full = !request_chunk(mesh, mesh->visible[i].chunk);
+		}
+	}
+
+	int prefetched = 0;
+	for (int i = 0; i < prefetch_count; i++) {
+		struct chunk *chunk = &mesh->chunks[prefetch[i].chunk];
+		if (chunk->state == CHUNK_RESIDENT) {
+			chunk->last_used = mesh->frame;
+		}
+	}
+	for (int i = 0; i < prefetch_count && !full; i++) {
+		if (mesh->chunks[prefetch[i].chunk].state == CHUNK_EVICTED) {
+			full = !request_chunk(mesh, prefetch[i].chunk);
+			prefetched += !full;
+		}
+	}
+	if (mesh->queue_count > 0) {
+		pthread_cond_signal(&mesh->requested);
+	}
+
+	int missing = visible_count - draw_count;
+	mesh->stats.visible_chunks = visible_count;
+	mesh->stats.missing_chunks = missing;
+	mesh->stats.prefetched_chunks = prefetched;
+	pthread_mutex_unlock(&mesh->mutex);
+
+	// Only this thread evicts chunks, so the drawn ones stay loaded
+	for (int i = 0; i < draw_count; i++) {
+		render_compact_mesh(mesh->draw_list[i], transform, texture, normal_map, scene, vertex_shader, fragment_shader, context);
+	}
+	return missing;
+}
+
+void streamed_mesh_wait(struct streamed_mesh *mesh) {
+	pthread_mutex_lock(&mesh->mutex);
+	while (mesh->queue_next < mesh->queue_count || mesh->loading >= 0) {
+		pthread_cond_wait(&mesh->loaded, &mesh->mutex);
+	}
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+struct streamed_mesh_stats streamed_mesh_get_stats(struct streamed_mesh *mesh) {
+	pthread_mutex_lock(&mesh->mutex);
+	struct streamed_mesh_stats stats = mesh->stats;
+	stats.resident_bytes = mesh->resident_bytes;
+	stats.resident_chunks = 0;
+	for (int i = 0; i < mesh->chunk_count; i++) {
+		stats.resident_chunks += mesh->chunks[i].state == CHUNK_RESIDENT;
+	}
+	pthread_mutex_unlock(&mesh->mutex);
+	return stats;
+}
@@ -0,0 +1,78 @@
+#ifndef STREAMED_MESH_H
+#define STREAMED_MESH_H
+
+#include "graphics_context.h"
+#include "textures.h"
+#include "shaders.h"
+#include "scene.h"
+#include "obj.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ Writes a model as a chunked mesh file. Faces are sorted along a Morton curve
+ through their centers and cut into chunks of faces_per_chunk, so each chunk
+ covers a compact part of space. Chunks are stored as compact meshes (see
+ compact_mesh.h), all quantized within the bounds of the whole model, with a
+ table of chunk bounds at the start of the file. Returns false on write errors.
+ */
+bool write_streamed_mesh(struct model model, FILE *fp, int faces_per_chunk);
+
+/**
+ A chunked mesh file that is rendered without loading it all. Only the chunk
+ table is read up front. Chunks are read from the file on a background thread
+ as they come into view, and kept in memory until the space is needed for
+ other chunks, least recently drawn first.
+
+ The memory used by loaded chunks (and chunks being loaded) never goes over
+ memory_budget. A chunk that doesn't fit in the budget next to the chunks
+ drawn in the same frame is not loaded, and stays missing from the image.
+ */
+struct streamed_mesh;
+
+struct streamed_mesh_stats {
+	int chunks;
+	int resident_chunks;
+	int visible_chunks;   // In the last frame
+	int missing_chunks;   // Visible in the last frame, but not drawn
+	int prefetched_chunks; // Requested in the last frame before they were visible
+	size_t memory_budget;
+	size_t resident_bytes;
+	size_t peak_resident_bytes;
+	long loads;
+	long evictions;
+};
+
+/**
+ Reads the chunk table of a file written by write_streamed_mesh. The file
+ must stay open until the mesh is closed. Returns NULL if the file can't be
+ read.
+ */
+struct streamed_mesh *open_streamed_mesh(FILE *fp, size_t memory_budget);
+void close_streamed_mesh(struct streamed_mesh *mesh);
+
+/**
+ Draws the chunks that are visible and loaded, and asks the background
+ thread for the missing ones, nearest first. Chunks just outside the view are
+ requested too when there is room, so they are ready before they come into
+ view. Returns the number of visible chunks that were not drawn, so a caller
+ can render progressively until it reaches 0.
+ */
+int render_streamed_mesh(struct streamed_mesh *mesh,
+						 transform_3d transform,
+						 struct texture *texture,
+						 struct texture *normal_map,
+						 struct scene scene,
+						 vertex_shader *vertex_shader,
+						 fragment_shader *fragment_shader,
+						 struct graphics_context *context);
+
+/**
+ Blocks until every requested chunk has been loaded
+ */
+void streamed_mesh_wait(struct streamed_mesh *mesh);
+
+struct streamed_mesh_stats streamed_mesh_get_stats(struct streamed_mesh *mesh);
+
+#endif
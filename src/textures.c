@@ -1,27 +1,42 @@
 #include "textures.h"
-#include <SDL2/SDL.h>
+#include "bmp.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+bool load_texture_file(const char *file_name, struct texture *texture) {
+	uint32_t *pixels;
+	if (!bmp_read(file_name, &pixels, &texture->width, &texture->height)) {
+		return false;
+	}
+	texture->_internal = pixels;
+	return true;
+}
 
 struct texture load_texture(char *file_name) {
 	struct texture texture;
-
-	SDL_Surface *surface = SDL_LoadBMP(file_name);
-	if (!surface) {
+	if (!load_texture_file(file_name, &texture)) {
 		fprintf(stderr, "Failed to load texture: %s", file_name);
 		abort();
-    }
-
-	SDL_Surface *better_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
-	SDL_FreeSurface(surface);
-
-	texture.width = better_surface->w;
-	texture.height = better_surface->h;
+	}
+	return texture;
+}
 
-	size_t buffer_size = texture.width * texture.height * sizeof(int32_t);
-	void *buffer = malloc(buffer_size);
-	memcpy(buffer, better_surface->pixels, buffer_size);
+/**
+ Creates a grey/white checkerboard texture in memory. Useful when no texture
+ files are available, e.g. for benchmarks.
+ */
+struct texture create_checkerboard_texture(int size, int squares) {
+	struct texture texture = {.width = size, .height = size};
+	uint32_t *buffer = malloc(size * size * sizeof(uint32_t));
+	int square_size = size / squares > 0 ? size / squares : 1;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			bool odd = ((x / square_size) + (y / square_size)) % 2;
+			buffer[y * size + x] = odd ? 0xffffffff : 0x808080ff;
+		}
+	}
 	texture._internal = buffer;
-	SDL_FreeSurface(better_surface);
 	return texture;
 }
 
@@ -29,14 +44,13 @@ void unload_texture(struct texture t) {
 	free(t._internal);
 }
 
-rgb_color texture_sample(struct texture t, vec2 coordinate) {
+packed_color texture_sample(struct texture t, vec2 coordinate) {
 	int x = (int)(coordinate.x * t.width);
 	int y = (int)((1.0 - coordinate.y) * t.height);
+
+	// Clamp to the edges, coordinates of exactly 0.0 or 1.0 would otherwise read outside the texture
+	x = x < 0 ? 0 : (x >= t.width ? t.width - 1 : x);
+	y = y < 0 ? 0 : (y >= t.height ? t.height - 1 : y);
 	uint32_t *pixel_buffer = (uint32_t *)t._internal;
-	uint32_t pixel = pixel_buffer[t.width * y + x];
-	rgb_color color;
-	color.r = pixel >> 24;
-	color.g = pixel >> 16;
-	color.b = pixel >> 8;
-	return color;
+	return pixel_buffer[t.width * y + x] | PACKED_COLOR_ALPHA;
 }
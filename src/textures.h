@@ -3,6 +3,7 @@
 
 #include "geometry.h"
 #include "color.h"
+#include <stdbool.h>
 
 struct texture {
 	int width;
@@ -10,8 +11,14 @@ struct texture {
 	void *_internal;
 };
 
+/**
+ Loads an uncompressed BMP file (see bmp.h). load_texture aborts on files it
+ can't load, load_texture_file returns false.
+ */
 struct texture load_texture(char *file_name);
+bool load_texture_file(const char *file_name, struct texture *texture);
+struct texture create_checkerboard_texture(int size, int squares);
 void unload_texture(struct texture t);
-rgb_color texture_sample(struct texture t, vec2 coordinate);
+packed_color texture_sample(struct texture t, vec2 coordinate);
 
 #endif
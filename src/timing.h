@@ -0,0 +1,9 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/**
+ Milliseconds on a monotonic clock, for measuring how long things take
+ */
+double timing_now_ms(void);
+
+#endif
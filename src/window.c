@@ -0,0 +1,47 @@
+#include "window.h"
+#include <stdio.h>
+
+static SDL_Surface *create_surface_from_context(struct graphics_context *context) {
+	return SDL_CreateRGBSurfaceFrom(context->pixel_buffer,
+									context->width,
+									context->height,
+									32,
+									context->width * sizeof(uint32_t),
+									0xff000000, 0x00ff0000, 0x0000ff00, 0);
+}
+
+void context_activate_window(struct graphics_context *context) {
+	if (SDL_Init(SDL_INIT_VIDEO) != 0){
+		printf("SDL_Init Error: %s\n", SDL_GetError());
+		SDL_Quit();
+	}
+
+	SDL_Window *window = SDL_CreateWindow("c3do", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, context->width, context->height, SDL_WINDOW_OPENGL);
+	if (window == NULL) {
+		printf("Could not create window: %s\n", SDL_GetError());
+	}
+	context->_internal = window;
+
+	SDL_Event event;
+	while (SDL_WaitEvent(&event)) {
+		if (event.type == SDL_QUIT)
+			break;
+
+		if (context->window_event_callback) {
+			context->window_event_callback(context, event);
+		}
+	}
+
+	if (window) {
+		SDL_DestroyWindow(window);
+	}
+	context->_internal = NULL;
+}
+
+void context_refresh_window(struct graphics_context *context) {
+	context_resolve_msaa(context);
+	SDL_Surface *surface = create_surface_from_context(context);
+	SDL_BlitSurface(surface, NULL, SDL_GetWindowSurface(context->_internal), NULL);
+	SDL_UpdateWindowSurface(context->_internal);
+	SDL_FreeSurface(surface);
+}
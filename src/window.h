@@ -0,0 +1,19 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include "graphics_context.h"
+#include <SDL2/SDL.h>
+
+/**
+ Shows the context in an SDL window, and passes its events to the context's
+ window_event_callback until it is closed. The window is destroyed before
+ returning.
+ */
+void context_activate_window(struct graphics_context *context);
+
+/**
+ Copies pixel_buffer to the window (resolving MSAA first)
+ */
+void context_refresh_window(struct graphics_context *context);
+
+#endif
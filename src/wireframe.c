@@ -0,0 +1,96 @@
+#include "wireframe.h"
+#include "shaders.h"
+#include <stdlib.h>
+
+static uint32_t hash_edge(int a, int b) {
+	uint32_t h = (uint32_t)a * 0x9e3779b1u;
+	h ^= (uint32_t)b * 0x85ebca77u;
+	return h ^ (h >> 15);
+}
+
+struct edge_list *create_edge_list(struct model model) {
+	struct edge_list *edges = malloc(sizeof(struct edge_list));
+	int corners = model.num_faces * 3;
+	edges->edges = malloc(sizeof(struct edge) * (corners > 0 ? corners : 1));
+	edges->count = 0;
+
+	// Find shared edges with an open addressing hash table, keyed by the
+	// vertex indices in increasing order
+	int table_size = 16;
+	while (table_size < corners * 2) {
+		table_size *= 2;
+	}
+	int *table = malloc(sizeof(int) * table_size);
+	for (int i = 0; i < table_size; i++) {
+		table[i] = -1;
+	}
+
+	for (int f = 0; f < model.num_faces; f++) {
+		struct face face = model.faces[f];
+		for (int c = 0; c < 3; c++) {
+			int a = (int)(face.vertices[c] - model.vertices);
+			int b = (int)(face.vertices[(c + 1) % 3] - model.vertices);
+			if (a > b) {
+				int tmp = a;
+				a = b;
+				b = tmp;
+			}
+
+			uint32_t slot = hash_edge(a, b) & (table_size - 1);
+			while (table[slot] >= 0) {
+				struct edge *other = &edges->edges[table[slot]];
+				if (other->vertices[0] == a && other->vertices[1] == b) {
+					break;
+				}
+				slot = (slot + 1) & (table_size - 1);
+			}
+
+			if (table[slot] < 0) {
+				table[slot] = edges->count;
+				edges->edges[edges->count++] = (struct edge){.vertices = {a, b}, .faces = {f, -1}};
+			} else if (edges->edges[table[slot]].faces[1] < 0) {
+				edges->edges[table[slot]].faces[1] = f;
+			}
+		}
+	}
+	free(table);
+
+	edges->edges = realloc(edges->edges, sizeof(struct edge) * (edges->count > 0 ? edges->count : 1));
+	return edges;
+}
+
+void destroy_edge_list(struct edge_list *edges) {
+	free(edges->edges);
+	free(edges);
+}
+
+void render_wireframe(struct edge_list *edges,
+					  struct model model,
+					  transform_3d model_view,
+					  struct scene scene,
+					  rgb_color color,
+					  bool depth_tested,
+					  struct graphics_context *context)
+{
+	vec3 *projected = frame_arena_alloc(context->arena, sizeof(vec3) * model.num_vertices);
+	project_positions(model.vertices, projected, model.num_vertices, model_view, scene);
+
+	// Same test as coordinates_are_front_facing(), which only depends on the
+	// sign of the Z of the face normal, so it isn't normalized
+	bool *front_facing = frame_arena_alloc(context->arena, sizeof(bool) * model.num_faces);
+	for (int i = 0; i < model.num_faces; i++) {
+		struct face face = model.faces[i];
+		vec3 a = projected[face.vertices[0] - model.vertices];
+		vec3 v = vec3_subtract(projected[face.vertices[1] - model.vertices], a);
+		vec3 u = vec3_subtract(projected[face.vertices[2] - model.vertices], a);
+		front_facing[i] = !(u.x * v.y - u.y * v.x < 0.0);
+	}
+
+	packed_color rgba = rgba_from_color(color);
+	for (int i = 0; i < edges->count; i++) {
+		struct edge edge = edges->edges[i];
+		if (front_facing[edge.faces[0]] || (edge.faces[1] >= 0 && front_facing[edge.faces[1]])) {
+			draw_line_3d(projected[edge.vertices[0]], projected[edge.vertices[1]], rgba, depth_tested, context);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include "graphics_context.h"
+#include "scene.h"
+#include "obj.h"
+#include <stdbool.h>
+
+/**
+ An edge between two vertices of a model, with the faces on either side of
+ it (faces[1] is -1 on the border of the model). Edges shared by more than
+ two faces only keep the first two.
+ */
+struct edge {
+	int vertices[2];
+	int faces[2];
+};
+
+/**
+ Every edge of a model, once. Drawing the three edges of every face draws the
+ edges inside the model twice; an edge list draws each of them once.
+ */
+struct edge_list {
+	struct edge *edges;
+	int count;
+};
+
+struct edge_list *create_edge_list(struct model model);
+void destroy_edge_list(struct edge_list *edges);
+
+/**
+ Draws the edges of a model that border a front face, with the same
+ coordinates as render_object with the built-in vertex shaders. Every vertex
+ is projected once, into the context's frame arena. With depth_tested, edges
+ hidden behind what has been drawn (usually the model itself) are left out.
+ */
+void render_wireframe(struct edge_list *edges,
+					  struct model model,
+					  transform_3d model_view,
+					  struct scene scene,
+					  rgb_color color,
+					  bool depth_tested,
+					  struct graphics_context *context);
+
+#endif